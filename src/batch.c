@@ -7,23 +7,24 @@
 #include "dsl.h"
 #include "hash_table.h"
 #include "message.h"
+#include "thread_pool.h"
 #include "utils.h"
 #include "vector.h"
 
 #define BATCH_MAX_SELECT 1
 #define BATCH_MAX_SELECT_POS 1
 
+// Variables read and written by a single operator, at most.
+#define BATCH_MAX_INPUTS 5
+#define BATCH_MAX_OUTPUTS 2
+
 #define BATCH_TABLE_INITIAL_CAPACITY 64
 #define BATCH_TABLE_LOAD_FACTOR 0.75f
 
 void batch_select(ClientContext *client_context, GeneralizedColumnHandle *col_hdl,
         Comparator *comparators, char **pos_out_vars, unsigned int batch_size, Message *message) {
     Column *source;
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     ColumnIndex *index;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
@@ -31,15 +32,23 @@ void batch_select(ClientContext *client_context, GeneralizedColumnHandle *col_hd
             message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
         source = column;
-        pthread_rwlock_rdlock(table_rwlock = &table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->deleted_rows != NULL ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
-        index = column->index;
+        index = __atomic_load_n(&column->index, __ATOMIC_ACQUIRE);
+
+        // Hash indexes only answer equality selects, so the batch scans unless all of them are.
+        if (index != NULL && index->type == HASHED) {
+            for (unsigned int i = 0; i < batch_size; i++) {
+                Comparator *comparator = comparators + i;
+                if (!comparator->has_low || !comparator->has_high
+                        || comparator->low != comparator->high - 1) {
+                    index = NULL;
+                    break;
+                }
+            }
+        }
+
+        column_reader_open(&reader, column, index);
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -52,14 +61,12 @@ void batch_select(ClientContext *client_context, GeneralizedColumnHandle *col_hd
         }
 
         source = NULL;
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
         index = NULL;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
+    unsigned int rows_count = reader.rows_count;
+
     unsigned int *results[batch_size];
     memset(results, 0, batch_size * sizeof(unsigned int *));
     unsigned int result_counts[batch_size];
@@ -69,24 +76,21 @@ void batch_select(ClientContext *client_context, GeneralizedColumnHandle *col_hd
             results[i] = malloc(rows_count * sizeof(unsigned int));
         }
 
-        if (index == NULL) {
-            if (deleted_rows == NULL) {
-                for (unsigned int i = 0; i < values_count; i++) {
-                    int value = values[i];
-                    for (unsigned int j = 0; j < batch_size; j++) {
-                        Comparator *comparator = comparators + j;
-                        results[j][result_counts[j]] = i;
-                        result_counts[j] += (!comparator->has_low || value >= comparator->low)
-                                & (!comparator->has_high || value < comparator->high);
-                    }
-                }
-            } else {
-                for (unsigned int i = 0; i < values_count; i++) {
+        if (reader.index == NULL) {
+            unsigned int values_count = reader.values_count;
+            for (unsigned int offset = 0; offset < values_count; offset += COLUMN_SEGMENT_SIZE) {
+                unsigned int s = offset >> COLUMN_SEGMENT_BITS;
+                int *values = reader.segments[s];
+                bool *deleted_rows = reader.deleted_rows != NULL ? reader.deleted_rows[s] : NULL;
+                unsigned int count = values_count - offset < COLUMN_SEGMENT_SIZE
+                        ? values_count - offset : COLUMN_SEGMENT_SIZE;
+
+                for (unsigned int i = 0; i < count; i++) {
                     int value = values[i];
-                    if (!deleted_rows[i]) {
+                    if (deleted_rows == NULL || !deleted_rows[i]) {
                         for (unsigned int j = 0; j < batch_size; j++) {
                             Comparator *comparator = comparators + j;
-                            results[j][result_counts[j]] = i;
+                            results[j][result_counts[j]] = offset + i;
                             result_counts[j] += (!comparator->has_low || value >= comparator->low)
                                     & (!comparator->has_high || value < comparator->high);
                         }
@@ -96,33 +100,8 @@ void batch_select(ClientContext *client_context, GeneralizedColumnHandle *col_hd
         } else {
             for (unsigned int i = 0; i < batch_size; i++) {
                 Comparator *comparator = comparators + i;
-
-                switch (index->type) {
-                case BTREE:
-                    if (!comparator->has_low) {
-                        result_counts[i] = btree_select_lower(&index->fields.btree,
-                                comparator->high, results[i]);
-                    } else if (!comparator->has_high) {
-                        result_counts[i] = btree_select_higher(&index->fields.btree,
-                                comparator->low, results[i]);
-                    } else {
-                        result_counts[i] = btree_select_range(&index->fields.btree, comparator->low,
-                                comparator->high, results[i]);
-                    }
-                    break;
-                case SORTED:
-                    if (!comparator->has_low) {
-                        result_counts[i] = sorted_select_lower(&index->fields.sorted,
-                                comparator->high, results[i]);
-                    } else if (!comparator->has_high) {
-                        result_counts[i] = sorted_select_higher(&index->fields.sorted,
-                                comparator->low, results[i]);
-                    } else {
-                        result_counts[i] = sorted_select_range(&index->fields.sorted,
-                                comparator->low, comparator->high, results[i]);
-                    }
-                    break;
-                }
+                result_counts[i] = column_reader_index_select(&reader, comparator->has_low,
+                        comparator->low, comparator->has_high, comparator->high, results[i]);
             }
         }
 
@@ -137,12 +116,11 @@ void batch_select(ClientContext *client_context, GeneralizedColumnHandle *col_hd
         }
     }
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
     for (unsigned int i = 0; i < batch_size; i++) {
-        pos_result_put(client_context, pos_out_vars[i], source, results[i], result_counts[i]);
+        pos_result_put(client_context, pos_out_vars[i], source, reader.moves, results[i],
+                result_counts[i], reader.index != NULL);
     }
 }
 
@@ -163,6 +141,8 @@ void batch_select_pos(ClientContext *client_context, char *val_var, char **pos_v
 
     unsigned int *positions[batch_size];
     Column *sources[batch_size];
+    unsigned int moves[batch_size];
+    bool sorted[batch_size];
 
     for (unsigned int i = 0; i < batch_size; i++) {
         Result *pos = result_lookup(client_context, pos_vars[i]);
@@ -181,6 +161,8 @@ void batch_select_pos(ClientContext *client_context, char *val_var, char **pos_v
 
         positions[i] = pos->values.pos_values;
         sources[i] = pos->source;
+        moves[i] = pos->moves;
+        sorted[i] = pos->sorted;
     }
 
     unsigned int *results[batch_size];
@@ -215,7 +197,8 @@ void batch_select_pos(ClientContext *client_context, char *val_var, char **pos_v
 
 
     for (unsigned int i = 0; i < batch_size; i++) {
-        pos_result_put(client_context, pos_out_vars[i], sources[i], results[i], result_counts[i]);
+        pos_result_put(client_context, pos_out_vars[i], sources[i], moves[i], results[i],
+                result_counts[i], sorted[i]);
     }
 }
 
@@ -258,26 +241,72 @@ void batch_handle_operator(DbOperator **dbos, unsigned int batch_size, Message *
     free(dbos);
 }
 
+// An operator, or operators sharing a scan, as a node of the batch's dependency graph.
 typedef struct BatchQuery {
     union {
         DbOperator *dbo;
         DbOperator **dbos;
     } operators;
     unsigned int batch_size;
-    bool success;
+    // Queries this one still waits for, and the ones waiting for it.
+    unsigned int dependencies;
+    PosVector dependents;
+    struct Batch *batch;
 } BatchQuery;
 
-void *query_routine(void *data) {
-    BatchQuery *query = data;
+typedef struct Batch {
+    BatchQuery *queries;
+    ThreadPoolGroup group;
+    bool failed;
+} Batch;
+
+// The query that last wrote a variable, and the ones that read it since.
+typedef struct BatchVariable {
+    bool written;
+    unsigned int writer;
+    PosVector readers;
+} BatchVariable;
 
-    Message message = MESSAGE_INITIALIZER;
+static inline void batch_query_free(BatchQuery *query) {
     if (query->batch_size == 1) {
-        db_operator_execute(query->operators.dbo, &message);
         db_operator_free(query->operators.dbo);
-    } else if (query->batch_size > 1) {
-        batch_handle_operator(query->operators.dbos, query->batch_size, &message);
+    } else {
+        for (unsigned int i = 0; i < query->batch_size; i++) {
+            db_operator_free(query->operators.dbos[i]);
+        }
+        free(query->operators.dbos);
     }
-    query->success = message.status == OK;
+}
+
+// Runs a query, then dispatches the queries that were only waiting for it. Once one fails, the
+// remaining ones are freed without running.
+void *query_routine(void *data) {
+    BatchQuery *query = data;
+    Batch *batch = query->batch;
+
+    if (!__atomic_load_n(&batch->failed, __ATOMIC_RELAXED)) {
+        Message message = MESSAGE_INITIALIZER;
+        if (query->batch_size == 1) {
+            db_operator_execute(query->operators.dbo, &message);
+            db_operator_free(query->operators.dbo);
+        } else {
+            batch_handle_operator(query->operators.dbos, query->batch_size, &message);
+        }
+
+        if (message.status != OK) {
+            __atomic_store_n(&batch->failed, true, __ATOMIC_RELAXED);
+        }
+    } else {
+        batch_query_free(query);
+    }
+
+    for (unsigned int i = 0; i < query->dependents.size; i++) {
+        BatchQuery *dependent = batch->queries + query->dependents.data[i];
+        if (__atomic_sub_fetch(&dependent->dependencies, 1, __ATOMIC_ACQ_REL) == 0) {
+            thread_pool_fork(&batch->group, &query_routine, dependent);
+        }
+    }
+    pos_vector_destroy(&query->dependents);
 
     return NULL;
 }
@@ -306,272 +335,216 @@ void batch_query(DbOperator *dbo, Message *message) {
     }
 }
 
-static inline bool check_dependency(DbOperator *dbo, HashTable *output_table) {
-    DbOperator *query;
+// Variables an operator reads, whose last writer in the batch it depends on.
+static inline unsigned int batch_inputs(DbOperator *dbo, char **vars) {
+    unsigned int count = 0;
 
     switch (dbo->type) {
     case SELECT:
         if (!dbo->fields.select.col_hdl.is_column_fqn) {
-            query = hash_table_get(output_table, dbo->fields.select.col_hdl.name);
-            if (query != NULL) {
-                return false;
-            }
+            vars[count++] = dbo->fields.select.col_hdl.name;
         }
         break;
 
     case SELECT_POS:
-        query = hash_table_get(output_table, dbo->fields.select_pos.pos_var);
-        if (query != NULL) {
-            return false;
-        }
-
-        query = hash_table_get(output_table, dbo->fields.select_pos.val_var);
-        if (query != NULL) {
-            return false;
-        }
+        vars[count++] = dbo->fields.select_pos.pos_var;
+        vars[count++] = dbo->fields.select_pos.val_var;
         break;
 
     case FETCH:
-        query = hash_table_get(output_table, dbo->fields.fetch.pos_var);
-        if (query != NULL) {
-            return false;
-        }
+        vars[count++] = dbo->fields.fetch.pos_var;
         break;
 
     case JOIN:
-        query = hash_table_get(output_table, dbo->fields.join.val_var1);
-        if (query != NULL) {
-            return false;
-        }
-
-        query = hash_table_get(output_table, dbo->fields.join.pos_var1);
-        if (query != NULL) {
-            return false;
-        }
-
-        query = hash_table_get(output_table, dbo->fields.join.val_var2);
-        if (query != NULL) {
-            return false;
-        }
-
-        query = hash_table_get(output_table, dbo->fields.join.pos_var2);
-        if (query != NULL) {
-            return false;
+        vars[count++] = dbo->fields.join.val_var1;
+        vars[count++] = dbo->fields.join.pos_var1;
+        vars[count++] = dbo->fields.join.val_var2;
+        vars[count++] = dbo->fields.join.pos_var2;
+        if (dbo->fields.join.high_var2 != NULL) {
+            vars[count++] = dbo->fields.join.high_var2;
         }
         break;
 
     case MIN:
         if (!dbo->fields.min.col_hdl.is_column_fqn) {
-            query = hash_table_get(output_table, dbo->fields.min.col_hdl.name);
-            if (query != NULL) {
-                return false;
-            }
+            vars[count++] = dbo->fields.min.col_hdl.name;
         }
         break;
 
     case MIN_POS:
-        query = hash_table_get(output_table, dbo->fields.min_pos.pos_var);
-        if (query != NULL) {
-            return false;
-        }
-
+        vars[count++] = dbo->fields.min_pos.pos_var;
         if (!dbo->fields.min_pos.col_hdl.is_column_fqn) {
-            query = hash_table_get(output_table, dbo->fields.min_pos.col_hdl.name);
-            if (query != NULL) {
-                return false;
-            }
+            vars[count++] = dbo->fields.min_pos.col_hdl.name;
         }
         break;
 
     case MAX:
         if (!dbo->fields.max.col_hdl.is_column_fqn) {
-            query = hash_table_get(output_table, dbo->fields.max.col_hdl.name);
-            if (query != NULL) {
-                return false;
-            }
+            vars[count++] = dbo->fields.max.col_hdl.name;
         }
         break;
 
     case MAX_POS:
-        query = hash_table_get(output_table, dbo->fields.max_pos.pos_var);
-        if (query != NULL) {
-            return false;
-        }
-
+        vars[count++] = dbo->fields.max_pos.pos_var;
         if (!dbo->fields.max_pos.col_hdl.is_column_fqn) {
-            query = hash_table_get(output_table, dbo->fields.max_pos.col_hdl.name);
-            if (query != NULL) {
-                return false;
-            }
+            vars[count++] = dbo->fields.max_pos.col_hdl.name;
         }
         break;
 
     case SUM:
         if (!dbo->fields.sum.col_hdl.is_column_fqn) {
-            query = hash_table_get(output_table, dbo->fields.sum.col_hdl.name);
-            if (query != NULL) {
-                return false;
-            }
+            vars[count++] = dbo->fields.sum.col_hdl.name;
         }
         break;
 
     case AVG:
         if (!dbo->fields.avg.col_hdl.is_column_fqn) {
-            query = hash_table_get(output_table, dbo->fields.avg.col_hdl.name);
-            if (query != NULL) {
-                return false;
-            }
+            vars[count++] = dbo->fields.avg.col_hdl.name;
         }
         break;
 
     case ADD:
-        query = hash_table_get(output_table, dbo->fields.add.val_var1);
-        if (query != NULL) {
-            return false;
-        }
-
-        query = hash_table_get(output_table, dbo->fields.add.val_var2);
-        if (query != NULL) {
-            return false;
-        }
+        vars[count++] = dbo->fields.add.val_var1;
+        vars[count++] = dbo->fields.add.val_var2;
         break;
 
     case SUB:
-        query = hash_table_get(output_table, dbo->fields.sub.val_var1);
-        if (query != NULL) {
-            return false;
-        }
-
-        query = hash_table_get(output_table, dbo->fields.sub.val_var2);
-        if (query != NULL) {
-            return false;
-        }
+        vars[count++] = dbo->fields.sub.val_var1;
+        vars[count++] = dbo->fields.sub.val_var2;
         break;
 
     default:
         break;
     }
 
-    return true;
+    return count;
 }
 
-static inline void register_output(DbOperator *dbo, HashTable *output_table) {
-    DbOperator *query;
+// Variables an operator writes, which must wait for their earlier writer and readers.
+static inline unsigned int batch_outputs(DbOperator *dbo, char **vars) {
+    unsigned int count = 0;
 
     switch (dbo->type) {
     case SELECT:
-        query = hash_table_put(output_table, dbo->fields.select.pos_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.select.pos_out_var;
         break;
 
     case SELECT_POS:
-        query = hash_table_put(output_table, dbo->fields.select_pos.pos_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.select_pos.pos_out_var;
         break;
 
     case FETCH:
-        query = hash_table_put(output_table, dbo->fields.fetch.val_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.fetch.val_out_var;
         break;
 
     case JOIN:
-        query = hash_table_put(output_table, dbo->fields.join.pos_out_var1, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
-
-        if (strcmp(dbo->fields.join.pos_out_var2, dbo->fields.join.pos_out_var1) != 0) {
-            query = hash_table_put(output_table, dbo->fields.join.pos_out_var2, dbo);
-            if (query != NULL) {
-                db_operator_free(query);
-            }
+        vars[count++] = dbo->fields.join.pos_out_var1;
+        if (dbo->fields.join.pos_out_var2 != NULL
+                && strcmp(dbo->fields.join.pos_out_var2, dbo->fields.join.pos_out_var1) != 0) {
+            vars[count++] = dbo->fields.join.pos_out_var2;
         }
         break;
 
     case MIN:
-        query = hash_table_put(output_table, dbo->fields.min.val_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.min.val_out_var;
         break;
 
     case MIN_POS:
-        query = hash_table_put(output_table, dbo->fields.min_pos.pos_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
-
+        vars[count++] = dbo->fields.min_pos.pos_out_var;
         if (strcmp(dbo->fields.min_pos.val_out_var, dbo->fields.min_pos.pos_out_var) != 0) {
-            query = hash_table_put(output_table, dbo->fields.min_pos.val_out_var, dbo);
-            if (query != NULL) {
-                db_operator_free(query);
-            }
+            vars[count++] = dbo->fields.min_pos.val_out_var;
         }
         break;
 
     case MAX:
-        query = hash_table_put(output_table, dbo->fields.max.val_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.max.val_out_var;
         break;
 
     case MAX_POS:
-        query = hash_table_put(output_table, dbo->fields.max_pos.pos_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
-
+        vars[count++] = dbo->fields.max_pos.pos_out_var;
         if (strcmp(dbo->fields.max_pos.val_out_var, dbo->fields.max_pos.pos_out_var) != 0) {
-            query = hash_table_put(output_table, dbo->fields.max_pos.val_out_var, dbo);
-            if (query != NULL) {
-                db_operator_free(query);
-            }
+            vars[count++] = dbo->fields.max_pos.val_out_var;
         }
         break;
 
     case SUM:
-        query = hash_table_put(output_table, dbo->fields.sum.val_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.sum.val_out_var;
         break;
 
     case AVG:
-        query = hash_table_put(output_table, dbo->fields.avg.val_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.avg.val_out_var;
         break;
 
     case ADD:
-        query = hash_table_put(output_table, dbo->fields.add.val_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.add.val_out_var;
         break;
 
     case SUB:
-        query = hash_table_put(output_table, dbo->fields.sub.val_out_var, dbo);
-        if (query != NULL) {
-            db_operator_free(query);
-        }
+        vars[count++] = dbo->fields.sub.val_out_var;
         break;
 
     default:
         break;
     }
+
+    return count;
+}
+
+static inline BatchVariable *batch_variable(HashTable *variables, char *name) {
+    BatchVariable *variable = hash_table_get(variables, name);
+    if (variable == NULL) {
+        variable = malloc(sizeof(BatchVariable));
+        variable->written = false;
+        pos_vector_init(&variable->readers, 0);
+        hash_table_put(variables, name, variable);
+    }
+    return variable;
+}
+
+static void batch_variable_free(void *data) {
+    BatchVariable *variable = data;
+    pos_vector_destroy(&variable->readers);
+    free(variable);
+}
+
+// Whether an operator has to wait for any query already in the batch.
+static inline bool batch_depends(HashTable *variables, char **inputs, unsigned int inputs_count,
+        char **outputs, unsigned int outputs_count) {
+    for (unsigned int i = 0; i < inputs_count; i++) {
+        BatchVariable *variable = hash_table_get(variables, inputs[i]);
+        if (variable != NULL && variable->written) {
+            return true;
+        }
+    }
+
+    for (unsigned int i = 0; i < outputs_count; i++) {
+        BatchVariable *variable = hash_table_get(variables, outputs[i]);
+        if (variable != NULL && (variable->written || variable->readers.size > 0)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-static inline void batch_query_init(BatchQuery *query, DbOperator *dbo) {
+static inline void batch_add_dependency(Batch *batch, unsigned int from, unsigned int to) {
+    PosVector *dependents = &batch->queries[from].dependents;
+
+    // Edges to a query are all added while it is being placed, so duplicates are adjacent.
+    if (from == to || (dependents->size > 0 && dependents->data[dependents->size - 1] == to)) {
+        return;
+    }
+
+    pos_vector_append(dependents, to);
+    batch->queries[to].dependencies++;
+}
+
+static inline void batch_query_init(Batch *batch, BatchQuery *query, DbOperator *dbo) {
     query->operators.dbo = dbo;
     query->batch_size = 1;
+    query->dependencies = 0;
+    pos_vector_init(&query->dependents, 0);
+    query->batch = batch;
 }
 
 static inline void batch_query_attach(BatchQuery *query, DbOperator *dbo, unsigned int max_capacity) {
@@ -584,21 +557,42 @@ static inline void batch_query_attach(BatchQuery *query, DbOperator *dbo, unsign
     query->operators.dbos[query->batch_size++] = dbo;
 }
 
-static inline bool execute_operators(HashTable *output_table) {
-    if (output_table->num_nodes == 0) {
-        return true;
-    }
+// Selects on the same source share a scan. Only selects that depend on nothing else in the batch
+// are grouped, so that a shared scan never waits for a query that waits for it.
+static inline BatchQuery *batch_shared_scan(HashTable *scans, char *source, DbOperator *dbo,
+        unsigned int max_capacity) {
+    BatchQuery *query = hash_table_get(scans, source);
+    if (query != NULL) {
+        batch_query_attach(query, dbo, max_capacity);
 
-    if (output_table->num_nodes == 1) {
-        DbOperator *dbo = output_table->nodes->value;
-        Message message = MESSAGE_INITIALIZER;
+        if (query->batch_size == max_capacity) {
+            hash_table_put(scans, source, NULL);
+        }
+    }
+    return query;
+}
 
-        db_operator_execute(dbo, &message);
-        db_operator_free(dbo);
+// Builds a dependency graph of the batched operators, with an edge from the last writer of every
+// variable to its readers, and from those to the next writer. Queries are dispatched on the
+// thread pool as soon as all of their dependencies finished. They take table locks, so they only
+// run on idle workers or on this thread while it joins the batch, never within the join of a
+// writer holding a lock.
+void batch_execute_concurrently(ClientContext *client_context, Message *message) {
+    Vector *batched_operators = &client_context->batched_operators;
 
-        return message.status == OK;
+    if (batched_operators->size == 0) {
+        return;
     }
 
+    Batch batch;
+    batch.queries = malloc(batched_operators->size * sizeof(BatchQuery));
+    thread_pool_group_init(&batch.group);
+    batch.failed = false;
+    unsigned int queries_count = 0;
+
+    HashTable variables;
+    hash_table_init(&variables, BATCH_TABLE_INITIAL_CAPACITY, BATCH_TABLE_LOAD_FACTOR);
+
 #if BATCH_MAX_SELECT > 1
     HashTable select_table;
     hash_table_init(&select_table, BATCH_TABLE_INITIAL_CAPACITY, BATCH_TABLE_LOAD_FACTOR);
@@ -609,59 +603,75 @@ static inline bool execute_operators(HashTable *output_table) {
     hash_table_init(&select_pos_table, BATCH_TABLE_INITIAL_CAPACITY, BATCH_TABLE_LOAD_FACTOR);
 #endif
 
-    BatchQuery queries[output_table->num_nodes];
+    for (unsigned int i = 0; i < batched_operators->size; i++) {
+        DbOperator *dbo = batched_operators->data[i];
 
-    unsigned int queries_count = 0;
-    for (HashTableNode *node = output_table->nodes; node != NULL; node = node->nodes_next) {
-        DbOperator *dbo = node->value;
+        char *inputs[BATCH_MAX_INPUTS];
+        unsigned int inputs_count = batch_inputs(dbo, inputs);
+        char *outputs[BATCH_MAX_OUTPUTS];
+        unsigned int outputs_count = batch_outputs(dbo, outputs);
 
-        BatchQuery *query;
+        BatchQuery *query = NULL;
+        HashTable *scans = NULL;
+        char *source = NULL;
+        unsigned int max_capacity = 1;
 
-        switch (dbo->type) {
 #if BATCH_MAX_SELECT > 1
-        case SELECT:
-            query = hash_table_get(&select_table, dbo->fields.select.col_hdl.name);
-
-            if (query != NULL) {
-                batch_query_attach(query, dbo, BATCH_MAX_SELECT);
-
-                if (query->batch_size == BATCH_MAX_SELECT) {
-                    hash_table_put(&select_table, dbo->fields.select.col_hdl.name, NULL);
-                }
-            } else {
-                query = queries + queries_count++;
-                batch_query_init(query, dbo);
-
-                hash_table_put(&select_table, dbo->fields.select.col_hdl.name, query);
-            }
-            break;
+        if (dbo->type == SELECT) {
+            scans = &select_table;
+            source = dbo->fields.select.col_hdl.name;
+            max_capacity = BATCH_MAX_SELECT;
+        }
 #endif
 
 #if BATCH_MAX_SELECT_POS > 1
-        case SELECT_POS:
-            query = hash_table_get(&select_pos_table, dbo->fields.select_pos.val_var);
+        if (dbo->type == SELECT_POS) {
+            scans = &select_pos_table;
+            source = dbo->fields.select_pos.val_var;
+            max_capacity = BATCH_MAX_SELECT_POS;
+        }
+#endif
+
+        if (scans != NULL && batch_depends(&variables, inputs, inputs_count, outputs,
+                outputs_count)) {
+            scans = NULL;
+        }
 
-            if (query != NULL) {
-                batch_query_attach(query, dbo, BATCH_MAX_SELECT_POS);
+        if (scans != NULL) {
+            query = batch_shared_scan(scans, source, dbo, max_capacity);
+        }
 
-                if (query->batch_size == BATCH_MAX_SELECT_POS) {
-                    hash_table_put(&select_pos_table, dbo->fields.select_pos.val_var, NULL);
-                }
-            } else {
-                query = queries + queries_count++;
-                batch_query_init(query, dbo);
+        if (query == NULL) {
+            query = batch.queries + queries_count++;
+            batch_query_init(&batch, query, dbo);
 
-                hash_table_put(&select_pos_table, dbo->fields.select_pos.val_var, query);
+            if (scans != NULL) {
+                hash_table_put(scans, source, query);
             }
-            break;
-#endif
+        }
+
+        unsigned int index = query - batch.queries;
 
-        default:
-            query = queries + queries_count++;
-            batch_query_init(query, dbo);
-            break;
+        for (unsigned int j = 0; j < inputs_count; j++) {
+            BatchVariable *variable = batch_variable(&variables, inputs[j]);
+            if (variable->written) {
+                batch_add_dependency(&batch, variable->writer, index);
+            }
+            pos_vector_append(&variable->readers, index);
         }
 
+        for (unsigned int j = 0; j < outputs_count; j++) {
+            BatchVariable *variable = batch_variable(&variables, outputs[j]);
+            if (variable->written) {
+                batch_add_dependency(&batch, variable->writer, index);
+            }
+            for (unsigned int k = 0; k < variable->readers.size; k++) {
+                batch_add_dependency(&batch, variable->readers.data[k], index);
+            }
+            variable->readers.size = 0;
+            variable->written = true;
+            variable->writer = index;
+        }
     }
 
 #if BATCH_MAX_SELECT > 1
@@ -672,74 +682,29 @@ static inline bool execute_operators(HashTable *output_table) {
     hash_table_destroy(&select_pos_table, NULL);
 #endif
 
-    if (queries_count == 1) {
-        BatchQuery *query = queries;
-        query_routine(query);
-        return query->success;
-    } else {
-        pthread_t threads[queries_count];
-
-        for (unsigned int i = 0; i < queries_count; i++) {
-            if (pthread_create(threads + i, NULL, &query_routine, queries + i) != 0) {
-                log_err("Unable to create query worker thread.");
-                exit(1);
-            }
-        }
-
-        bool success = true;
-
-        for (unsigned int i = 0; i < queries_count; i++) {
-            pthread_join(threads[i], NULL);
+    hash_table_destroy(&variables, &batch_variable_free);
 
-            if (!queries[i].success) {
-                success = false;
-            }
+    // Queries waiting for nothing start right away, the others once their last dependency
+    // finished. Those are collected first, as running queries release their dependents.
+    unsigned int roots[queries_count];
+    unsigned int roots_count = 0;
+    for (unsigned int i = 0; i < queries_count; i++) {
+        if (batch.queries[i].dependencies == 0) {
+            roots[roots_count++] = i;
         }
-
-        return success;
     }
-}
-
-void batch_execute_concurrently(ClientContext *client_context, Message *message) {
-    Vector *batched_operators = &client_context->batched_operators;
 
-    if (batched_operators->size == 0) {
-        return;
+    for (unsigned int i = 0; i < roots_count; i++) {
+        thread_pool_fork(&batch.group, &query_routine, batch.queries + roots[i]);
     }
 
-    bool error = false;
-
-    HashTable output_table;
-    hash_table_init(&output_table, BATCH_TABLE_INITIAL_CAPACITY, BATCH_TABLE_LOAD_FACTOR);
-
-    for (unsigned int i = 0; i < batched_operators->size; i++) {
-        DbOperator *dbo = batched_operators->data[i];
+    thread_pool_join(&batch.group);
 
-        if (!error) {
-            if (!check_dependency(dbo, &output_table)) {
-                if (!execute_operators(&output_table)) {
-                    error = true;
-                    message->status = BATCH_EXECUTION_ERROR;
-                    db_operator_free(dbo);
-                    continue;
-                }
-
-                hash_table_clear(&output_table, NULL);
-            }
-
-            register_output(dbo, &output_table);
-        } else {
-            db_operator_free(dbo);
-        }
-    }
-
-    if (!error) {
-        if (!execute_operators(&output_table)) {
-            message->status = BATCH_EXECUTION_ERROR;
-        }
+    if (batch.failed) {
+        message->status = BATCH_EXECUTION_ERROR;
     }
 
-    hash_table_destroy(&output_table, NULL);
+    free(batch.queries);
 
     batched_operators->size = 0;
 }
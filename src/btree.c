@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,8 +7,16 @@
 #include "btree.h"
 #include "utils.h"
 
+static inline BTreeNode *btree_node_alloc() {
+    void *node;
+    if (posix_memalign(&node, BTREE_CACHE_LINE_SIZE, sizeof(BTreeNode)) != 0) {
+        return NULL;
+    }
+    return node;
+}
+
 static inline BTreeNode *btree_leaf_node_create() {
-    BTreeNode *node = malloc(sizeof(BTreeNode));
+    BTreeNode *node = btree_node_alloc();
     node->leaf = true;
     node->fields.leaf.size = 0;
     node->fields.leaf.prev = NULL;
@@ -16,12 +25,86 @@ static inline BTreeNode *btree_leaf_node_create() {
 }
 
 static inline BTreeNode *btree_internal_node_create() {
-    BTreeNode *node = malloc(sizeof(BTreeNode));
+    BTreeNode *node = btree_node_alloc();
     node->leaf = false;
     node->fields.internal.size = 0;
     return node;
 }
 
+// Grows the position map, if any, to hold position.
+static inline void btree_entries_reserve(BTreeIndex *index, unsigned int position) {
+    if (index->entries == NULL || position < index->entries_capacity) {
+        return;
+    }
+
+    unsigned int capacity = round_up_power_of_two(position + 1);
+    index->entries = realloc(index->entries, capacity * sizeof(BTreeEntry));
+    memset(index->entries + index->entries_capacity, 0,
+            (capacity - index->entries_capacity) * sizeof(BTreeEntry));
+    index->entries_capacity = capacity;
+}
+
+// Points the positions in slots [idx, size) of a leaf back at them, after they moved.
+static inline void btree_entries_update(BTreeIndex *index, BTreeNode *node, unsigned int idx) {
+    if (index->entries == NULL) {
+        return;
+    }
+
+    BTreeLeafNode *leaf = &node->fields.leaf;
+    for (unsigned int i = idx; i < leaf->size; i++) {
+        index->entries[leaf->positions[i]] = (BTreeEntry) {node, i};
+    }
+}
+
+// Refreshes the summary of an internal node for all lines from the value at idx onwards.
+static inline void btree_internal_node_update_leaders(BTreeInternalNode *internal,
+        unsigned int idx) {
+    for (unsigned int i = idx / BTREE_LINE_VALUES * BTREE_LINE_VALUES; i < internal->size;
+            i += BTREE_LINE_VALUES) {
+        internal->leaders[i / BTREE_LINE_VALUES] = internal->values[i];
+    }
+}
+
+// Returns the position of the left-most value that is >= value, like binary_search_left.
+static inline unsigned int btree_internal_node_search_left(BTreeInternalNode *internal,
+        int value) {
+    unsigned int lines = (internal->size + BTREE_LINE_VALUES - 1) / BTREE_LINE_VALUES;
+    unsigned int line = binary_search_left(internal->leaders, lines, value);
+    if (line > 0) {
+        line--;
+    }
+
+    unsigned int start = line * BTREE_LINE_VALUES;
+    unsigned int end = start + BTREE_LINE_VALUES;
+    end = end < internal->size ? end : internal->size;
+
+    unsigned int idx = start;
+    for (unsigned int i = start; i < end; i++) {
+        idx += internal->values[i] < value;
+    }
+    return idx;
+}
+
+// Returns the position of the left-most value that is > value, like binary_search_right.
+static inline unsigned int btree_internal_node_search_right(BTreeInternalNode *internal,
+        int value) {
+    unsigned int lines = (internal->size + BTREE_LINE_VALUES - 1) / BTREE_LINE_VALUES;
+    unsigned int line = binary_search_right(internal->leaders, lines, value);
+    if (line > 0) {
+        line--;
+    }
+
+    unsigned int start = line * BTREE_LINE_VALUES;
+    unsigned int end = start + BTREE_LINE_VALUES;
+    end = end < internal->size ? end : internal->size;
+
+    unsigned int idx = start;
+    for (unsigned int i = start; i < end; i++) {
+        idx += internal->values[i] <= value;
+    }
+    return idx;
+}
+
 static void btree_node_free(BTreeNode *node) {
     if (!node->leaf) {
         for (unsigned int i = 0; i < node->fields.internal.size; i++) {
@@ -75,8 +158,8 @@ static bool btree_node_save(BTreeNode *node, FILE *file) {
     return true;
 }
 
-static BTreeNode *btree_node_load(BTreeLeafNode **head, BTreeLeafNode **tail, FILE *file) {
-    BTreeNode *node = malloc(sizeof(BTreeNode));
+static BTreeNode *btree_node_load(BTreeNode **head, BTreeNode **tail, FILE *file) {
+    BTreeNode *node = btree_node_alloc();
 
     if (fread(&node->leaf, sizeof(node->leaf), 1, file) != 1) {
         log_err("Unable to write B-Tree is_leaf\n");
@@ -109,11 +192,11 @@ static BTreeNode *btree_node_load(BTreeLeafNode **head, BTreeLeafNode **tail, FI
         leaf->next = NULL;
 
         if (*head == NULL) {
-            *head = leaf;
+            *head = node;
         } else {
-            (*tail)->next = leaf;
+            (*tail)->fields.leaf.next = node;
         }
-        *tail = leaf;
+        *tail = node;
     } else {
         BTreeInternalNode *internal = &node->fields.internal;
 
@@ -127,6 +210,8 @@ static BTreeNode *btree_node_load(BTreeLeafNode **head, BTreeLeafNode **tail, FI
             return false;
         }
 
+        btree_internal_node_update_leaders(internal, 0);
+
         for (unsigned int i = 0; i < internal->size; i++) {
             BTreeNode *child = btree_node_load(head, tail, file);
             if (child == NULL) {
@@ -145,6 +230,9 @@ static BTreeNode *btree_node_load(BTreeLeafNode **head, BTreeLeafNode **tail, FI
 }
 
 void btree_init(BTreeIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    index->entries = NULL;
+    index->entries_capacity = 0;
+
     if (size == 0) {
         index->root = NULL;
         index->head = NULL;
@@ -173,8 +261,8 @@ void btree_init(BTreeIndex *index, int *values, unsigned int *positions, unsigne
     offset = 0;
 
     unsigned int counter = 0;
-    BTreeLeafNode *head = NULL;
-    BTreeLeafNode *tail = NULL;
+    BTreeNode *head = NULL;
+    BTreeNode *tail = NULL;
     for (unsigned int i = 0; i < num_nodes; i++) {
         num_values = min_num_values;
         if (i < remainder) {
@@ -191,15 +279,15 @@ void btree_init(BTreeIndex *index, int *values, unsigned int *positions, unsigne
         } else {
             memcpy(leaf->positions, positions + offset, num_values * sizeof(unsigned int));
         }
-        leaf->prev = tail;
         leaf->size = num_values;
 
         if (i == 0) {
-            head = leaf;
+            head = node;
         } else {
-            tail->next = leaf;
+            tail->fields.leaf.next = node;
         }
-        tail = leaf;
+        leaf->prev = tail;
+        tail = node;
 
         values_buf[i] = values[offset];
         children_buf[i] = node;
@@ -230,6 +318,7 @@ void btree_init(BTreeIndex *index, int *values, unsigned int *positions, unsigne
             memcpy(internal->values, values_buf + offset, num_values * sizeof(int));
             memcpy(internal->children, children_buf + offset, num_values * sizeof(BTreeNode *));
             internal->size = num_values;
+            btree_internal_node_update_leaders(internal, 0);
 
             values_buf[i] = values_buf[offset];
             children_buf[i] = node;
@@ -253,6 +342,98 @@ void btree_destroy(BTreeIndex *index) {
     if (index->root != NULL) {
         btree_node_free(index->root);
     }
+    free(index->entries);
+}
+
+void btree_track_positions(BTreeIndex *index) {
+    if (index->entries != NULL) {
+        return;
+    }
+
+    unsigned int max_position = 0;
+    for (BTreeNode *node = index->head; node != NULL; node = node->fields.leaf.next) {
+        BTreeLeafNode *leaf = &node->fields.leaf;
+        for (unsigned int i = 0; i < leaf->size; i++) {
+            max_position = leaf->positions[i] > max_position ? leaf->positions[i] : max_position;
+        }
+    }
+
+    index->entries_capacity = round_up_power_of_two(max_position + 1);
+    index->entries = calloc(index->entries_capacity, sizeof(BTreeEntry));
+
+    for (BTreeNode *node = index->head; node != NULL; node = node->fields.leaf.next) {
+        btree_entries_update(index, node, 0);
+    }
+}
+
+void btree_merge(BTreeIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    unsigned int new_size = index->size + size;
+    int *merged_values = malloc(new_size * sizeof(int));
+    unsigned int *merged_positions = malloc(new_size * sizeof(unsigned int));
+
+    // Walk the leaves in order, interleaving the sorted batch.
+    unsigned int j = 0;
+    unsigned int k = 0;
+    for (BTreeNode *node = index->size > 0 ? index->head : NULL; node != NULL;
+            node = node->fields.leaf.next) {
+        BTreeLeafNode *leaf = &node->fields.leaf;
+        for (unsigned int i = 0; i < leaf->size; i++) {
+            int value = leaf->values[i];
+            for (; j < size && values[j] < value; j++, k++) {
+                merged_values[k] = values[j];
+                merged_positions[k] = positions[j];
+            }
+            merged_values[k] = value;
+            merged_positions[k] = leaf->positions[i];
+            k++;
+        }
+    }
+    for (; j < size; j++, k++) {
+        merged_values[k] = values[j];
+        merged_positions[k] = positions[j];
+    }
+
+    bool track_positions = index->entries != NULL;
+
+    btree_destroy(index);
+    btree_init(index, merged_values, merged_positions, new_size);
+
+    if (track_positions) {
+        btree_track_positions(index);
+    }
+
+    free(merged_values);
+    free(merged_positions);
+}
+
+void btree_remove_if(BTreeIndex *index, bool (*removed)(void *, unsigned int), void *data) {
+    int *kept_values = malloc(index->size * sizeof(int));
+    unsigned int *kept_positions = malloc(index->size * sizeof(unsigned int));
+
+    unsigned int k = 0;
+    for (BTreeNode *node = index->size > 0 ? index->head : NULL; node != NULL;
+            node = node->fields.leaf.next) {
+        BTreeLeafNode *leaf = &node->fields.leaf;
+        for (unsigned int i = 0; i < leaf->size; i++) {
+            if (!removed(data, leaf->positions[i])) {
+                kept_values[k] = leaf->values[i];
+                kept_positions[k] = leaf->positions[i];
+                k++;
+            }
+        }
+    }
+
+    bool track_positions = index->entries != NULL;
+
+    btree_destroy(index);
+    btree_init(index, kept_values, kept_positions, k);
+
+    if (track_positions) {
+        btree_track_positions(index);
+    }
+
+    free(kept_values);
+    free(kept_positions);
 }
 
 bool btree_save(BTreeIndex *index, FILE *file) {
@@ -274,14 +455,13 @@ bool btree_load(BTreeIndex *index, FILE *file) {
         return false;
     }
 
-    if (index->size == 0) {
-        index->root = NULL;
-        index->head = NULL;
-        index->tail = NULL;
-    } else {
-        index->head = NULL;
-        index->tail = NULL;
+    index->root = NULL;
+    index->head = NULL;
+    index->tail = NULL;
+    index->entries = NULL;
+    index->entries_capacity = 0;
 
+    if (index->size > 0) {
         BTreeNode *root = btree_node_load(&index->head, &index->tail, file);
         if (root == NULL) {
             return false;
@@ -324,8 +504,17 @@ static inline int btree_node_first_value(BTreeNode *node) {
     }
 }
 
-static inline BTreeNode *btree_leaf_node_split(BTreeIndex *index, BTreeLeafNode *leaf,
+static inline bool btree_node_full(BTreeNode *node) {
+    if (node->leaf) {
+        return node->fields.leaf.size == BTREE_LEAF_NODE_CAPACITY;
+    } else {
+        return node->fields.internal.size == BTREE_INTERNAL_NODE_CAPACITY;
+    }
+}
+
+static inline BTreeNode *btree_leaf_node_split(BTreeIndex *index, BTreeNode *node,
         unsigned int split) {
+    BTreeLeafNode *leaf = &node->fields.leaf;
     BTreeNode *new = btree_leaf_node_create();
     BTreeLeafNode *new_leaf = &new->fields.leaf;
 
@@ -334,17 +523,17 @@ static inline BTreeNode *btree_leaf_node_split(BTreeIndex *index, BTreeLeafNode
     memcpy(new_leaf->values, leaf->values + split, new_size * sizeof(int));
     memcpy(new_leaf->positions, leaf->positions + split, new_size * sizeof(unsigned int));
     new_leaf->size = new_size;
-    new_leaf->prev = leaf;
+    new_leaf->prev = node;
     new_leaf->next = leaf->next;
 
     if (leaf->next != NULL) {
-        leaf->next->prev = new_leaf;
+        leaf->next->fields.leaf.prev = new;
     } else {
-        index->tail = new_leaf;
+        index->tail = new;
     }
 
     leaf->size = split;
-    leaf->next = new_leaf;
+    leaf->next = new;
 
     return new;
 }
@@ -358,100 +547,168 @@ static inline BTreeNode *btree_internal_node_split(BTreeInternalNode *internal,
     memcpy(new_internal->values, internal->values + split, new_size * sizeof(int));
     memcpy(new_internal->children, internal->children + split, new_size * sizeof(BTreeNode *));
     new_internal->size = new_size;
+    btree_internal_node_update_leaders(new_internal, 0);
 
     internal->size = split;
 
     return new;
 }
 
-static BTreeNode *btree_node_insert(BTreeIndex *index, BTreeNode *root, int value,
-        unsigned int position) {
-    if (root->leaf) {
-        BTreeLeafNode *leaf = &root->fields.leaf;
-        BTreeNode *new_leaf = NULL;
+// Splits a full node and links the new right half into its parent, or into a new root if node is
+// the root.
+static inline void btree_node_split(BTreeIndex *index, BTreeNode *parent, unsigned int parent_idx,
+        BTreeNode *node) {
+    BTreeNode *new_node;
+    if (node->leaf) {
+        new_node = btree_leaf_node_split(index, node, BTREE_LEAF_NODE_CAPACITY / 2);
+        btree_entries_update(index, new_node, 0);
+    } else {
+        new_node = btree_internal_node_split(&node->fields.internal,
+                BTREE_INTERNAL_NODE_CAPACITY / 2);
+    }
 
-        unsigned int idx = binary_search_right(leaf->values, leaf->size, value);
+    if (parent == NULL) {
+        BTreeNode *new_root = btree_internal_node_create();
 
-        if (leaf->size == BTREE_LEAF_NODE_CAPACITY) {
-            unsigned int median = leaf->size / 2;
+        new_root->fields.internal.values[0] = btree_node_first_value(node);
+        new_root->fields.internal.children[0] = node;
 
-            new_leaf = btree_leaf_node_split(index, leaf, median);
+        new_root->fields.internal.values[1] = btree_node_first_value(new_node);
+        new_root->fields.internal.children[1] = new_node;
 
-            if (idx > median) {
-                idx -= median;
-                leaf = &new_leaf->fields.leaf;
-            }
-        }
+        new_root->fields.internal.size = 2;
+        btree_internal_node_update_leaders(&new_root->fields.internal, 0);
 
-        btree_values_insert(leaf->values, leaf->size, idx, value);
-        btree_positions_insert(leaf->positions, leaf->size, idx, position);
+        index->root = new_root;
+    } else {
+        BTreeInternalNode *internal = &parent->fields.internal;
 
-        leaf->size++;
+        btree_values_insert(internal->values, internal->size, parent_idx + 1,
+                btree_node_first_value(new_node));
+        btree_children_insert(internal->children, internal->size, parent_idx + 1, new_node);
 
-        return new_leaf;
-    } else {
-        BTreeInternalNode *internal = &root->fields.internal;
-        BTreeNode *new_internal = NULL;
+        internal->size++;
+        btree_internal_node_update_leaders(internal, parent_idx + 1);
+    }
+}
+
+// Inserts go to the right-most child whose separator is <= value, lowering the first separator
+// if value is below it so that separators stay sorted lower bounds. Full nodes are split on the
+// way down, so a split never has to propagate upwards.
+void btree_insert(BTreeIndex *index, int value, unsigned int position) {
+    if (index->root == NULL) {
+        BTreeNode *node = btree_leaf_node_create();
+        index->root = node;
+        index->head = node;
+        index->tail = node;
+    }
+
+    if (btree_node_full(index->root)) {
+        btree_node_split(index, NULL, 0, index->root);
+    }
+
+    BTreeNode *node = index->root;
+    while (!node->leaf) {
+        BTreeInternalNode *internal = &node->fields.internal;
 
-        unsigned int idx = binary_search_right(internal->values, internal->size, value);
+        unsigned int idx = btree_internal_node_search_right(internal, value);
         if (idx > 0) {
             idx--;
+        } else {
+            internal->values[0] = value;
+            internal->leaders[0] = value;
         }
 
         BTreeNode *child = internal->children[idx];
-        BTreeNode *new_child = btree_node_insert(index, child, value, position);
-        // Update slot value to the first value in child since it might have been updated.
-        internal->values[idx] = btree_node_first_value(child);
+        if (btree_node_full(child)) {
+            btree_node_split(index, node, idx, child);
+            if (value >= internal->values[idx + 1]) {
+                child = internal->children[idx + 1];
+            }
+        }
 
-        if (new_child != NULL) {
-            unsigned int insert_idx = idx + 1;
+        node = child;
+    }
 
-            if (internal->size == BTREE_INTERNAL_NODE_CAPACITY) {
-                unsigned int median = internal->size / 2;
+    BTreeLeafNode *leaf = &node->fields.leaf;
+    unsigned int idx = binary_search_right(leaf->values, leaf->size, value);
 
-                new_internal = btree_internal_node_split(internal, median);
+    btree_values_insert(leaf->values, leaf->size, idx, value);
+    btree_positions_insert(leaf->positions, leaf->size, idx, position);
 
-                if (insert_idx >= median) {
-                    insert_idx -= median;
-                    internal = &new_internal->fields.internal;
-                }
-            }
+    leaf->size++;
 
-            btree_values_insert(internal->values, internal->size, insert_idx,
-                    btree_node_first_value(new_child));
-            btree_children_insert(internal->children, internal->size, insert_idx, new_child);
+    btree_entries_reserve(index, position);
+    btree_entries_update(index, node, idx);
 
-            internal->size++;
-        }
+    index->size++;
+}
 
-        return new_internal;
+// Descends to the leaf where the left-most value that is >= value would be, which is in the child
+// before the left-most separator >= value, since separators are lower bounds. Returns NULL if the
+// tree is empty.
+static BTreeNode *btree_descend(BTreeIndex *index, int value) {
+    BTreeNode *node = index->root;
+    if (node == NULL) {
+        return NULL;
     }
-}
 
-void btree_insert(BTreeIndex *index, int value, unsigned int position) {
-    BTreeNode *root = index->root;
+    while (!node->leaf) {
+        BTreeInternalNode *internal = &node->fields.internal;
 
-    if (root == NULL) {
-        root = index->root = btree_leaf_node_create();
-        index->head = index->tail = &root->fields.leaf;
+        unsigned int idx = btree_internal_node_search_left(internal, value);
+        if (idx > 0) {
+            idx--;
+        }
+
+        node = internal->children[idx];
     }
 
-    BTreeNode *new_node = btree_node_insert(index, root, value, position);
-    if (new_node != NULL) {
-        BTreeNode *new_root = btree_internal_node_create();
+    return node;
+}
 
-        new_root->fields.internal.values[0] = btree_node_first_value(root);
-        new_root->fields.internal.children[0] = root;
+// Finds the entry for value at position, through the position map if it holds one, otherwise
+// scanning right from the leaf btree_descend ends at. Returns its leaf and its offset in idx_ptr,
+// or NULL if there is no such entry.
+static BTreeNode *btree_find(BTreeIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *idx_ptr, unsigned int *raw_pos_ptr) {
+    if (positions_map == NULL && position < index->entries_capacity) {
+        BTreeEntry entry = index->entries[position];
+        BTreeNode *node = entry.leaf;
+        if (node != NULL) {
+            BTreeLeafNode *leaf = &node->fields.leaf;
+            if (entry.slot < leaf->size && leaf->values[entry.slot] == value
+                    && leaf->positions[entry.slot] == position) {
+                *idx_ptr = entry.slot;
+                *raw_pos_ptr = position;
+                return node;
+            }
+        }
+    }
 
-        new_root->fields.internal.values[1] = btree_node_first_value(new_node);
-        new_root->fields.internal.children[1] = new_node;
+    for (BTreeNode *node = btree_descend(index, value); node != NULL;
+            node = node->fields.leaf.next) {
+        BTreeLeafNode *leaf = &node->fields.leaf;
+        unsigned int size = leaf->size;
 
-        new_root->fields.internal.size = 2;
+        unsigned int i = binary_search_left(leaf->values, size, value);
+        for (; i < size && leaf->values[i] == value; i++) {
+            unsigned int raw_pos = leaf->positions[i];
+            unsigned int pos = positions_map != NULL ? positions_map[raw_pos] : raw_pos;
 
-        index->root = new_root;
+            if (pos == position) {
+                *idx_ptr = i;
+                *raw_pos_ptr = raw_pos;
+                return node;
+            }
+        }
+
+        if (i < size) {
+            return NULL;
+        }
     }
 
-    index->size++;
+    return NULL;
 }
 
 static inline void btree_values_remove(int *values, unsigned int size, unsigned int idx) {
@@ -469,335 +726,194 @@ static inline void btree_positions_remove(unsigned int *positions, unsigned int
 
 static inline void btree_children_remove(BTreeNode **children, unsigned int size, unsigned int idx) {
     if (idx < size - 1) {
-        memmove(children + idx, children + idx + 1, (size - idx - 1) * sizeof(BTreeNode*));
+        memmove(children + idx, children + idx + 1, (size - idx - 1) * sizeof(BTreeNode *));
     }
 }
 
-static inline unsigned int btree_node_size(BTreeNode *node) {
-    if (node->leaf) {
-        return node->fields.leaf.size;
-    } else {
-        return node->fields.internal.size;
-    }
-}
-
-static bool btree_node_remove(BTreeIndex *index, BTreeNode *root, int value, unsigned int position,
-        unsigned int *positions_map, unsigned int *position_ptr) {
-    if (root->leaf) {
-        BTreeLeafNode *leaf = &root->fields.leaf;
-
-        for (unsigned int idx = binary_search_left(leaf->values, leaf->size, value);
-                idx < leaf->size && leaf->values[idx] == value; idx++) {
-            unsigned int raw_pos = leaf->positions[idx];
-            unsigned int pos = positions_map != NULL ? positions_map[raw_pos] : raw_pos;
+// Unlinks an emptied leaf holding value from the children of node, freeing every internal node
+// on the way that is left without children. A child holds values from its separator up to the
+// next one, so only the children in that range are searched. Returns whether leaf was found.
+static bool btree_node_unlink(BTreeNode *node, BTreeNode *leaf, int value) {
+    BTreeInternalNode *internal = &node->fields.internal;
 
-            if (pos == position) {
-                if (position_ptr != NULL) {
-                    *position_ptr = raw_pos;
-                }
-
-                btree_values_remove(leaf->values, leaf->size, idx);
-                btree_positions_remove(leaf->positions, leaf->size, idx);
+    unsigned int first = btree_internal_node_search_left(internal, value);
+    if (first > 0) {
+        first--;
+    }
+    unsigned int last = btree_internal_node_search_right(internal, value);
 
-                leaf->size--;
+    for (unsigned int idx = first; idx < last || idx == first; idx++) {
+        BTreeNode *child = internal->children[idx];
+        if (child != leaf && (child->leaf || !btree_node_unlink(child, leaf, value))) {
+            continue;
+        }
 
-                if (leaf->size == 0) {
-                    if (leaf->prev != NULL) {
-                        leaf->prev->next = leaf->next;
-                    } else {
-                        index->head = leaf->next;
-                    }
+        if (child->leaf || child->fields.internal.size == 0) {
+            free(child);
 
-                    if (leaf->next != NULL) {
-                        leaf->next->prev = leaf->prev;
-                    } else {
-                        index->tail = leaf->prev;
-                    }
-                }
+            btree_values_remove(internal->values, internal->size, idx);
+            btree_children_remove(internal->children, internal->size, idx);
 
-                return true;
-            }
+            internal->size--;
+            btree_internal_node_update_leaders(internal, idx);
         }
 
-        return false;
-    } else {
-        BTreeInternalNode *internal = &root->fields.internal;
+        return true;
+    }
 
-        unsigned int idx = binary_search_left(internal->values, internal->size, value);
-        if (idx == internal->size) {
-            idx--;
-        } else if (internal->values[idx] > value) {
-            if (idx > 0) {
-                idx--;
-            } else {
-                return false;
-            }
-        } else if (idx > 0) {
-            idx--;
-        }
+    return false;
+}
 
-        for (; idx < internal->size && internal->values[idx] <= value; idx++) {
-            BTreeNode *child = internal->children[idx];
+// Takes an emptied leaf out of the leaf list and out of the tree, so that churn doesn't leave
+// empty leaves behind. A root left with a single child is replaced by it.
+static void btree_leaf_free(BTreeIndex *index, BTreeNode *node, int value) {
+    BTreeLeafNode *leaf = &node->fields.leaf;
 
-            bool removed = btree_node_remove(index, child, value, position, positions_map,
-                    position_ptr);
-            if (removed) {
-                if (btree_node_size(child) == 0) {
-                    free(child);
+    if (leaf->prev != NULL) {
+        leaf->prev->fields.leaf.next = leaf->next;
+    } else {
+        index->head = leaf->next;
+    }
 
-                    btree_values_remove(internal->values, internal->size, idx);
-                    btree_children_remove(internal->children, internal->size, idx);
+    if (leaf->next != NULL) {
+        leaf->next->fields.leaf.prev = leaf->prev;
+    } else {
+        index->tail = leaf->prev;
+    }
 
-                    internal->size--;
-                } else {
-                    internal->values[idx] = btree_node_first_value(child);
-                }
+    BTreeNode *root = index->root;
+    if (root == node) {
+        free(node);
+        index->root = NULL;
+        return;
+    }
 
-                return true;
-            }
-        }
+    btree_node_unlink(root, node, value);
 
-        return false;
+    while (root != NULL && !root->leaf && root->fields.internal.size <= 1) {
+        BTreeNode *child = root->fields.internal.size > 0
+                ? root->fields.internal.children[0] : NULL;
+        free(root);
+        root = child;
     }
+    index->root = root;
 }
 
 bool btree_remove(BTreeIndex *index, int value, unsigned int position, unsigned int *positions_map,
         unsigned int *position_ptr) {
-    BTreeNode *root = index->root;
+    unsigned int idx;
+    unsigned int raw_pos;
 
-    if (root == NULL) {
+    BTreeNode *node = btree_find(index, value, position, positions_map, &idx, &raw_pos);
+    if (node == NULL) {
         return false;
     }
 
-    bool removed = btree_node_remove(index, root, value, position, positions_map, position_ptr);
-    if (removed) {
-        if (btree_node_size(root) == 0) {
-            free(root);
-
-            index->root = NULL;
-        }
-
-        index->size--;
-    }
-
-    return removed;
-}
+    BTreeLeafNode *leaf = &node->fields.leaf;
 
-static BTreeLeafNode *btree_node_descend_left(BTreeNode *root, int value) {
-    if (root->leaf) {
-        return &root->fields.leaf;
-    } else {
-        BTreeInternalNode *internal = &root->fields.internal;
+    btree_values_remove(leaf->values, leaf->size, idx);
+    btree_positions_remove(leaf->positions, leaf->size, idx);
 
-        unsigned int idx = binary_search_left(internal->values, internal->size, value);
-        if (idx > 0) {
-            if (idx == internal->size) {
-                idx--;
-            } else {
-                BTreeLeafNode *leaf = btree_node_descend_left(internal->children[idx - 1], value);
-                if (leaf->values[leaf->size - 1] >= value) {
-                    return leaf;
-                }
-            }
-        }
+    leaf->size--;
 
-        return btree_node_descend_left(internal->children[idx], value);
+    // Separators stay valid lower bounds, so internal nodes only change if the leaf is emptied.
+    if (index->entries != NULL) {
+        index->entries[raw_pos] = (BTreeEntry) {NULL, 0};
     }
-}
-
-static inline int btree_leaf_node_search_left(BTreeLeafNode *leaf, int value) {
-    unsigned int idx = binary_search_left(leaf->values, leaf->size, value);
-    if (idx == leaf->size) {
-        return -1;
-    }
-
-    return idx;
-}
-
-static BTreeLeafNode *btree_node_descend_right(BTreeNode *root, int value) {
-    if (root->leaf) {
-        return &root->fields.leaf;
+    if (leaf->size > 0) {
+        btree_entries_update(index, node, idx);
     } else {
-        BTreeInternalNode *internal = &root->fields.internal;
-
-        unsigned int idx = binary_search_left(internal->values, internal->size, value);
-        if (idx == 0) {
-            return NULL;
-        }
-
-        return btree_node_descend_right(internal->children[idx - 1], value);
+        btree_leaf_free(index, node, value);
     }
-}
 
-static inline int btree_leaf_node_search_right(BTreeLeafNode *leaf, int value) {
-    unsigned int idx = binary_search_left(leaf->values, leaf->size, value);
-    if (idx == 0) {
-        return -1;
+    index->size--;
+
+    if (position_ptr != NULL) {
+        *position_ptr = raw_pos;
     }
 
-    return idx - 1;
+    return true;
 }
 
 bool btree_search(BTreeIndex *index, int value, unsigned int position, unsigned int *positions_map,
         unsigned int *position_ptr) {
-    BTreeLeafNode *leaf = btree_node_descend_left(index->root, value);
-    if (leaf == NULL) {
-        return false;
-    }
+    unsigned int idx;
+    unsigned int raw_pos;
 
-    int idx = btree_leaf_node_search_left(leaf, value);
-    if (idx == -1) {
+    BTreeNode *node = btree_find(index, value, position, positions_map, &idx, &raw_pos);
+    if (node == NULL) {
         return false;
     }
 
-    unsigned int i = idx;
-    for (BTreeLeafNode *node = leaf; node != NULL; node = node->next) {
-        for (; i < node->size; i++) {
-            if (node->values[i] != value) {
-                return false;
-            }
+    if (position_ptr != NULL) {
+        *position_ptr = raw_pos;
+    }
 
-            unsigned int raw_pos = node->positions[i];
-            unsigned int pos = positions_map != NULL ? positions_map[raw_pos] : raw_pos;
+    return true;
+}
 
-            if (pos == position) {
-                if (position_ptr != NULL) {
-                    *position_ptr = raw_pos;
-                }
+// Copies the positions of all values in [low, high) to result, or of all values >= low if
+// has_high is false.
+static unsigned int btree_select(BTreeIndex *index, int low, bool has_high, int high,
+        unsigned int *result) {
+    unsigned int result_count = 0;
 
-                return true;
-            }
+    for (BTreeNode *node = btree_descend(index, low); node != NULL;
+            node = node->fields.leaf.next) {
+        BTreeLeafNode *leaf = &node->fields.leaf;
+        unsigned int size = leaf->size;
+
+        unsigned int start = binary_search_left(leaf->values, size, low);
+        unsigned int end = has_high ? binary_search_left(leaf->values, size, high) : size;
+        if (end > start) {
+            memcpy(result + result_count, leaf->positions + start,
+                    (end - start) * sizeof(unsigned int));
+            result_count += end - start;
         }
 
-        i = 0;
+        if (end < size) {
+            break;
+        }
     }
 
-    return false;
+    return result_count;
 }
 
 unsigned int btree_select_lower(BTreeIndex *index, int high, unsigned int *result) {
-    if (index->size == 0) {
-        return 0;
-    }
-
-    BTreeLeafNode *leaf = btree_node_descend_right(index->root, high);
-    if (leaf == NULL) {
-        return 0;
-    }
-
-    int idx = btree_leaf_node_search_right(leaf, high);
-    if (idx == -1) {
-        return 0;
-    }
-
-    unsigned int result_count = 0;
-
-    for (BTreeLeafNode *node = index->head; node != leaf; node = node->next) {
-        memcpy(result + result_count, node->positions, node->size * sizeof(unsigned int));
-        result_count += node->size;
-    }
-
-    memcpy(result + result_count, leaf->positions, (idx + 1) * sizeof(unsigned int));
-    result_count += idx + 1;
-
-    return result_count;
+    return btree_select(index, INT_MIN, true, high, result);
 }
 
 unsigned int btree_select_higher(BTreeIndex *index, int low, unsigned int *result) {
-    if (index->size == 0) {
-        return 0;
-    }
-
-    BTreeLeafNode *leaf = btree_node_descend_left(index->root, low);
-    if (leaf == NULL) {
-        return 0;
-    }
-
-    int idx = btree_leaf_node_search_left(leaf, low);
-    if (idx == -1) {
-        return 0;
-    }
-
-    unsigned int result_count = 0;
-
-    memcpy(result, leaf->positions + idx, (leaf->size - idx) * sizeof(unsigned int));
-    result_count += leaf->size - idx;
-
-    for (BTreeLeafNode *node = leaf->next; node != NULL; node = node->next) {
-        memcpy(result + result_count, node->positions, node->size * sizeof(unsigned int));
-        result_count += node->size;
-    }
-
-    return result_count;
+    return btree_select(index, low, false, 0, result);
 }
 
 unsigned int btree_select_range(BTreeIndex *index, int low, int high, unsigned int *result) {
-    if (index->size == 0) {
-        return 0;
-    }
-
-    BTreeLeafNode *left_leaf = btree_node_descend_left(index->root, low);
-    if (left_leaf == NULL) {
-        return 0;
-    }
-
-    int left_idx = btree_leaf_node_search_left(left_leaf, low);
-    if (left_idx == -1) {
-        return 0;
-    }
-
-    BTreeLeafNode *right_leaf = btree_node_descend_right(index->root, high);
-    if (right_leaf == NULL) {
-        return 0;
-    }
-
-    int right_idx = btree_leaf_node_search_right(right_leaf, high);
-    if (right_idx == -1) {
-        return 0;
-    }
-
-    if (left_leaf == right_leaf) {
-        memcpy(result, left_leaf->positions + left_idx,
-                (right_idx - left_idx + 1) * sizeof(unsigned int));
-        return right_idx - left_idx + 1;
-    } else {
-        unsigned int result_count = 0;
-
-        memcpy(result, left_leaf->positions + left_idx,
-                (left_leaf->size - left_idx) * sizeof(unsigned int));
-        result_count += left_leaf->size - left_idx;
-
-        for (BTreeLeafNode *node = left_leaf->next; node != right_leaf; node = node->next) {
-            memcpy(result + result_count, node->positions, node->size * sizeof(unsigned int));
-            result_count += node->size;
-        }
-
-        memcpy(result + result_count, right_leaf->positions,
-                (right_idx + 1) * sizeof(unsigned int));
-        result_count += right_idx + 1;
-
-        return result_count;
-    }
+    return btree_select(index, low, true, high, result);
 }
 
 int btree_min(BTreeIndex *index, unsigned int *position_ptr) {
-    BTreeLeafNode *leaf = index->head;
+    BTreeNode *node = index->head;
+    if (node == NULL) {
+        return 0;
+    }
 
     if (position_ptr != NULL) {
-        *position_ptr = leaf->positions[0];
+        *position_ptr = node->fields.leaf.positions[0];
     }
 
-    return leaf->values[0];
+    return node->fields.leaf.values[0];
 }
 
 int btree_max(BTreeIndex *index, unsigned int *position_ptr) {
-    BTreeLeafNode *leaf = index->tail;
-    unsigned int idx = leaf->size - 1;
+    BTreeNode *node = index->tail;
+    if (node == NULL) {
+        return 0;
+    }
 
+    unsigned int idx = node->fields.leaf.size - 1;
     if (position_ptr != NULL) {
-        *position_ptr = leaf->positions[idx];
+        *position_ptr = node->fields.leaf.positions[idx];
     }
 
-    return leaf->values[idx];
+    return node->fields.leaf.values[idx];
 }
-
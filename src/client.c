@@ -42,6 +42,12 @@ typedef struct Table {
     int **column_values;
 } Table;
 
+typedef struct Rows {
+    unsigned int columns_count;
+    unsigned int rows_count;
+    IntVector values;
+} Rows;
+
 /**
  * connect_client()
  *
@@ -100,6 +106,43 @@ static inline char *parse_load(char *load_arguments) {
     return load_arguments_stripped2;
 }
 
+// Inserts of several rows, of the form relational_insert(db.tbl,(1,2),(3,4)), are sent as
+// relational_insert(db.tbl) followed by their rows in binary. Returns the table to insert into if
+// the rows were parsed, or NULL if the insert is to be sent as is or status was set.
+static inline char *parse_insert_rows(char *insert_arguments, Rows *rows, MessageStatus *status) {
+    char *insert_arguments_stripped = strip_parenthesis(insert_arguments);
+    if (insert_arguments_stripped == insert_arguments) {
+        return NULL;
+    }
+
+    char *table_fqn = strsep(&insert_arguments_stripped, ",");
+    if (insert_arguments_stripped == NULL) {
+        // The server would wait for rows to follow.
+        *status = WRONG_NUMBER_OF_ARGUMENTS;
+        return NULL;
+    }
+
+    if (*insert_arguments_stripped != '(') {
+        return NULL;
+    }
+
+    if (!is_valid_fqn(table_fqn, 1)) {
+        *status = INCORRECT_FORMAT;
+        return NULL;
+    }
+
+    int_vector_init(&rows->values, 0);
+    rows->columns_count = parse_int_tuples(insert_arguments_stripped, &rows->values);
+    if (rows->columns_count == 0) {
+        int_vector_destroy(&rows->values);
+        *status = INCORRECT_FORMAT;
+        return NULL;
+    }
+    rows->rows_count = rows->values.size / rows->columns_count;
+
+    return table_fqn;
+}
+
 MessageStatus load_table(char *file_path, Table *table) {
     int fd = open(file_path, O_RDONLY);
     if (fd == -1) {
@@ -386,6 +429,28 @@ static inline bool send_table(int client_socket, Table *table) {
     return true;
 }
 
+static inline bool send_rows(int client_socket, Rows *rows) {
+    bool sent = true;
+
+    if (send(client_socket, &rows->columns_count, sizeof(rows->columns_count), MSG_NOSIGNAL)
+            == -1) {
+        log_err("Failed to send columns count.\n");
+        sent = false;
+    } else if (send(client_socket, &rows->rows_count, sizeof(rows->rows_count), MSG_NOSIGNAL)
+            == -1) {
+        log_err("Failed to send rows count.\n");
+        sent = false;
+    } else if (send(client_socket, rows->values.data, rows->values.size * sizeof(int),
+            MSG_NOSIGNAL) == -1) {
+        log_err("Failed to send rows.\n");
+        sent = false;
+    }
+
+    int_vector_destroy(&rows->values);
+
+    return sent;
+}
+
 static inline void print_payload(char *payload) {
     unsigned int num_columns = *((unsigned int *) payload);
     payload += sizeof(unsigned int);
@@ -463,6 +528,7 @@ int main(void) {
     Message recv_message = MESSAGE_INITIALIZER;
 
     Table table;
+    Rows rows;
 
     bool interactive = isatty(fileno(stdin));
 
@@ -520,6 +586,23 @@ int main(void) {
             loaded = true;
         }
 
+        bool framed = false;
+
+        if (strncmp(parse_buffer_stripped, "relational_insert", 17) == 0) {
+            MessageStatus insert_status = OK;
+            char *table_fqn = parse_insert_rows(parse_buffer_stripped + 17, &rows, &insert_status);
+            if (insert_status != OK) {
+                print_error(insert_status, interactive, line_num);
+                continue;
+            }
+
+            if (table_fqn != NULL) {
+                send_message.length = snprintf(read_buffer, READ_BUFFER_SIZE,
+                        "relational_insert(%s)", table_fqn);
+                framed = true;
+            }
+        }
+
         // Send the message_header, which tells server payload size.
         if (send(client_socket, &send_message.length, sizeof(send_message.length), MSG_NOSIGNAL)
                 == -1) {
@@ -541,6 +624,12 @@ int main(void) {
             break;
         }
 
+        // Send the rows of an insert of several rows.
+        if (framed && !send_rows(client_socket, &rows)) {
+            error = true;
+            break;
+        }
+
         // Always wait for server response (even if it is just an OK message).
         if (!recv_and_check(client_socket, &recv_message.status, sizeof(recv_message.status),
                 MSG_WAITALL)) {
@@ -29,10 +29,11 @@ void client_context_destroy(ClientContext *client_context) {
 }
 
 void result_put(ClientContext *client_context, char *name, DataType type, Column *source,
-        void *values, unsigned int num_tuples) {
+        unsigned int moves, void *values, unsigned int num_tuples, bool sorted) {
     Result *result = malloc(sizeof(Result));
     result->type = type;
     result->source = source;
+    result->moves = moves;
     switch (type) {
     case POS:
         result->values.pos_values = values;
@@ -48,6 +49,7 @@ void result_put(ClientContext *client_context, char *name, DataType type, Column
         break;
     }
     result->num_tuples = num_tuples;
+    result->sorted = sorted;
 
     pthread_mutex_lock(&client_context->results_mutex);
     Result *removed = hash_table_put(&client_context->results_table, name, result);
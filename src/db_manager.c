@@ -3,14 +3,18 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/stat.h>
 
 #include "db_manager.h"
+#include "epoch.h"
 #include "hash_table.h"
 #include "message.h"
 #include "queue.h"
+#include "sort.h"
+#include "thread_pool.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -23,13 +27,28 @@
 #define DB_MANAGER_TABLE_INITIAL_CAPACITY 1
 #define DB_MANAGER_TABLE_LOAD_FACTOR 1.0f
 
-#define COLUMN_INITIAL_CAPACITY 8
+#define TABLE_SEGMENTS_INITIAL_CAPACITY 8
+
+// Indexes are rebuilt from a snapshot of their table by a background thread, which checks every
+// DELTA_MERGE_INTERVAL_MS whether the rows changed or appended since they were built reach
+// 1/DELTA_MERGE_RATIO of the rows they hold. Until then readers take those rows from the table.
+#define DELTA_MERGE_INTERVAL_MS 100
+#define DELTA_MERGE_RATIO 16
+
+#define TABLE_CHANGES_INITIAL_CAPACITY 64
 
 Db *db_manager_dbs = NULL;
 
-HashTable db_manager_table;
+// Every db, table and column by name. Lookups read the published catalog without any lock, while
+// DDL, serialized by the mutex, publishes a changed copy and retires the one it replaced.
+HashTable *db_manager_table;
 pthread_mutex_t db_manager_table_mutex;
 
+pthread_t delta_merge_thread;
+pthread_mutex_t delta_merge_mutex;
+pthread_cond_t delta_merge_cond;
+bool delta_merge_stopped;
+
 static inline void db_free(Db *db);
 static inline void table_free(Table *table);
 static inline void column_free(Column *column);
@@ -38,22 +57,38 @@ static inline void index_free(ColumnIndex *index);
 static inline bool db_save(Db *db);
 static inline bool table_save(Table *table, FILE *file);
 static inline bool column_save(Column *column, FILE *file);
+static inline bool column_values_save(Column *column, FILE *file);
+static inline bool deleted_rows_save(bool **segments, unsigned int count, FILE *file);
 static inline bool index_save(ColumnIndex *index, FILE *file);
 
 static inline Db *db_load(char *db_name);
 static inline Table *table_load(FILE *file);
-static inline bool column_load(Column *column, unsigned int order, FILE *file);
-static inline ColumnIndex *index_load(FILE *file);
+static inline bool column_load(Column *column, unsigned int order, IntVector *values,
+        FILE *file);
+static inline ColumnIndex *index_load(FILE *file, unsigned int *clustered_count_ptr);
+
+static inline void table_init(Table *table, char *name, unsigned int columns_capacity);
+
+static inline HashTable *catalog_copy();
+static inline void catalog_publish(HashTable *catalog);
+
+static void *delta_merge_routine(void *data);
+static void table_delta_flush(Table *table);
 
 static inline void db_register(Db *db);
 static inline void table_register(Table *table, char *db_name);
 static inline void column_register(Column *column, char *table_fqn);
 
 void db_manager_startup() {
-    hash_table_init(&db_manager_table, DB_MANAGER_TABLE_INITIAL_CAPACITY,
+    db_manager_table = malloc(sizeof(HashTable));
+    hash_table_init(db_manager_table, DB_MANAGER_TABLE_INITIAL_CAPACITY,
             DB_MANAGER_TABLE_LOAD_FACTOR);
     pthread_mutex_init(&db_manager_table_mutex, NULL);
 
+    pthread_mutex_init(&delta_merge_mutex, NULL);
+    pthread_cond_init(&delta_merge_cond, NULL);
+    delta_merge_stopped = false;
+
     DIR *dir;
     struct dirent *ent;
     if ((dir = opendir(DATA_DIRECTORY)) != NULL) {
@@ -73,23 +108,42 @@ void db_manager_startup() {
     } else {
         log_err("Unable to open directory \"%s\"\n", DATA_DIRECTORY);
     }
+
+    pthread_create(&delta_merge_thread, NULL, &delta_merge_routine, NULL);
 }
 
 void db_manager_shutdown() {
+    pthread_mutex_lock(&delta_merge_mutex);
+    delta_merge_stopped = true;
+    pthread_cond_signal(&delta_merge_cond);
+    pthread_mutex_unlock(&delta_merge_mutex);
+
+    pthread_join(delta_merge_thread, NULL);
+    pthread_mutex_destroy(&delta_merge_mutex);
+    pthread_cond_destroy(&delta_merge_cond);
+
     for (Db *db = db_manager_dbs, *next; db != NULL; db = next) {
+        // Saved indexes hold every row as it is.
+        for (Table *table = db->tables; table != NULL; table = table->next) {
+            table_write_begin(table);
+            table_delta_merge(table, false);
+            table_write_commit(table);
+        }
+
         db_save(db);
         next = db->next;
         db_free(db);
     }
 
-    hash_table_destroy(&db_manager_table, NULL);
+    hash_table_destroy(db_manager_table, NULL);
+    free(db_manager_table);
     pthread_mutex_destroy(&db_manager_table_mutex);
 }
 
 void db_create(char *name, Message *send_message) {
     pthread_mutex_lock(&db_manager_table_mutex);
 
-    if (hash_table_get(&db_manager_table, name) != NULL) {
+    if (hash_table_get(db_manager_table, name) != NULL) {
         send_message->status = DATABASE_ALREADY_EXISTS;
         pthread_mutex_unlock(&db_manager_table_mutex);
         return;
@@ -103,7 +157,9 @@ void db_create(char *name, Message *send_message) {
 
     db_manager_dbs = db;
 
-    hash_table_put(&db_manager_table, name, db);
+    HashTable *catalog = catalog_copy();
+    hash_table_put(catalog, name, db);
+    catalog_publish(catalog);
 
     pthread_mutex_unlock(&db_manager_table_mutex);
 }
@@ -113,14 +169,14 @@ void table_create(char *name, char *db_name, unsigned int num_columns, Message *
 
     pthread_mutex_lock(&db_manager_table_mutex);
 
-    if (hash_table_get(&db_manager_table, table_fqn) != NULL) {
+    if (hash_table_get(db_manager_table, table_fqn) != NULL) {
         send_message->status = TABLE_ALREADY_EXISTS;
         pthread_mutex_unlock(&db_manager_table_mutex);
         free(table_fqn);
         return;
     }
 
-    Db *db = hash_table_get(&db_manager_table, db_name);
+    Db *db = hash_table_get(db_manager_table, db_name);
     if (db == NULL) {
         send_message->status = DATABASE_NOT_FOUND;
         pthread_mutex_unlock(&db_manager_table_mutex);
@@ -129,20 +185,16 @@ void table_create(char *name, char *db_name, unsigned int num_columns, Message *
     }
 
     Table *table = malloc(sizeof(Table));
-    table->name = strdup(name);
-    table->columns = malloc(num_columns * sizeof(Column));
-    table->columns_count = 0;
-    table->columns_capacity = num_columns;
-    table->rows_count = 0;
-    queue_init(&table->delete_queue);
-    table->deleted_rows = NULL;
-    pthread_rwlock_init(&table->rwlock, NULL);
+    table_init(table, strdup(name), num_columns);
     table->db = db;
     table->next = db->tables;
 
     db->tables = table;
     db->tables_count++;
-    hash_table_put(&db_manager_table, table_fqn, table);
+
+    HashTable *catalog = catalog_copy();
+    hash_table_put(catalog, table_fqn, table);
+    catalog_publish(catalog);
 
     pthread_mutex_unlock(&db_manager_table_mutex);
 
@@ -154,14 +206,14 @@ void column_create(char *name, char *table_fqn, Message *send_message) {
 
     pthread_mutex_lock(&db_manager_table_mutex);
 
-    if (hash_table_get(&db_manager_table, column_fqn) != NULL) {
+    if (hash_table_get(db_manager_table, column_fqn) != NULL) {
         send_message->status = COLUMN_ALREADY_EXISTS;
         pthread_mutex_unlock(&db_manager_table_mutex);
         free(column_fqn);
         return;
     }
 
-    Table *table = hash_table_get(&db_manager_table, table_fqn);
+    Table *table = hash_table_get(db_manager_table, table_fqn);
     if (table == NULL) {
         send_message->status = TABLE_NOT_FOUND;
         pthread_mutex_unlock(&db_manager_table_mutex);
@@ -177,175 +229,1189 @@ void column_create(char *name, char *table_fqn, Message *send_message) {
         return;
     }
 
-    Column *column = &table->columns[table->columns_count];
-    column->name = strdup(name);
-    column->order = table->columns_count;
-    int_vector_init(&column->values, COLUMN_INITIAL_CAPACITY);
-    column->index = NULL;
-    column->table = table;
+    Column *column = &table->columns[table->columns_count];
+    column->name = strdup(name);
+    column->order = table->columns_count;
+    column->index = NULL;
+    column->index_build = NULL;
+    column->table = table;
+
+    table->columns_count++;
+
+    HashTable *catalog = catalog_copy();
+    hash_table_put(catalog, column_fqn, column);
+    catalog_publish(catalog);
+
+    pthread_mutex_unlock(&db_manager_table_mutex);
+
+    free(column_fqn);
+}
+
+static inline unsigned int segments_count(unsigned int values_count) {
+    return (values_count + COLUMN_SEGMENT_SIZE - 1) >> COLUMN_SEGMENT_BITS;
+}
+
+static inline TableVersion *table_version_alloc(unsigned int columns_capacity) {
+    TableVersion *version = malloc(sizeof(TableVersion)
+            + columns_capacity * (sizeof(int **) + sizeof(ColumnIndex *)));
+    version->columns = (int ***) (version + 1);
+    version->indexes = (ColumnIndex **) (version->columns + columns_capacity);
+    return version;
+}
+
+static void table_version_free(TableVersion *version, unsigned int columns_capacity) {
+    unsigned int count = segments_count(version->values_count);
+    for (unsigned int c = 0; c < columns_capacity; c++) {
+        for (unsigned int s = 0; s < count; s++) {
+            free(version->columns[c][s]);
+        }
+        free(version->columns[c]);
+    }
+
+    if (version->deleted_rows != NULL) {
+        for (unsigned int s = 0; s < count; s++) {
+            free(version->deleted_rows[s]);
+        }
+        free(version->deleted_rows);
+    }
+
+    if (version->changed_rows != NULL) {
+        for (unsigned int s = 0; s < count; s++) {
+            free(version->changed_rows[s]);
+        }
+        free(version->changed_rows);
+    }
+    free(version->changes);
+
+    free(version);
+}
+
+// Sets up a table without columns or rows.
+static inline void table_init(Table *table, char *name, unsigned int columns_capacity) {
+    table->name = name;
+    table->columns = malloc(columns_capacity * sizeof(Column));
+    table->columns_count = 0;
+    table->columns_capacity = columns_capacity;
+    table->segments_capacity = TABLE_SEGMENTS_INITIAL_CAPACITY;
+
+    TableVersion *version = table_version_alloc(columns_capacity);
+    version->rows_count = 0;
+    version->values_count = 0;
+    version->moves = 0;
+    for (unsigned int c = 0; c < columns_capacity; c++) {
+        version->columns[c] = malloc(table->segments_capacity * sizeof(int *));
+        version->indexes[c] = NULL;
+    }
+    version->deleted_rows = NULL;
+    version->changed_rows = NULL;
+    version->changes = NULL;
+    version->changes_start = 0;
+    version->changes_count = 0;
+
+    table->version = version;
+    pthread_rwlock_init(&table->rwlock, NULL);
+    table->pending = NULL;
+    vector_init(&table->retired, 0);
+    vector_init(&table->retired_indexes, 0);
+    table->changes_capacity = 0;
+    table->indexed_count = 0;
+    table->changes_logged = 0;
+    table->clustered_count = 0;
+    queue_init(&table->delete_queue);
+    pthread_mutex_init(&table->inserts_mutex, NULL);
+    pthread_cond_init(&table->inserts_cond, NULL);
+    vector_init(&table->inserts, 0);
+    table->inserting = false;
+}
+
+// Rows as seen by the writer of the table, with the changes it has not published yet.
+static inline TableVersion *table_write_version(Table *table) {
+    return table->pending != NULL ? table->pending : table->version;
+}
+
+void column_reader_open(ColumnReader *reader, Column *column, ColumnIndex *index) {
+    Table *table = column->table;
+
+    epoch_enter();
+    TableVersion *version = __atomic_load_n(&table->version, __ATOMIC_SEQ_CST);
+
+    reader->segments = version->columns[column->order];
+    reader->deleted_rows = version->rows_count < version->values_count
+            ? version->deleted_rows : NULL;
+    reader->values_count = version->values_count;
+    reader->rows_count = version->rows_count;
+    reader->moves = version->moves;
+    reader->index = index != NULL ? version->indexes[column->order] : NULL;
+    reader->version = version;
+    reader->table = table;
+}
+
+static inline int reader_value(ColumnReader *reader, unsigned int position) {
+    return reader->segments[position >> COLUMN_SEGMENT_BITS][position & COLUMN_SEGMENT_MASK];
+}
+
+static inline bool reader_row_deleted(ColumnReader *reader, unsigned int position) {
+    return reader->deleted_rows != NULL
+            && reader->deleted_rows[position >> COLUMN_SEGMENT_BITS][position & COLUMN_SEGMENT_MASK];
+}
+
+// Returns whether the index of a reader holds the row at position as it is in the version read.
+static inline bool reader_row_indexed(ColumnReader *reader, unsigned int position) {
+    TableVersion *version = reader->version;
+    ColumnIndex *index = reader->index;
+    if (position >= index->indexed_count || position >= version->values_count) {
+        return false;
+    }
+
+    unsigned int **changed_rows = version->changed_rows;
+    return changed_rows == NULL || changed_rows[position >> COLUMN_SEGMENT_BITS]
+            [position & COLUMN_SEGMENT_MASK] <= index->changes_count;
+}
+
+// Returns an upper bound on the number of rows of a reader that its index does not hold as they
+// are in the version read.
+static inline unsigned int reader_delta_capacity(ColumnReader *reader) {
+    TableVersion *version = reader->version;
+    ColumnIndex *index = reader->index;
+    unsigned int covered = index->indexed_count < version->values_count
+            ? index->indexed_count : version->values_count;
+    return version->changes_count - index->changes_count + version->values_count - covered;
+}
+
+// Copies the values of the live rows of a reader that its index does not hold as they are in the
+// version read, and that are >= low if has_low and < high if has_high, to values, and their
+// positions to positions, in position order. These are the rows changed since the index was built,
+// each taken at its last change, then the rows past those it holds. Returns the number of rows
+// copied.
+static unsigned int reader_delta(ColumnReader *reader, bool has_low, int low, bool has_high,
+        int high, int *values, unsigned int *positions) {
+    TableVersion *version = reader->version;
+    ColumnIndex *index = reader->index;
+    unsigned int covered = index->indexed_count < version->values_count
+            ? index->indexed_count : version->values_count;
+
+    unsigned int changed_count = 0;
+    for (unsigned int k = index->changes_count; k < version->changes_count; k++) {
+        unsigned int p = version->changes[k - version->changes_start];
+        positions[changed_count] = p;
+        changed_count += p < covered && !reader_row_deleted(reader, p) && version->changed_rows
+                [p >> COLUMN_SEGMENT_BITS][p & COLUMN_SEGMENT_MASK] == k + 1;
+    }
+
+    // Positions fit in an int, and values is free to take the order the sort leaves behind.
+    if (changed_count > 1) {
+        radix_sort_indices((int *) positions, NULL, (int *) positions, (unsigned int *) values,
+                changed_count);
+    }
+
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < changed_count; i++) {
+        unsigned int p = positions[i];
+        int value = reader_value(reader, p);
+        values[count] = value;
+        positions[count] = p;
+        count += (!has_low || value >= low) && (!has_high || value < high);
+    }
+
+    for (unsigned int p = covered; p < version->values_count; p++) {
+        if (reader_row_deleted(reader, p)) {
+            continue;
+        }
+
+        int value = reader_value(reader, p);
+        values[count] = value;
+        positions[count] = p;
+        count += (!has_low || value >= low) && (!has_high || value < high);
+    }
+
+    return count;
+}
+
+static unsigned int index_select(ColumnIndex *index, bool has_low, int low, bool has_high,
+        int high, unsigned int *result) {
+    switch (index->type) {
+    case BTREE:
+        if (!has_low) {
+            return btree_select_lower(&index->fields.btree, high, result);
+        } else if (!has_high) {
+            return btree_select_higher(&index->fields.btree, low, result);
+        }
+        return btree_select_range(&index->fields.btree, low, high, result);
+    case SORTED:
+        if (!has_low) {
+            return sorted_select_lower(&index->fields.sorted, high, result);
+        } else if (!has_high) {
+            return sorted_select_higher(&index->fields.sorted, low, result);
+        }
+        return sorted_select_range(&index->fields.sorted, low, high, result);
+    case LEARNED:
+        if (!has_low) {
+            return learned_select_lower(&index->fields.learned, high, result);
+        } else if (!has_high) {
+            return learned_select_higher(&index->fields.learned, low, result);
+        }
+        return learned_select_range(&index->fields.learned, low, high, result);
+    case HASHED:
+        return hash_index_select(&index->fields.hash, low, result);
+    }
+    return 0;
+}
+
+// Entries of the index that no longer hold their row as read are filtered out, and the rows it
+// misses are sorted and merged in, so the result stays ordered by value and then by position.
+unsigned int column_reader_index_select(ColumnReader *reader, bool has_low, int low,
+        bool has_high, int high, unsigned int *result) {
+    TableVersion *version = reader->version;
+    ColumnIndex *index = reader->index;
+
+    // Entries of rows deleted since the index was built may not fit in result.
+    unsigned int *entries = index->rows_count > reader->rows_count
+            ? malloc(index->rows_count * sizeof(unsigned int)) : result;
+    unsigned int entries_count = index_select(index, has_low, low, has_high, high, entries);
+
+    unsigned int result_count = entries_count;
+    if (entries != result || index->indexed_count > version->values_count
+            || index->changes_count < version->changes_count) {
+        result_count = 0;
+        for (unsigned int i = 0; i < entries_count; i++) {
+            result[result_count] = entries[i];
+            result_count += reader_row_indexed(reader, entries[i]);
+        }
+    }
+    if (entries != result) {
+        free(entries);
+    }
+
+    unsigned int capacity = reader_delta_capacity(reader);
+    if (capacity == 0) {
+        return result_count;
+    }
+
+    int *values = malloc(capacity * sizeof(int));
+    unsigned int *positions = malloc(capacity * sizeof(unsigned int));
+    unsigned int count = reader_delta(reader, has_low, low, has_high, high, values, positions);
+    radix_sort_indices(values, positions, values, positions, count);
+
+    // From the last row down, the entries after each row are moved past it.
+    unsigned int end = result_count;
+    for (unsigned int j = count; j-- > 0;) {
+        unsigned int left = 0;
+        unsigned int right = end;
+        while (left < right) {
+            unsigned int mid = left + (right - left) / 2;
+            int value = reader_value(reader, result[mid]);
+            if (value > values[j] || (value == values[j] && result[mid] > positions[j])) {
+                right = mid;
+            } else {
+                left = mid + 1;
+            }
+        }
+
+        memmove(result + left + j + 1, result + left, (end - left) * sizeof(unsigned int));
+        result[left + j] = positions[j];
+        end = left;
+    }
+
+    free(values);
+    free(positions);
+
+    return result_count + count;
+}
+
+// The extremum of the index is only current if the index still holds its row as read, the rows it
+// misses are then compared with it. Ties go to the first row for the minimum and to the last one
+// for the maximum, like the entries of the index.
+static bool column_reader_index_extremum(ColumnReader *reader, bool max, int *value_ptr,
+        unsigned int *position_ptr) {
+    ColumnIndex *index = reader->index;
+    if (index->rows_count == 0) {
+        return false;
+    }
+
+    int value = 0;
+    unsigned int position = 0;
+    switch (index->type) {
+    case BTREE:
+        value = max ? btree_max(&index->fields.btree, &position)
+                : btree_min(&index->fields.btree, &position);
+        break;
+    case SORTED:
+        value = max ? sorted_max(&index->fields.sorted, &position)
+                : sorted_min(&index->fields.sorted, &position);
+        break;
+    case LEARNED:
+        value = max ? learned_max(&index->fields.learned, &position)
+                : learned_min(&index->fields.learned, &position);
+        break;
+    case HASHED:
+        return false;
+    }
+
+    if (!reader_row_indexed(reader, position)) {
+        return false;
+    }
+
+    unsigned int capacity = reader_delta_capacity(reader);
+    if (capacity > 0) {
+        int *values = malloc(capacity * sizeof(int));
+        unsigned int *positions = malloc(capacity * sizeof(unsigned int));
+        unsigned int count = reader_delta(reader, false, 0, false, 0, values, positions);
+
+        for (unsigned int i = 0; i < count; i++) {
+            bool better = max ? values[i] > value || (values[i] == value && positions[i] > position)
+                    : values[i] < value || (values[i] == value && positions[i] < position);
+            if (better) {
+                value = values[i];
+                position = positions[i];
+            }
+        }
+
+        free(values);
+        free(positions);
+    }
+
+    *value_ptr = value;
+    if (position_ptr != NULL) {
+        *position_ptr = position;
+    }
+    return true;
+}
+
+bool column_reader_index_min(ColumnReader *reader, int *value_ptr, unsigned int *position_ptr) {
+    return column_reader_index_extremum(reader, false, value_ptr, position_ptr);
+}
+
+bool column_reader_index_max(ColumnReader *reader, int *value_ptr, unsigned int *position_ptr) {
+    return column_reader_index_extremum(reader, true, value_ptr, position_ptr);
+}
+
+void column_reader_open_values(ColumnReader *reader, int *values, unsigned int values_count) {
+    unsigned int count = segments_count(values_count);
+    reader->segments = malloc(count * sizeof(int *));
+    for (unsigned int s = 0; s < count; s++) {
+        reader->segments[s] = values + (s << COLUMN_SEGMENT_BITS);
+    }
+
+    reader->deleted_rows = NULL;
+    reader->values_count = values_count;
+    reader->rows_count = values_count;
+    reader->moves = 0;
+    reader->index = NULL;
+    reader->version = NULL;
+    reader->table = NULL;
+}
+
+void column_reader_close(ColumnReader *reader) {
+    if (reader->table == NULL) {
+        free(reader->segments);
+        return;
+    }
+
+    epoch_exit();
+}
+
+void table_write_begin(Table *table) {
+    TableVersion *version = table->version;
+
+    TableVersion *pending = table_version_alloc(table->columns_capacity);
+    pending->rows_count = version->rows_count;
+    pending->values_count = version->values_count;
+    memcpy(pending->columns, version->columns, table->columns_capacity * sizeof(int **));
+    memcpy(pending->indexes, version->indexes, table->columns_capacity * sizeof(ColumnIndex *));
+    pending->deleted_rows = version->deleted_rows;
+    pending->moves = version->moves;
+    pending->changed_rows = version->changed_rows;
+    pending->changes = version->changes;
+    pending->changes_start = version->changes_start;
+    pending->changes_count = version->changes_count;
+
+    table->pending = pending;
+    table->changes_logged = pending->changes_count;
+}
+
+static void index_release(void *data) {
+    index_free(data);
+}
+
+// Drops the changes that every index and every index being built holds from the log of the
+// version being written.
+static void table_changes_trim(Table *table) {
+    TableVersion *pending = table->pending;
+
+    unsigned int start = pending->changes_count;
+    for (unsigned int i = 0; i < table->columns_count; i++) {
+        ColumnIndex *index = pending->indexes[i];
+        if (index != NULL && index->changes_count < start) {
+            start = index->changes_count;
+        }
+
+        IndexBuild *build = table->columns[i].index_build;
+        if (build != NULL && build->changes_count < start) {
+            start = build->changes_count;
+        }
+    }
+
+    if (start == pending->changes_start) {
+        return;
+    }
+
+    unsigned int count = pending->changes_count - start;
+    if (pending->changes != NULL) {
+        vector_append(&table->retired, pending->changes);
+    }
+
+    if (count == 0) {
+        // No index misses any change, so neither are the changes of rows needed anymore.
+        if (pending->changed_rows != NULL) {
+            for (unsigned int s = 0; s < segments_count(pending->values_count); s++) {
+                vector_append(&table->retired, pending->changed_rows[s]);
+            }
+            vector_append(&table->retired, pending->changed_rows);
+            pending->changed_rows = NULL;
+        }
+
+        pending->changes = NULL;
+        table->changes_capacity = 0;
+    } else {
+        unsigned int capacity = TABLE_CHANGES_INITIAL_CAPACITY;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+
+        unsigned int *changes = malloc(capacity * sizeof(unsigned int));
+        memcpy(changes, pending->changes + (start - pending->changes_start),
+                count * sizeof(unsigned int));
+        pending->changes = changes;
+        table->changes_capacity = capacity;
+    }
+
+    pending->changes_start = start;
+}
+
+void table_write_commit(Table *table) {
+    TableVersion *version = table->version;
+    TableVersion *pending = table->pending;
+
+    table_changes_trim(table);
+
+    // Once no row is deleted anymore, the flags are dropped until the next delete.
+    if (pending->deleted_rows != NULL && pending->rows_count == pending->values_count) {
+        for (unsigned int s = 0; s < segments_count(pending->values_count); s++) {
+            vector_append(&table->retired, pending->deleted_rows[s]);
+        }
+        vector_append(&table->retired, pending->deleted_rows);
+        pending->deleted_rows = NULL;
+    }
+
+    __atomic_store_n(&table->version, table->pending, __ATOMIC_SEQ_CST);
+    table->pending = NULL;
+
+    // Readers may still scan what was replaced, until they leave their epoch.
+    epoch_retire(version, &free);
+    for (unsigned int i = 0; i < table->retired.size; i++) {
+        epoch_retire(table->retired.data[i], &free);
+    }
+    table->retired.size = 0;
+    for (unsigned int i = 0; i < table->retired_indexes.size; i++) {
+        epoch_retire(table->retired_indexes.data[i], &index_release);
+    }
+    table->retired_indexes.size = 0;
+
+    // Readers choose how to read a column by its index, which the version they read then holds.
+    for (unsigned int i = 0; i < table->columns_count; i++) {
+        if (table->columns[i].index != pending->indexes[i]) {
+            __atomic_store_n(&table->columns[i].index, pending->indexes[i], __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// Returns the segment of a column holding position in the pending version, copying it first if
+// the published version shares it and readers can see the position. The copy is skipped if the
+// caller overwrites the whole segment.
+static int *column_segment_write(Table *table, unsigned int order, unsigned int position,
+        bool overwrite) {
+    TableVersion *pending = table->pending;
+    TableVersion *version = table->version;
+    unsigned int segment = position >> COLUMN_SEGMENT_BITS;
+
+    int **segments = pending->columns[order];
+    if (position >= version->values_count) {
+        return segments[segment];
+    }
+
+    int **published = version->columns[order];
+    if (segments == published) {
+        segments = malloc(table->segments_capacity * sizeof(int *));
+        memcpy(segments, published, segments_count(pending->values_count) * sizeof(int *));
+        vector_append(&table->retired, published);
+        pending->columns[order] = segments;
+    }
+
+    if (segments[segment] == published[segment]) {
+        segments[segment] = malloc(COLUMN_SEGMENT_SIZE * sizeof(int));
+        if (!overwrite) {
+            memcpy(segments[segment], published[segment], COLUMN_SEGMENT_SIZE * sizeof(int));
+        }
+        vector_append(&table->retired, published[segment]);
+    }
+
+    return segments[segment];
+}
+
+static bool *deleted_segment_write(Table *table, unsigned int position) {
+    TableVersion *pending = table->pending;
+    TableVersion *version = table->version;
+    unsigned int segment = position >> COLUMN_SEGMENT_BITS;
+
+    bool **segments = pending->deleted_rows;
+    bool **published = version->deleted_rows;
+    if (position >= version->values_count || published == NULL) {
+        return segments[segment];
+    }
+
+    if (segments == published) {
+        segments = malloc(table->segments_capacity * sizeof(bool *));
+        memcpy(segments, published, segments_count(pending->values_count) * sizeof(bool *));
+        vector_append(&table->retired, published);
+        pending->deleted_rows = segments;
+    }
+
+    if (segments[segment] == published[segment]) {
+        segments[segment] = malloc(COLUMN_SEGMENT_SIZE * sizeof(bool));
+        memcpy(segments[segment], published[segment], COLUMN_SEGMENT_SIZE * sizeof(bool));
+        vector_append(&table->retired, published[segment]);
+    }
+
+    return segments[segment];
+}
+
+static unsigned int *changed_segment_write(Table *table, unsigned int position) {
+    TableVersion *pending = table->pending;
+    TableVersion *version = table->version;
+    unsigned int segment = position >> COLUMN_SEGMENT_BITS;
+
+    unsigned int **segments = pending->changed_rows;
+    unsigned int **published = version->changed_rows;
+    if (position >= version->values_count || published == NULL) {
+        return segments[segment];
+    }
+
+    if (segments == published) {
+        segments = malloc(table->segments_capacity * sizeof(unsigned int *));
+        memcpy(segments, published,
+                segments_count(pending->values_count) * sizeof(unsigned int *));
+        vector_append(&table->retired, published);
+        pending->changed_rows = segments;
+    }
+
+    if (segments[segment] == published[segment]) {
+        segments[segment] = malloc(COLUMN_SEGMENT_SIZE * sizeof(unsigned int));
+        memcpy(segments[segment], published[segment], COLUMN_SEGMENT_SIZE * sizeof(unsigned int));
+        vector_append(&table->retired, published[segment]);
+    }
+
+    return segments[segment];
+}
+
+// Grows the segment arrays of the pending version to hold count segments.
+static void table_segments_reserve(Table *table, unsigned int count) {
+    if (count <= table->segments_capacity) {
+        return;
+    }
+
+    unsigned int capacity = table->segments_capacity;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+
+    TableVersion *pending = table->pending;
+    unsigned int used = segments_count(pending->values_count);
+
+    for (unsigned int c = 0; c < table->columns_capacity; c++) {
+        int **segments = malloc(capacity * sizeof(int *));
+        memcpy(segments, pending->columns[c], used * sizeof(int *));
+        vector_append(&table->retired, pending->columns[c]);
+        pending->columns[c] = segments;
+    }
+
+    if (pending->deleted_rows != NULL) {
+        bool **segments = malloc(capacity * sizeof(bool *));
+        memcpy(segments, pending->deleted_rows, used * sizeof(bool *));
+        vector_append(&table->retired, pending->deleted_rows);
+        pending->deleted_rows = segments;
+    }
+
+    if (pending->changed_rows != NULL) {
+        unsigned int **segments = malloc(capacity * sizeof(unsigned int *));
+        memcpy(segments, pending->changed_rows, used * sizeof(unsigned int *));
+        vector_append(&table->retired, pending->changed_rows);
+        pending->changed_rows = segments;
+    }
+
+    table->segments_capacity = capacity;
+}
+
+static void table_deleted_rows_alloc(Table *table) {
+    TableVersion *pending = table->pending;
+
+    pending->deleted_rows = malloc(table->segments_capacity * sizeof(bool *));
+    for (unsigned int s = 0; s < segments_count(pending->values_count); s++) {
+        pending->deleted_rows[s] = calloc(COLUMN_SEGMENT_SIZE, sizeof(bool));
+    }
+}
+
+static void table_changed_rows_alloc(Table *table) {
+    TableVersion *pending = table->pending;
+
+    pending->changed_rows = malloc(table->segments_capacity * sizeof(unsigned int *));
+    for (unsigned int s = 0; s < segments_count(pending->values_count); s++) {
+        pending->changed_rows[s] = calloc(COLUMN_SEGMENT_SIZE, sizeof(unsigned int));
+    }
+}
+
+// Logs a change to the row at position of the table being written, so that readers of the
+// indexes holding the row take it from the table instead. Rows that no index holds and rows
+// already logged by the same write are skipped.
+static void table_row_change(Table *table, unsigned int position) {
+    if (position >= table->indexed_count) {
+        return;
+    }
+
+    TableVersion *pending = table->pending;
+    if (pending->changed_rows == NULL) {
+        table_changed_rows_alloc(table);
+    } else if (pending->changed_rows[position >> COLUMN_SEGMENT_BITS]
+            [position & COLUMN_SEGMENT_MASK] > table->changes_logged) {
+        return;
+    }
+
+    // Changes are appended in place past those published, the log is only copied to grow.
+    unsigned int count = pending->changes_count - pending->changes_start;
+    if (count == table->changes_capacity) {
+        unsigned int capacity = count > 0 ? count * 2 : TABLE_CHANGES_INITIAL_CAPACITY;
+        unsigned int *changes = malloc(capacity * sizeof(unsigned int));
+        if (pending->changes != NULL) {
+            memcpy(changes, pending->changes, count * sizeof(unsigned int));
+            vector_append(&table->retired, pending->changes);
+        }
+        pending->changes = changes;
+        table->changes_capacity = capacity;
+    }
+
+    pending->changes[count] = position;
+    pending->changes_count++;
+    changed_segment_write(table, position)[position & COLUMN_SEGMENT_MASK] =
+            pending->changes_count;
+}
+
+unsigned int table_rows_append(Table *table, unsigned int count) {
+    TableVersion *pending = table->pending;
+    unsigned int start = pending->values_count;
+    unsigned int end = start + count;
+    unsigned int first = segments_count(start);
+    unsigned int last = segments_count(end);
+
+    table_segments_reserve(table, last);
+
+    // Slots past the end of the published version are written in place, no reader looks at them.
+    for (unsigned int c = 0; c < table->columns_capacity; c++) {
+        for (unsigned int s = first; s < last; s++) {
+            pending->columns[c][s] = malloc(COLUMN_SEGMENT_SIZE * sizeof(int));
+        }
+    }
+
+    if (pending->deleted_rows != NULL) {
+        for (unsigned int p = start; p < end && p < first << COLUMN_SEGMENT_BITS; p++) {
+            pending->deleted_rows[p >> COLUMN_SEGMENT_BITS][p & COLUMN_SEGMENT_MASK] = false;
+        }
+        for (unsigned int s = first; s < last; s++) {
+            pending->deleted_rows[s] = calloc(COLUMN_SEGMENT_SIZE, sizeof(bool));
+        }
+    }
+
+    if (pending->changed_rows != NULL) {
+        for (unsigned int s = first; s < last; s++) {
+            pending->changed_rows[s] = calloc(COLUMN_SEGMENT_SIZE, sizeof(unsigned int));
+        }
+    }
+
+    pending->values_count = end;
+    pending->rows_count += count;
+
+    return start;
+}
+
+// Gives the pending version a segment array of its own, if it shares the one of the published
+// version.
+static void *segments_unshare(Table *table, void *segments, void *published, size_t size) {
+    if (segments != published) {
+        return segments;
+    }
+
+    void *copy = malloc(table->segments_capacity * size);
+    memcpy(copy, published, segments_count(table->pending->values_count) * size);
+    vector_append(&table->retired, published);
+    return copy;
+}
+
+void table_rows_truncate(Table *table, unsigned int count) {
+    TableVersion *pending = table->pending;
+    TableVersion *version = table->version;
+    unsigned int first = segments_count(count);
+    unsigned int last = segments_count(pending->values_count);
+
+    // Rows past the end are appended in place, so nothing published may be shared past count.
+    bool partial = (count & COLUMN_SEGMENT_MASK) != 0 && count < version->values_count;
+
+    for (unsigned int c = 0; c < table->columns_capacity; c++) {
+        if (partial) {
+            column_segment_write(table, c, count - 1, false);
+        }
+
+        int **segments = pending->columns[c] = segments_unshare(table, pending->columns[c],
+                version->columns[c], sizeof(int *));
+        for (unsigned int s = first; s < last; s++) {
+            vector_append(&table->retired, segments[s]);
+        }
+    }
+
+    if (pending->deleted_rows != NULL) {
+        if (partial) {
+            deleted_segment_write(table, count - 1);
+        }
+
+        bool **segments = pending->deleted_rows = segments_unshare(table, pending->deleted_rows,
+                version->deleted_rows, sizeof(bool *));
+        for (unsigned int s = first; s < last; s++) {
+            vector_append(&table->retired, segments[s]);
+        }
+    }
+
+    if (pending->changed_rows != NULL) {
+        if (partial) {
+            changed_segment_write(table, count - 1);
+        }
+
+        unsigned int **segments = pending->changed_rows = segments_unshare(table,
+                pending->changed_rows, version->changed_rows, sizeof(unsigned int *));
+        for (unsigned int s = first; s < last; s++) {
+            vector_append(&table->retired, segments[s]);
+        }
+    }
+
+    pending->values_count = count;
+
+    if (table->clustered_count > count) {
+        table->clustered_count = count;
+    }
+}
+
+bool table_row_deleted(Table *table, unsigned int position) {
+    bool **deleted_rows = table_write_version(table)->deleted_rows;
+    return deleted_rows != NULL
+            && deleted_rows[position >> COLUMN_SEGMENT_BITS][position & COLUMN_SEGMENT_MASK];
+}
+
+void table_row_delete(Table *table, unsigned int position) {
+    if (table->pending->deleted_rows == NULL) {
+        table_deleted_rows_alloc(table);
+    }
+
+    deleted_segment_write(table, position)[position & COLUMN_SEGMENT_MASK] = true;
+    table->pending->rows_count--;
+    table_row_change(table, position);
+}
+
+void table_row_restore(Table *table, unsigned int position) {
+    deleted_segment_write(table, position)[position & COLUMN_SEGMENT_MASK] = false;
+    table->pending->rows_count++;
+    table_row_change(table, position);
+}
+
+int column_value(Column *column, unsigned int position) {
+    int **segments = table_write_version(column->table)->columns[column->order];
+    return segments[position >> COLUMN_SEGMENT_BITS][position & COLUMN_SEGMENT_MASK];
+}
+
+void column_value_set(Column *column, unsigned int position, int value) {
+    int *segment = column_segment_write(column->table, column->order, position, false);
+    segment[position & COLUMN_SEGMENT_MASK] = value;
+    table_row_change(column->table, position);
+}
+
+void column_values_set(Column *column, unsigned int start, int *values, unsigned int count) {
+    Table *table = column->table;
+    unsigned int values_count = table->pending->values_count;
+
+    for (unsigned int position = start, end = start + count; position < end;) {
+        unsigned int offset = position & COLUMN_SEGMENT_MASK;
+        unsigned int segment_end = position - offset + COLUMN_SEGMENT_SIZE;
+        unsigned int n = (end < segment_end ? end : segment_end) - position;
+
+        bool overwrite = offset == 0
+                && position + n >= (values_count < segment_end ? values_count : segment_end);
+        int *segment = column_segment_write(table, column->order, position, overwrite);
+        memcpy(segment + offset, values + (position - start), n * sizeof(int));
+
+        position += n;
+    }
+
+    for (unsigned int position = start, end = start + count;
+            position < end && position < table->indexed_count; position++) {
+        table_row_change(table, position);
+    }
+}
+
+// Copies count values of a column in a version, from position start on.
+static void column_values_copy(TableVersion *version, unsigned int order, unsigned int start,
+        unsigned int count, int *dst) {
+    int **segments = version->columns[order];
+
+    for (unsigned int position = start, end = start + count; position < end;) {
+        unsigned int offset = position & COLUMN_SEGMENT_MASK;
+        unsigned int segment_end = position - offset + COLUMN_SEGMENT_SIZE;
+        unsigned int n = (end < segment_end ? end : segment_end) - position;
+
+        memcpy(dst + (position - start), segments[position >> COLUMN_SEGMENT_BITS] + offset,
+                n * sizeof(int));
+
+        position += n;
+    }
+}
+
+static inline unsigned int filter_removed(int *values, bool *deleted_rows, unsigned int count,
+        unsigned int offset, int *dst_values, unsigned int *dst_positions,
+        unsigned int dst_count) {
+    unsigned int j = 0;
+    for (unsigned int i = 0; i < count && j < dst_count; i++) {
+        dst_values[j] = values[i];
+        dst_positions[j] = offset + i;
+        j += !deleted_rows[i];
+    }
+    return j;
+}
+
+// Copies the values of the live rows of a column in a version to values, and their positions to
+// positions if rows are deleted. Returns whether positions were written, they are the identity
+// otherwise.
+static bool index_snapshot(Column *column, TableVersion *version, int *values,
+        unsigned int *positions) {
+    if (version->rows_count == version->values_count) {
+        column_values_copy(version, column->order, 0, version->values_count, values);
+        return false;
+    }
+
+    int **segments = version->columns[column->order];
+    unsigned int j = 0;
+    for (unsigned int s = 0; s < segments_count(version->values_count); s++) {
+        unsigned int offset = s << COLUMN_SEGMENT_BITS;
+        unsigned int count = version->values_count - offset < COLUMN_SEGMENT_SIZE
+                ? version->values_count - offset : COLUMN_SEGMENT_SIZE;
+        j += filter_removed(segments[s], version->deleted_rows[s], count, offset, values + j,
+                positions + j, version->rows_count - j);
+    }
+    return true;
+}
+
+// Sorts a snapshot in place and builds the index from it. The sort returns early on sorted input,
+// so clustered columns are not sorted again.
+static void index_init_snapshot(ColumnIndex *index, int *values, unsigned int *positions,
+        bool has_positions, unsigned int rows_count) {
+    if (rows_count == 0) {
+        switch (index->type) {
+        case BTREE:
+            btree_init(&index->fields.btree, NULL, NULL, 0);
+            break;
+        case SORTED:
+            sorted_init(&index->fields.sorted, NULL, NULL, 0);
+            break;
+        case LEARNED:
+            learned_init(&index->fields.learned, NULL, NULL, 0);
+            break;
+        case HASHED:
+            hash_index_init(&index->fields.hash, NULL, NULL, 0);
+            break;
+        }
+        return;
+    }
+
+    radix_sort_indices(values, has_positions ? positions : NULL, values, positions, rows_count);
+
+    switch (index->type) {
+    case BTREE:
+        btree_init(&index->fields.btree, values, positions, rows_count);
+        break;
+    case SORTED:
+        sorted_init(&index->fields.sorted, values, positions, rows_count);
+        break;
+    case LEARNED:
+        learned_init(&index->fields.learned, values, positions, rows_count);
+        break;
+    case HASHED:
+        hash_index_init(&index->fields.hash, values, positions, rows_count);
+        break;
+    }
+}
+
+// Builds an index from the rows of a version, which must outlive the call.
+static void index_init(ColumnIndex *index, TableVersion *version) {
+    unsigned int rows_count = version->rows_count;
+
+    int *values = malloc(rows_count * sizeof(int));
+    unsigned int *positions = malloc(rows_count * sizeof(unsigned int));
+
+    bool has_positions = rows_count > 0
+            && index_snapshot(index->column, version, values, positions);
+    index_init_snapshot(index, values, positions, has_positions, rows_count);
+    index->rows_count = rows_count;
+    index->indexed_count = version->values_count;
+    index->changes_count = version->changes_count;
+
+    free(values);
+    free(positions);
+}
+
+static void index_destroy(ColumnIndex *index) {
+    switch (index->type) {
+    case BTREE:
+        btree_destroy(&index->fields.btree);
+        break;
+    case SORTED:
+        sorted_destroy(&index->fields.sorted);
+        break;
+    case LEARNED:
+        learned_destroy(&index->fields.learned);
+        break;
+    case HASHED:
+        hash_index_destroy(&index->fields.hash);
+        break;
+    }
+}
+
+// Sorts the rows of the table being written from start onwards by the clustered column and
+// merges them into the rows before start, which are in clustered order. Returns the position of
+// the first row that moved, or the number of rows if none did.
+static unsigned int table_cluster(Table *table, ColumnIndex *index, unsigned int start) {
+    TableVersion *version = table->pending;
+    unsigned int size = version->values_count;
+    unsigned int count = size - start;
+    if (count == 0) {
+        return size;
+    }
+
+    int *values = malloc(count * sizeof(int));
+    unsigned int *order = malloc(count * sizeof(unsigned int));
+    column_values_copy(version, index->column->order, start, count, values);
+    radix_sort_indices(values, NULL, values, order, count);
+
+    // Sorted row k goes after the first before[k] rows.
+    unsigned int *before = malloc(count * sizeof(unsigned int));
+    unsigned int i = 0;
+    for (unsigned int k = 0; k < count; k++) {
+        while (i < start && column_value(index->column, i) <= values[k]) {
+            i++;
+        }
+        before[k] = i;
+    }
+
+    unsigned int moved = before[0];
+    if (moved == start) {
+        unsigned int k = 0;
+        while (k < count && order[k] == k) {
+            k++;
+        }
+        moved = start + k;
+    }
+
+    if (moved < size) {
+        // Positions selected before may now refer to other rows.
+        if (moved < table->version->values_count) {
+            version->moves++;
+        }
 
-    table->columns_count++;
-    hash_table_put(&db_manager_table, column_fqn, column);
+        // Position each row comes from, for every position from the first merged row onwards.
+        unsigned int first = before[0];
+        unsigned int *sources = malloc((size - first) * sizeof(unsigned int));
+        unsigned int j = 0;
+        unsigned int l = first;
+        for (unsigned int k = 0; k < count; k++) {
+            while (l < before[k]) {
+                sources[j++] = l++;
+            }
+            sources[j++] = start + order[k];
+        }
+        while (l < start) {
+            sources[j++] = l++;
+        }
 
-    pthread_mutex_unlock(&db_manager_table_mutex);
+        // Moved rows are written to new segments, readers keep scanning the old ones.
+        unsigned int moved_count = size - moved;
+        unsigned int *moved_sources = sources + (moved - first);
+        int *moved_values = malloc(moved_count * sizeof(int));
+        for (unsigned int c = 0; c < table->columns_count; c++) {
+            Column *column = table->columns + c;
+            for (unsigned int k = 0; k < moved_count; k++) {
+                moved_values[k] = column_value(column, moved_sources[k]);
+            }
+            column_values_set(column, moved, moved_values, moved_count);
+        }
+        free(moved_values);
 
-    free(column_fqn);
-}
+        if (version->deleted_rows != NULL) {
+            bool *moved_deleted = malloc(moved_count * sizeof(bool));
+            for (unsigned int k = 0; k < moved_count; k++) {
+                moved_deleted[k] = table_row_deleted(table, moved_sources[k]);
+            }
+            for (unsigned int k = 0; k < moved_count; k++) {
+                unsigned int p = moved + k;
+                deleted_segment_write(table, p)[p & COLUMN_SEGMENT_MASK] = moved_deleted[k];
+            }
+            free(moved_deleted);
+
+            // Deleted rows have moved along with the others, so their free slots are collected
+            // again.
+            queue_destroy(&table->delete_queue);
+            queue_init(&table->delete_queue);
+            for (unsigned int p = 0; p < size; p++) {
+                if (table_row_deleted(table, p)) {
+                    queue_push(&table->delete_queue, p);
+                }
+            }
+        }
 
-static inline void filter_removed(int *values, bool *deleted_rows, unsigned int values_count,
-        int *dst_values, unsigned int *dst_positions, unsigned int rows_count) {
-    unsigned int j = 0;
-    for (unsigned int i = 0; i < values_count && j < rows_count; i++) {
-        dst_values[j] = values[i];
-        dst_positions[j] = i;
-        j += !deleted_rows[i];
+        free(sources);
     }
-}
 
-static void index_init(ColumnIndex *index) {
-    Column *column = index->column;
-    Table *table = column->table;
+    table->clustered_count = size;
 
-    unsigned int rows_count = table->rows_count;
+    free(values);
+    free(order);
+    free(before);
 
-    if (index->clustered) {
-        unsigned int num_columns = table->columns_capacity;
+    return moved;
+}
 
-        index->clustered_positions = malloc(sizeof(PosVector));
-        index->clustered_columns = malloc(num_columns * sizeof(IntVector));
-        index->num_columns = num_columns;
+ColumnIndex *table_clustered_index(Table *table) {
+    for (unsigned int i = 0; i < table->columns_count; i++) {
+        ColumnIndex *index = table->columns[i].index;
+        if (index != NULL && index->clustered) {
+            return index;
+        }
+    }
+    return NULL;
+}
 
-        if (rows_count == 0) {
-            pos_vector_init(index->clustered_positions, 0);
+static inline ColumnIndex *index_alloc(Column *column, ColumnIndexType type, bool clustered) {
+    ColumnIndex *index = malloc(sizeof(ColumnIndex));
+    index->type = type;
+    index->clustered = clustered;
+    index->rows_count = 0;
+    index->indexed_count = 0;
+    index->changes_count = 0;
+    index->column = column;
+    return index;
+}
 
-            for (unsigned int i = 0; i < num_columns; i++) {
-                int_vector_init(index->clustered_columns + i, 0);
-            }
+// Makes index the index of its column in the version being written. The index it replaces is
+// freed once no reader can probe it anymore.
+static void index_publish(Table *table, ColumnIndex *index) {
+    TableVersion *pending = table->pending;
+    unsigned int order = index->column->order;
 
-            switch (index->type) {
-            case BTREE:
-                btree_init(&index->fields.btree, NULL, NULL, 0);
-                break;
-            case SORTED:
-                sorted_init(&index->fields.sorted, NULL, NULL, 0);
-                break;
-            }
-        } else {
-            IntVector *leading_values_vector = index->clustered_columns + column->order;
-            int_vector_init(leading_values_vector, rows_count);
-            int *leading_values = leading_values_vector->data;
+    if (pending->indexes[order] != NULL) {
+        vector_append(&table->retired_indexes, pending->indexes[order]);
+    }
+    pending->indexes[order] = index;
 
-            PosVector *positions_vector = index->clustered_positions;
-            pos_vector_init(positions_vector, rows_count);
-            unsigned int *sorted_positions = positions_vector->data;
+    if (table->indexed_count < index->indexed_count) {
+        table->indexed_count = index->indexed_count;
+    }
+}
 
-            bool *deleted_rows = table->deleted_rows != NULL ? table->deleted_rows->data : NULL;
-            if (deleted_rows == NULL) {
-                radix_sort_indices(column->values.data, NULL, leading_values, sorted_positions, rows_count);
-            } else {
-                filter_removed(column->values.data, deleted_rows, column->values.size, leading_values, sorted_positions, rows_count);
+// Returns whether an index misses rows or changes of a version.
+static inline bool index_stale(ColumnIndex *index, TableVersion *version) {
+    return index->indexed_count != version->values_count
+            || index->changes_count != version->changes_count;
+}
 
-                radix_sort_indices(leading_values, sorted_positions, leading_values, sorted_positions, rows_count);
-            }
+typedef struct IndexRebuildArgs {
+    ColumnIndex *index;
+    TableVersion *version;
+    ColumnIndex *rebuilt;
+} IndexRebuildArgs;
 
+static void *index_rebuild_routine(void *data) {
+    IndexRebuildArgs *args = data;
+    args->rebuilt = index_alloc(args->index->column, args->index->type, args->index->clustered);
+    index_init(args->rebuilt, args->version);
+    return NULL;
+}
 
-            leading_values_vector->size = rows_count;
-            positions_vector->size = rows_count;
+void table_delta_merge(Table *table, bool cluster) {
+    ColumnIndex *clustered_index = table_clustered_index(table);
+    if (cluster && clustered_index != NULL) {
+        table_cluster(table, clustered_index, table->clustered_count);
+    }
 
-            for (unsigned int i = 0; i < num_columns; i++) {
-                if (i != column->order) {
-                    IntVector *values_vector = index->clustered_columns + i;
-                    int_vector_init(values_vector, rows_count);
+    TableVersion *pending = table->pending;
+    IndexRebuildArgs args[table->columns_count];
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < table->columns_count; i++) {
+        ColumnIndex *index = pending->indexes[i];
+        if (index != NULL && index_stale(index, pending)) {
+            args[count].index = index;
+            args[count].version = pending;
+            count++;
+        }
+    }
 
-                    int *sorted_values = values_vector->data;
-                    int *unsorted_values = table->columns[i].values.data;
+    thread_pool_run(&index_rebuild_routine, args, sizeof(IndexRebuildArgs), count);
 
-                    for (unsigned int j = 0; j < rows_count; j++) {
-                        sorted_values[j] = unsorted_values[sorted_positions[j]];
-                    }
+    for (unsigned int i = 0; i < count; i++) {
+        index_publish(table, args[i].rebuilt);
+    }
 
-                    values_vector->size = rows_count;
-                }
-            }
+    // The rebuilt indexes hold every change so far, later ones are logged anew.
+    table->changes_logged = pending->changes_count;
+}
 
-            switch (index->type) {
-            case BTREE:
-                btree_init(&index->fields.btree, leading_values, NULL, rows_count);
-                break;
-            case SORTED:
-                sorted_init(&index->fields.sorted, leading_values, NULL, rows_count);
-                break;
-            }
-        }
-    } else {
-        index->clustered_positions = NULL;
-        index->clustered_columns = NULL;
-        index->num_columns = 0;
-
-        if (rows_count == 0) {
-            switch (index->type) {
-            case BTREE:
-                btree_init(&index->fields.btree, NULL, NULL, 0);
-                break;
-            case SORTED:
-                sorted_init(&index->fields.sorted, NULL, NULL, 0);
-                break;
-            }
-        } else {
-            int *values = malloc(rows_count * sizeof(int));
-            unsigned int *positions = malloc(rows_count * sizeof(unsigned int));
+// Creating a clustered index reorders the whole table, so it holds the write lock throughout.
+static void index_create_clustered(Column *column, ColumnIndexType type,
+        Message *send_message) {
+    Table *table = column->table;
 
-            bool *deleted_rows = table->deleted_rows != NULL ? table->deleted_rows->data : NULL;
-            if (deleted_rows == NULL) {
-                radix_sort_indices(column->values.data, NULL, values, positions, rows_count);
-            } else {
-                filter_removed(column->values.data, deleted_rows, column->values.size, values, positions, rows_count);
+    pthread_rwlock_wrlock(&table->rwlock);
 
-                radix_sort_indices(values, positions, values, positions, rows_count);
-            }
+    if (column->index != NULL || column->index_build != NULL) {
+        send_message->status = INDEX_ALREADY_EXISTS;
+        pthread_rwlock_unlock(&table->rwlock);
+        return;
+    }
 
-            radix_sort_indices(column->values.data, NULL, values, positions, rows_count);
+    if (table_clustered_index(table) != NULL) {
+        send_message->status = CLUSTERED_INDEX_ALREADY_EXISTS;
+        pthread_rwlock_unlock(&table->rwlock);
+        return;
+    }
 
-            switch (index->type) {
-            case BTREE:
-                btree_init(&index->fields.btree, values, positions, rows_count);
-                break;
-            case SORTED:
-                sorted_init(&index->fields.sorted, values, positions, rows_count);
-                break;
-            }
+    ColumnIndex *index = index_alloc(column, type, true);
 
-            free(values);
-            free(positions);
-        }
-    }
-}
+    table_write_begin(table);
 
-static void index_destroy(ColumnIndex *index) {
-    switch (index->type) {
-    case BTREE:
-        btree_destroy(&index->fields.btree);
-        break;
-    case SORTED:
-        sorted_destroy(&index->fields.sorted);
-        break;
-    }
+    // Sort the whole table, then rebuild the existing indexes for the new row positions.
+    table_cluster(table, index, 0);
+    index_init(index, table->pending);
+    index_publish(table, index);
+    table_delta_merge(table, false);
 
-    if (index->clustered) {
-        if (index->clustered_positions != NULL) {
-            pos_vector_destroy(index->clustered_positions);
-            free(index->clustered_positions);
-        }
+    table_write_commit(table);
 
-        if (index->clustered_columns != NULL) {
-            for (unsigned int i = 0; i < index->num_columns; i++) {
-                int_vector_destroy(index->clustered_columns + i);
-            }
-            free(index->clustered_columns);
-        }
-    }
+    pthread_rwlock_unlock(&table->rwlock);
 }
 
+// Unclustered indexes are built from the version of the table published when the build started,
+// without blocking writers. Writes made meanwhile stay logged until the index is published, and
+// readers take the rows they changed from the table like for any other index.
 void index_create(char *column_fqn, ColumnIndexType type, bool clustered, Message *send_message) {
     Column *column = column_lookup(column_fqn);
     if (column == NULL) {
@@ -353,86 +1419,183 @@ void index_create(char *column_fqn, ColumnIndexType type, bool clustered, Messag
         return;
     }
 
+    if (clustered) {
+        index_create_clustered(column, type, send_message);
+        return;
+    }
+
     Table *table = column->table;
 
     pthread_rwlock_wrlock(&table->rwlock);
 
-    if (column->index != NULL) {
+    if (column->index != NULL || column->index_build != NULL) {
         send_message->status = INDEX_ALREADY_EXISTS;
         pthread_rwlock_unlock(&table->rwlock);
         return;
     }
 
-    ColumnIndex *index = malloc(sizeof(ColumnIndex));
-    index->type = type;
-    index->clustered = clustered;
-    index->column = column;
+    epoch_enter();
+    TableVersion *version = table->version;
+
+    // Every write after this version changes rows the index holds, so they are all logged.
+    IndexBuild *build = malloc(sizeof(IndexBuild));
+    build->changes_count = version->changes_count;
+    __atomic_store_n(&column->index_build, build, __ATOMIC_RELEASE);
+    if (table->indexed_count < version->values_count) {
+        table->indexed_count = version->values_count;
+    }
+
+    pthread_rwlock_unlock(&table->rwlock);
+
+    ColumnIndex *index = index_alloc(column, type, false);
+    index_init(index, version);
 
-    index_init(index);
+    epoch_exit();
+
+    pthread_rwlock_wrlock(&table->rwlock);
 
-    column->index = index;
+    table_write_begin(table);
+    index_publish(table, index);
+    column->index_build = NULL;
+    table_write_commit(table);
 
     pthread_rwlock_unlock(&table->rwlock);
-}
 
-void index_rebuild(ColumnIndex *index) {
-    index_destroy(index);
-    index_init(index);
+    free(build);
 }
 
-static void *index_rebuild_routine(void *data) {
-    ColumnIndex *index = data;
-    index_rebuild(index);
-    return NULL;
-}
+// Rebuilds the indexes of a table that miss many rows or changes, from the version published
+// without any lock, so that neither writers nor readers wait for it. The rebuilt indexes are then
+// published unless the ones they replace were rebuilt meanwhile.
+static void table_delta_flush(Table *table) {
+    epoch_enter();
+    TableVersion *version = __atomic_load_n(&table->version, __ATOMIC_SEQ_CST);
+
+    IndexRebuildArgs args[table->columns_capacity];
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < table->columns_capacity; i++) {
+        ColumnIndex *index = version->indexes[i];
+        if (index == NULL || !index_stale(index, version)) {
+            continue;
+        }
 
-void index_rebuild_all(Table *table) {
-    ColumnIndex *indices[table->columns_count];
-    unsigned int indices_count = 0;
-    for (unsigned int i = 0; i < table->columns_count; i++) {
-        ColumnIndex *index = table->columns[i].index;
-        if (index != NULL) {
-            indices[indices_count++] = index;
+        unsigned int appended = version->values_count > index->indexed_count
+                ? version->values_count - index->indexed_count
+                : index->indexed_count - version->values_count;
+        unsigned long delta = version->changes_count - index->changes_count + appended;
+        if (delta * DELTA_MERGE_RATIO >= index->rows_count) {
+            args[count].index = index;
+            args[count].version = version;
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        epoch_exit();
+        return;
+    }
+
+    thread_pool_run(&index_rebuild_routine, args, sizeof(IndexRebuildArgs), count);
+
+    pthread_rwlock_wrlock(&table->rwlock);
+    table_write_begin(table);
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (table->pending->indexes[args[i].index->column->order] == args[i].index) {
+            index_publish(table, args[i].rebuilt);
+        } else {
+            index_free(args[i].rebuilt);
         }
     }
 
-    if (indices_count == 1) {
-        index_rebuild(indices[0]);
-    } else if (indices_count > 1){
-        pthread_t threads[indices_count];
+    table_write_commit(table);
+    pthread_rwlock_unlock(&table->rwlock);
+
+    epoch_exit();
+}
+
+// Rebuilds the indexes of every table in the background, so that readers usually find few rows
+// missing from them.
+static void *delta_merge_routine(void *data) {
+    (void) data;
+
+    Vector tables;
+    vector_init(&tables, 0);
+
+    pthread_mutex_lock(&delta_merge_mutex);
+    while (!delta_merge_stopped) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += DELTA_MERGE_INTERVAL_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&delta_merge_cond, &delta_merge_mutex, &deadline);
+
+        if (delta_merge_stopped) {
+            break;
+        }
+
+        pthread_mutex_unlock(&delta_merge_mutex);
 
-        for (unsigned int i = 0; i < indices_count; i++) {
-            if (pthread_create(threads + i, NULL, &index_rebuild_routine, indices[i]) != 0) {
-                log_err("Unable to spawn index rebuild worker thread.");
-                exit(1);
+        pthread_mutex_lock(&db_manager_table_mutex);
+        for (Db *db = db_manager_dbs; db != NULL; db = db->next) {
+            for (Table *table = db->tables; table != NULL; table = table->next) {
+                vector_append(&tables, table);
             }
         }
+        pthread_mutex_unlock(&db_manager_table_mutex);
 
-        for (unsigned int i = 0; i < indices_count; i++) {
-            pthread_join(threads[i], NULL);
+        for (unsigned int i = 0; i < tables.size; i++) {
+            table_delta_flush(tables.data[i]);
         }
+        tables.size = 0;
+
+        pthread_mutex_lock(&delta_merge_mutex);
     }
+    pthread_mutex_unlock(&delta_merge_mutex);
+
+    vector_destroy(&tables, NULL);
+    return NULL;
+}
+
+// Dbs, tables and columns are only freed on shutdown, so they outlive the catalog they were found
+// in.
+static inline void *catalog_lookup(char *name) {
+    epoch_enter();
+    HashTable *catalog = __atomic_load_n(&db_manager_table, __ATOMIC_SEQ_CST);
+    void *value = hash_table_get(catalog, name);
+    epoch_exit();
+    return value;
+}
+
+static void catalog_free(void *data) {
+    hash_table_destroy(data, NULL);
+    free(data);
+}
+
+// Returns a copy of the catalog for DDL to change. Called with the mutex held.
+static inline HashTable *catalog_copy() {
+    HashTable *catalog = malloc(sizeof(HashTable));
+    hash_table_copy(catalog, db_manager_table);
+    return catalog;
+}
+
+static inline void catalog_publish(HashTable *catalog) {
+    HashTable *replaced = db_manager_table;
+    __atomic_store_n(&db_manager_table, catalog, __ATOMIC_SEQ_CST);
+    epoch_retire(replaced, &catalog_free);
 }
 
 Db *db_lookup(char *db_name) {
-    pthread_mutex_lock(&db_manager_table_mutex);
-    Db *db = hash_table_get(&db_manager_table, db_name);
-    pthread_mutex_unlock(&db_manager_table_mutex);
-    return db;
+    return catalog_lookup(db_name);
 }
 
 Table *table_lookup(char *table_fqn) {
-    pthread_mutex_lock(&db_manager_table_mutex);
-    Table *table = hash_table_get(&db_manager_table, table_fqn);
-    pthread_mutex_unlock(&db_manager_table_mutex);
-    return table;
+    return catalog_lookup(table_fqn);
 }
 
 Column *column_lookup(char *column_fqn) {
-    pthread_mutex_lock(&db_manager_table_mutex);
-    Column *column = hash_table_get(&db_manager_table, column_fqn);
-    pthread_mutex_unlock(&db_manager_table_mutex);
-    return column;
+    return catalog_lookup(column_fqn);
 }
 
 static inline void db_free(Db *db) {
@@ -450,18 +1613,19 @@ static inline void table_free(Table *table) {
         column_free(&table->columns[i]);
     }
     free(table->columns);
-    queue_destroy(&table->delete_queue);
-    if (table->deleted_rows != NULL) {
-        bool_vector_destroy(table->deleted_rows);
-        free(table->deleted_rows);
-    }
+    table_version_free(table->version, table->columns_capacity);
     pthread_rwlock_destroy(&table->rwlock);
+    vector_destroy(&table->retired, NULL);
+    vector_destroy(&table->retired_indexes, NULL);
+    queue_destroy(&table->delete_queue);
+    pthread_mutex_destroy(&table->inserts_mutex);
+    pthread_cond_destroy(&table->inserts_cond);
+    vector_destroy(&table->inserts, NULL);
     free(table);
 }
 
 static inline void column_free(Column *column) {
     free(column->name);
-    int_vector_destroy(&column->values);
     if (column->index != NULL) {
         index_free(column->index);
     }
@@ -555,19 +1719,22 @@ static inline bool table_save(Table *table, FILE *file) {
         return false;
     }
 
-    if (fwrite(&table->rows_count, sizeof(table->rows_count), 1, file) != 1) {
+    TableVersion *version = table->version;
+
+    if (fwrite(&version->rows_count, sizeof(version->rows_count), 1, file) != 1) {
         log_err("Unable to write table rows count\n");
         return false;
     }
 
-    bool has_deleted_rows = table->deleted_rows != NULL;
+    bool has_deleted_rows = version->deleted_rows != NULL;
 
     if (fwrite(&has_deleted_rows, sizeof(has_deleted_rows), 1, file) != 1) {
         log_err("Unable to write table has_deleted_rows\n");
         return false;
     }
 
-    if (has_deleted_rows && !bool_vector_save(table->deleted_rows, file)) {
+    if (has_deleted_rows && !deleted_rows_save(version->deleted_rows, version->values_count,
+            file)) {
         log_err("Unable to write table deleted rows\n");
         return false;
     }
@@ -575,6 +1742,23 @@ static inline bool table_save(Table *table, FILE *file) {
     return true;
 }
 
+// Segments are written in the layout of a saved vector.
+static inline bool deleted_rows_save(bool **segments, unsigned int count, FILE *file) {
+    if (fwrite(&count, sizeof(count), 1, file) != 1) {
+        return false;
+    }
+
+    for (unsigned int position = 0; position < count; position += COLUMN_SEGMENT_SIZE) {
+        unsigned int n = count - position < COLUMN_SEGMENT_SIZE ? count - position
+                : COLUMN_SEGMENT_SIZE;
+        if (fwrite(segments[position >> COLUMN_SEGMENT_BITS], sizeof(bool), n, file) != n) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static inline bool column_save(Column *column, FILE *file) {
     unsigned int name_length = strlen(column->name);
     if (fwrite(&name_length, sizeof(name_length), 1, file) != 1) {
@@ -587,7 +1771,7 @@ static inline bool column_save(Column *column, FILE *file) {
         return false;
     }
 
-    if (!int_vector_save(&column->values, file)) {
+    if (!column_values_save(column, file)) {
         log_err("Unable to write column values\n");
         return false;
     }
@@ -606,6 +1790,25 @@ static inline bool column_save(Column *column, FILE *file) {
     return true;
 }
 
+static inline bool column_values_save(Column *column, FILE *file) {
+    TableVersion *version = column->table->version;
+    unsigned int count = version->values_count;
+    if (fwrite(&count, sizeof(count), 1, file) != 1) {
+        return false;
+    }
+
+    int **segments = version->columns[column->order];
+    for (unsigned int position = 0; position < count; position += COLUMN_SEGMENT_SIZE) {
+        unsigned int n = count - position < COLUMN_SEGMENT_SIZE ? count - position
+                : COLUMN_SEGMENT_SIZE;
+        if (fwrite(segments[position >> COLUMN_SEGMENT_BITS], sizeof(int), n, file) != n) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static inline bool index_save(ColumnIndex *index, FILE *file) {
     if (fwrite(&index->type, sizeof(index->type), 1, file) != 1) {
         log_err("Unable to write index type\n");
@@ -628,23 +1831,22 @@ static inline bool index_save(ColumnIndex *index, FILE *file) {
             return false;
         }
         break;
-    }
-
-    if (index->clustered) {
-        if (!pos_vector_save(index->clustered_positions, file)) {
+    case LEARNED:
+        if (!learned_save(&index->fields.learned, file)) {
             return false;
         }
-
-        if (fwrite(&index->num_columns, sizeof(index->num_columns), 1, file) != 1) {
-            log_err("Unable to write index num_columns\n");
+        break;
+    case HASHED:
+        if (!hash_index_save(&index->fields.hash, file)) {
             return false;
         }
+        break;
+    }
 
-        for (unsigned int i = 0; i < index->num_columns; i++) {
-            if (!int_vector_save(index->clustered_columns + i, file)) {
-                return false;
-            }
-        }
+    unsigned int clustered_count = index->column->table->clustered_count;
+    if (index->clustered && fwrite(&clustered_count, sizeof(clustered_count), 1, file) != 1) {
+        log_err("Unable to write index clustered_count\n");
+        return false;
     }
 
     return true;
@@ -734,61 +1936,105 @@ static inline Table *table_load(FILE *file) {
     }
 
     Table *table = malloc(sizeof(Table));
-    table->name = name;
-    table->columns = malloc(columns_capacity * sizeof(Column));
-    table->columns_count = 0;
-    table->columns_capacity = columns_capacity;
-    queue_init(&table->delete_queue);
-    table->deleted_rows = NULL;
-    pthread_rwlock_init(&table->rwlock, NULL);
+    table_init(table, name, columns_capacity);
 
+    // Rows are read first, then appended to the table in a single write.
+    IntVector *values = malloc(columns_count * sizeof(IntVector));
     for (unsigned int i = 0; i < columns_count; i++) {
-        Column *column = &table->columns[i];
-        if (!column_load(column, i, file)) {
-            table_free(table);
-            table = NULL;
-            break;
-        }
+        int_vector_init(values + i, 0);
+    }
 
+    BoolVector deleted_rows;
+    bool_vector_init(&deleted_rows, 0);
+
+    for (unsigned int i = 0; i < columns_count; i++) {
+        Column *column = &table->columns[i];
         column->table = table;
+        if (!column_load(column, i, values + i, file)) {
+            goto ERROR;
+        }
 
         table->columns_count++;
     }
 
     if (!queue_load(&table->delete_queue, file)) {
         log_err("Unable to read table delete queue\n");
-        table_free(table);
-        return false;
+        goto ERROR;
     }
 
-    if (fread(&table->rows_count, sizeof(table->rows_count), 1, file) != 1) {
+    unsigned int rows_count;
+
+    if (fread(&rows_count, sizeof(rows_count), 1, file) != 1) {
         log_err("Unable to read table rows count\n");
-        table_free(table);
-        return false;
+        goto ERROR;
     }
 
     bool has_deleted_rows;
 
     if (fread(&has_deleted_rows, sizeof(has_deleted_rows), 1, file) != 1) {
         log_err("Unable to read table has_deleted_rows\n");
-        table_free(table);
-        return false;
+        goto ERROR;
+    }
+
+    if (has_deleted_rows && !bool_vector_load(&deleted_rows, file)) {
+        log_err("Unable to read table deleted rows\n");
+        goto ERROR;
+    }
+
+    table_write_begin(table);
+
+    if (columns_count > 0) {
+        table_rows_append(table, values[0].size);
+        for (unsigned int i = 0; i < columns_count; i++) {
+            column_values_set(&table->columns[i], 0, values[i].data, values[i].size);
+        }
     }
 
+    TableVersion *pending = table->pending;
     if (has_deleted_rows) {
-        table->deleted_rows = malloc(sizeof(BoolVector));
-        bool_vector_init(table->deleted_rows, 0);
-        if (!bool_vector_load(table->deleted_rows, file)) {
-            log_err("Unable to read table deleted rows\n");
-            table_free(table);
-            return false;
+        table_deleted_rows_alloc(table);
+        for (unsigned int p = 0; p < deleted_rows.size && p < pending->values_count; p++) {
+            pending->deleted_rows[p >> COLUMN_SEGMENT_BITS][p & COLUMN_SEGMENT_MASK] =
+                    deleted_rows.data[p];
+        }
+    }
+    pending->rows_count = rows_count;
+
+    // Indexes are saved holding every row as it is.
+    for (unsigned int i = 0; i < columns_count; i++) {
+        ColumnIndex *index = table->columns[i].index;
+        if (index != NULL) {
+            index->rows_count = rows_count;
+            index->indexed_count = pending->values_count;
+            index->changes_count = 0;
+            index_publish(table, index);
         }
     }
 
+    table_write_commit(table);
+
+    for (unsigned int i = 0; i < columns_count; i++) {
+        int_vector_destroy(values + i);
+    }
+    free(values);
+    bool_vector_destroy(&deleted_rows);
+
     return table;
+
+ERROR:
+    table_free(table);
+
+    for (unsigned int i = 0; i < columns_count; i++) {
+        int_vector_destroy(values + i);
+    }
+    free(values);
+    bool_vector_destroy(&deleted_rows);
+
+    return NULL;
 }
 
-static inline bool column_load(Column *column, unsigned int order, FILE *file) {
+static inline bool column_load(Column *column, unsigned int order, IntVector *values,
+        FILE *file) {
     unsigned int name_length;
     if (fread(&name_length, sizeof(name_length), 1, file) != 1) {
         log_err("Unable to read column name length\n");
@@ -805,10 +2051,10 @@ static inline bool column_load(Column *column, unsigned int order, FILE *file) {
 
     column->name = name;
     column->order = order;
-    int_vector_init(&column->values, 0);
     column->index = NULL;
+    column->index_build = NULL;
 
-    if (!int_vector_load(&column->values, file)) {
+    if (!int_vector_load(values, file)) {
         log_err("Unable to read column values\n");
         column_free(column);
         return false;
@@ -823,7 +2069,7 @@ static inline bool column_load(Column *column, unsigned int order, FILE *file) {
     }
 
     if (has_index) {
-        ColumnIndex *index = index_load(file);
+        ColumnIndex *index = index_load(file, &column->table->clustered_count);
         if (index == NULL) {
             column_free(column);
             return false;
@@ -837,7 +2083,7 @@ static inline bool column_load(Column *column, unsigned int order, FILE *file) {
     return true;
 }
 
-static inline ColumnIndex *index_load(FILE *file) {
+static inline ColumnIndex *index_load(FILE *file, unsigned int *clustered_count_ptr) {
     ColumnIndexType type;
     if (fread(&type, sizeof(type), 1, file) != 1) {
         log_err("Unable to read index type\n");
@@ -862,47 +2108,34 @@ static inline ColumnIndex *index_load(FILE *file) {
             return false;
         }
         break;
+    case LEARNED:
+        if (!learned_load(&fields.learned, file)) {
+            return false;
+        }
+        break;
+    case HASHED:
+        if (!hash_index_load(&fields.hash, file)) {
+            return false;
+        }
+        break;
     }
 
     ColumnIndex *index = malloc(sizeof(ColumnIndex));
     index->type = type;
     index->clustered = clustered;
     index->fields = fields;
-    index->clustered_positions = NULL;
-    index->clustered_columns = NULL;
-    index->num_columns = 0;
-
-    if (clustered) {
-        index->clustered_positions = malloc(sizeof(PosVector));
-        pos_vector_init(index->clustered_positions, 0);
-        if (!pos_vector_load(index->clustered_positions, file)) {
-            index_free(index);
-            return NULL;
-        }
-
-        if (fread(&index->num_columns, sizeof(index->num_columns), 1, file) != 1) {
-            log_err("Unable to read index num_columns\n");
-            index_free(index);
-            return false;
-        }
 
-        index->clustered_columns = malloc(index->num_columns * sizeof(IntVector));
-        for (unsigned int i = 0; i < index->num_columns; i++) {
-            int_vector_init(index->clustered_columns + i, 0);
-        }
-        for (unsigned int i = 0; i < index->num_columns; i++) {
-            if (!int_vector_load(index->clustered_columns + i, file)) {
-                index_free(index);
-                return NULL;
-            }
-        }
+    if (clustered && fread(clustered_count_ptr, sizeof(unsigned int), 1, file) != 1) {
+        log_err("Unable to read index clustered_count\n");
+        index_free(index);
+        return NULL;
     }
 
     return index;
 }
 
 static inline void db_register(Db *db) {
-    hash_table_put(&db_manager_table, db->name, db);
+    hash_table_put(db_manager_table, db->name, db);
 
     for (Table *table = db->tables; table != NULL; table = table->next) {
         table_register(table, db->name);
@@ -912,7 +2145,7 @@ static inline void db_register(Db *db) {
 static inline void table_register(Table *table, char *db_name) {
     char *table_fqn = strjoin(db_name, table->name, '.');
 
-    hash_table_put(&db_manager_table, table_fqn, table);
+    hash_table_put(db_manager_table, table_fqn, table);
 
     for (unsigned int i = 0; i < table->columns_count; i++) {
         column_register(&table->columns[i], table_fqn);
@@ -924,7 +2157,7 @@ static inline void table_register(Table *table, char *db_name) {
 static inline void column_register(Column *column, char *table_fqn) {
     char *column_fqn = strjoin(table_fqn, column->name, '.');
 
-    hash_table_put(&db_manager_table, column_fqn, column);
+    hash_table_put(db_manager_table, column_fqn, column);
 
     free(column_fqn);
 }
@@ -59,11 +59,15 @@ void db_operator_log(DbOperator *query) {
         log_info("RELATIONAL_UPDATE: %s, %s, %d\n", query->fields.relational_update.column_fqn,
                 query->fields.relational_update.pos_var, query->fields.relational_update.value);
         break;
+    case VACUUM:
+        log_info("VACUUM: %s\n", query->fields.vacuum.table_fqn);
+        break;
     case JOIN:
         log_info("JOIN: %d, %s, %s, %s, %s -> %s, %s\n", query->fields.join.type,
                 query->fields.join.val_var1, query->fields.join.pos_var1,
                 query->fields.join.val_var2, query->fields.join.pos_var2,
-                query->fields.join.pos_out_var1, query->fields.join.pos_out_var2);
+                query->fields.join.pos_out_var1,
+                query->fields.join.pos_out_var2 != NULL ? query->fields.join.pos_out_var2 : "");
         break;
     case MIN:
         log_info("MIN: %s(%d) -> %s\n", query->fields.min.col_hdl.name,
@@ -158,7 +162,9 @@ void db_operator_execute(DbOperator *query, Message *message) {
         break;
     case RELATIONAL_INSERT:
         dsl_relational_insert(query->fields.relational_insert.table_fqn,
-                &query->fields.relational_insert.values, message);
+                query->fields.relational_insert.values.data,
+                query->fields.relational_insert.rows_count,
+                query->fields.relational_insert.columns_count, message);
         break;
     case RELATIONAL_DELETE:
         dsl_relational_delete(query->context, query->fields.relational_delete.table_fqn,
@@ -169,10 +175,14 @@ void db_operator_execute(DbOperator *query, Message *message) {
                 query->fields.relational_update.pos_var, query->fields.relational_update.value,
                 message);
         break;
+    case VACUUM:
+        dsl_vacuum(query->fields.vacuum.table_fqn, message);
+        break;
     case JOIN:
         dsl_join(query->context, query->fields.join.type, query->fields.join.val_var1,
                 query->fields.join.pos_var1, query->fields.join.val_var2,
-                query->fields.join.pos_var2, query->fields.join.pos_out_var1,
+                query->fields.join.pos_var2, &query->fields.join.band,
+                query->fields.join.high_var2, query->fields.join.pos_out_var1,
                 query->fields.join.pos_out_var2, message);
         break;
     case MIN:
@@ -274,11 +284,15 @@ void db_operator_free(DbOperator *query) {
         free(query->fields.relational_update.column_fqn);
         free(query->fields.relational_update.pos_var);
         break;
+    case VACUUM:
+        free(query->fields.vacuum.table_fqn);
+        break;
     case JOIN:
         free(query->fields.join.val_var1);
         free(query->fields.join.pos_var1);
         free(query->fields.join.val_var2);
         free(query->fields.join.pos_var2);
+        free(query->fields.join.high_var2);
         free(query->fields.join.pos_out_var1);
         free(query->fields.join.pos_out_var2);
         break;
@@ -8,8 +8,21 @@
 #include "dsl.h"
 #include "join.h"
 #include "queue.h"
+#include "thread_pool.h"
 #include "utils.h"
 
+// Scans of at least this many rows are split into chunks of SELECT_CHUNK_SIZE rows, each selected
+// by a task of its own.
+#define SELECT_PARALLEL_THRESHOLD (1 << 20)
+// Chunks are aligned on column segments.
+#define SELECT_CHUNK_SIZE (4 * COLUMN_SEGMENT_SIZE)
+
+// Tables are vacuumed after a delete once at least VACUUM_THRESHOLD of their rows, and a
+// 1/VACUUM_RATIO of them, are deleted. A vacuum moves up to VACUUM_STEP_ROWS rows per step.
+#define VACUUM_THRESHOLD (1 << 16)
+#define VACUUM_RATIO 2
+#define VACUUM_STEP_ROWS COLUMN_SEGMENT_SIZE
+
 bool shutdown_initiated = false;
 
 void dsl_create_db(char *name, Message *send_message) {
@@ -64,98 +77,83 @@ void dsl_load(unsigned int columns_count, char **col_fqns, IntVector *col_vals,
 
     unsigned int rows_count = col_vals[0].size;
 
-    for (unsigned int i = 0; i < columns_count; i++) {
-        IntVector *dst = &columns[i]->values;
-        IntVector *src = col_vals + i;
+    table_write_begin(table);
 
-        if (dst->size == 0) {
-            int_vector_destroy(dst);
-            int_vector_shallow_copy(dst, src);
-            int_vector_init(src, 0);
-        } else {
-            int_vector_concat(dst, src);
-        }
+    unsigned int start = table_rows_append(table, rows_count);
+    for (unsigned int i = 0; i < columns_count; i++) {
+        column_values_set(columns[i], start, col_vals[i].data, rows_count);
     }
 
-    table->rows_count += rows_count;
+    table_delta_merge(table, true);
 
-    BoolVector *deleted_rows = table->deleted_rows;
-    if (deleted_rows != NULL) {
-        unsigned int new_size = deleted_rows->size + rows_count;
-
-        bool_vector_ensure_capacity(deleted_rows, new_size);
-        memset(deleted_rows->data + deleted_rows->size, 0, rows_count * sizeof(bool));
-        deleted_rows->size = new_size;
-    }
-
-    index_rebuild_all(table);
+    table_write_commit(table);
 
     pthread_rwlock_unlock(&table->rwlock);
 }
 
-static inline unsigned int select_lower(int *values, unsigned int values_count,
-        bool *deleted_rows, int high, unsigned int *result) {
+static inline unsigned int select_lower(int *values, bool *deleted_rows, unsigned int count,
+        unsigned int offset, int high, unsigned int *result) {
     unsigned int result_count = 0;
     if (deleted_rows == NULL) {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             result_count += values[i] < high;
         }
     } else {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             result_count += !deleted_rows[i] & (values[i] < high);
         }
     }
     return result_count;
 }
 
-static inline unsigned int select_higher(int *values, unsigned int values_count,
-        bool *deleted_rows, int low, unsigned int *result) {
+static inline unsigned int select_higher(int *values, bool *deleted_rows, unsigned int count,
+        unsigned int offset, int low, unsigned int *result) {
     unsigned int result_count = 0;
     if (deleted_rows == NULL) {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             result_count += values[i] >= low;
         }
     } else {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             result_count += !deleted_rows[i] & (values[i] >= low);
         }
     }
     return result_count;
 }
 
-static inline unsigned int select_equal(int *values, unsigned int values_count,
-        bool *deleted_rows, int value, unsigned int *result) {
+static inline unsigned int select_equal(int *values, bool *deleted_rows, unsigned int count,
+        unsigned int offset, int value, unsigned int *result) {
     unsigned int result_count = 0;
     if (deleted_rows == NULL) {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             result_count += values[i] == value;
         }
     } else {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             result_count += !deleted_rows[i] & (values[i] == value);
         }
     }
     return result_count;
 }
 
-static inline unsigned int select_range(int *values, unsigned int values_count,
-        bool *deleted_rows, int low, int high, unsigned int *result) {
+static inline unsigned int select_range(int *values, bool *deleted_rows, unsigned int count,
+        unsigned int offset, int low, int high, unsigned int *result) {
     unsigned int result_count = 0;
     if (deleted_rows == NULL) {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             int value = values[i];
             result_count += (value >= low) & (value < high);
         }
     } else {
-        for (unsigned int i = 0; i < values_count; i++) {
-            result[result_count] = i;
+        for (unsigned int i = 0; i < count; i++) {
+            result[result_count] = offset + i;
             int value = values[i];
             result_count += !deleted_rows[i] & (value >= low) & (value < high);
         }
@@ -163,14 +161,91 @@ static inline unsigned int select_range(int *values, unsigned int values_count,
     return result_count;
 }
 
+// Selects the rows read from start to end, which are aligned on segments unless end is the last
+// row.
+static unsigned int select_segments(ColumnReader *reader, unsigned int start, unsigned int end,
+        Comparator *comparator, unsigned int *result) {
+    unsigned int result_count = 0;
+    for (unsigned int offset = start; offset < end; offset += COLUMN_SEGMENT_SIZE) {
+        unsigned int s = offset >> COLUMN_SEGMENT_BITS;
+        int *values = reader->segments[s];
+        bool *deleted_rows = reader->deleted_rows != NULL ? reader->deleted_rows[s] : NULL;
+        unsigned int count = end - offset < COLUMN_SEGMENT_SIZE ? end - offset : COLUMN_SEGMENT_SIZE;
+        unsigned int *segment_result = result + result_count;
+
+        if (!comparator->has_low) {
+            result_count += select_lower(values, deleted_rows, count, offset, comparator->high,
+                    segment_result);
+        } else if (!comparator->has_high) {
+            result_count += select_higher(values, deleted_rows, count, offset, comparator->low,
+                    segment_result);
+        } else if (comparator->low == comparator->high - 1) {
+            result_count += select_equal(values, deleted_rows, count, offset, comparator->low,
+                    segment_result);
+        } else {
+            result_count += select_range(values, deleted_rows, count, offset, comparator->low,
+                    comparator->high, segment_result);
+        }
+    }
+    return result_count;
+}
+
+typedef struct SelectTask {
+    ColumnReader *reader;
+    Comparator *comparator;
+    unsigned int start;
+    unsigned int end;
+    unsigned int *result;
+    unsigned int result_count;
+} SelectTask;
+
+static void *select_routine(void *data) {
+    SelectTask *task = data;
+    task->result_count = select_segments(task->reader, task->start, task->end, task->comparator,
+            task->result + task->start);
+    return NULL;
+}
+
+// Every chunk writes its matches at its own offset in the result, then they are moved together.
+static unsigned int select_scan(ColumnReader *reader, Comparator *comparator,
+        unsigned int *result) {
+    unsigned int values_count = reader->values_count;
+    if (values_count < SELECT_PARALLEL_THRESHOLD || thread_pool_size() == 1) {
+        return select_segments(reader, 0, values_count, comparator, result);
+    }
+
+    unsigned int chunks_count = (values_count + SELECT_CHUNK_SIZE - 1) / SELECT_CHUNK_SIZE;
+    SelectTask *tasks = malloc(chunks_count * sizeof(SelectTask));
+    ThreadPoolGroup group;
+    thread_pool_group_init(&group);
+
+    for (unsigned int c = 0; c < chunks_count; c++) {
+        SelectTask *task = tasks + c;
+        task->reader = reader;
+        task->comparator = comparator;
+        task->start = c * SELECT_CHUNK_SIZE;
+        task->end = c < chunks_count - 1 ? task->start + SELECT_CHUNK_SIZE : values_count;
+        task->result = result;
+        thread_pool_fork(&group, &select_routine, task);
+    }
+
+    thread_pool_join(&group);
+
+    unsigned int result_count = 0;
+    for (unsigned int c = 0; c < chunks_count; c++) {
+        memmove(result + result_count, result + tasks[c].start,
+                tasks[c].result_count * sizeof(unsigned int));
+        result_count += tasks[c].result_count;
+    }
+
+    free(tasks);
+    return result_count;
+}
+
 void dsl_select(ClientContext *client_context, GeneralizedColumnHandle *col_hdl,
         Comparator *comparator, char *pos_out_var, Message *send_message) {
     Column *source;
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     ColumnIndex *index;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
@@ -178,15 +253,17 @@ void dsl_select(ClientContext *client_context, GeneralizedColumnHandle *col_hdl,
             send_message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
         source = column;
-        pthread_rwlock_rdlock(table_rwlock = &table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->delete_queue.size > 0 ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
-        index = column->index;
+        index = __atomic_load_n(&column->index, __ATOMIC_ACQUIRE);
+
+        // Hash indexes only answer equality selects, anything else scans the column.
+        if (index != NULL && index->type == HASHED && !(comparator->has_low
+                && comparator->has_high && comparator->low == comparator->high - 1)) {
+            index = NULL;
+        }
+
+        column_reader_open(&reader, column, index);
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -199,76 +276,36 @@ void dsl_select(ClientContext *client_context, GeneralizedColumnHandle *col_hdl,
         }
 
         source = NULL;
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
         index = NULL;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
+    unsigned int values_count = reader.values_count;
     unsigned int *result = NULL;
     unsigned int result_count = 0;
-    if (rows_count > 0
+    if (reader.rows_count > 0
             && (!comparator->has_low || !comparator->has_high || comparator->low < comparator->high)) {
-        result = malloc(rows_count * sizeof(unsigned int));
-
-        if (index == NULL) {
-            if (!comparator->has_low) {
-                result_count = select_lower(values, values_count, deleted_rows, comparator->high,
-                        result);
-            } else if (!comparator->has_high) {
-                result_count = select_higher(values, values_count, deleted_rows, comparator->low,
-                        result);
-            } else if (comparator->low == comparator->high - 1) {
-                result_count = select_equal(values, values_count, deleted_rows, comparator->low,
-                        result);
-            } else {
-                result_count = select_range(values, values_count, deleted_rows, comparator->low,
-                        comparator->high, result);
-            }
+        result = malloc(values_count * sizeof(unsigned int));
+
+        if (reader.index == NULL) {
+            result_count = select_scan(&reader, comparator, result);
         } else {
-            switch (index->type) {
-            case BTREE:
-                if (!comparator->has_low) {
-                    result_count = btree_select_lower(&index->fields.btree, comparator->high,
-                            result);
-                } else if (!comparator->has_high) {
-                    result_count = btree_select_higher(&index->fields.btree, comparator->low,
-                            result);
-                } else {
-                    result_count = btree_select_range(&index->fields.btree, comparator->low,
-                            comparator->high, result);
-                }
-                break;
-            case SORTED:
-                if (!comparator->has_low) {
-                    result_count = sorted_select_lower(&index->fields.sorted, comparator->high,
-                            result);
-                } else if (!comparator->has_high) {
-                    result_count = sorted_select_higher(&index->fields.sorted, comparator->low,
-                            result);
-                } else {
-                    result_count = sorted_select_range(&index->fields.sorted, comparator->low,
-                            comparator->high, result);
-                }
-                break;
-            }
+            result_count = column_reader_index_select(&reader, comparator->has_low,
+                    comparator->low, comparator->has_high, comparator->high, result);
         }
 
         if (result_count == 0) {
             free(result);
             result = NULL;
-        } else if (result_count < rows_count) {
+        } else if (result_count < values_count) {
             result = realloc(result, result_count * sizeof(unsigned int));
         }
     }
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
-    pos_result_put(client_context, pos_out_var, source, result, result_count);
+    pos_result_put(client_context, pos_out_var, source, reader.moves, result, result_count,
+            reader.index != NULL);
 }
 
 static inline unsigned int select_pos_lower(unsigned int *positions, int *values,
@@ -373,7 +410,27 @@ void dsl_select_pos(ClientContext *client_context, char *pos_var, char *val_var,
         }
     }
 
-    pos_result_put(client_context, pos_out_var, pos->source, result, result_count);
+    pos_result_put(client_context, pos_out_var, pos->source, pos->moves, result, result_count,
+            pos->sorted);
+}
+
+// Checks positions about to be used on rows of table, as of a version with values_count rows and
+// the given count of moves. Positions selected from the table before rows were moved, by a vacuum
+// or by clustering, may refer to other rows since, or lie past the end a vacuum truncated.
+static inline MessageStatus positions_check(Result *pos, Table *table, unsigned int values_count,
+        unsigned int moves) {
+    if (pos->source != NULL && pos->source->table == table && pos->moves != moves) {
+        return POSITIONS_OUT_OF_DATE;
+    }
+
+    unsigned int *positions = pos->values.pos_values;
+    for (unsigned int i = 0; i < pos->num_tuples; i++) {
+        if (positions[i] >= values_count) {
+            return POSITIONS_OUT_OF_RANGE;
+        }
+    }
+
+    return OK;
 }
 
 void dsl_fetch(ClientContext *client_context, char *column_fqn, char *pos_var, char *val_out_var,
@@ -399,168 +456,276 @@ void dsl_fetch(ClientContext *client_context, char *column_fqn, char *pos_var, c
 
     int *result = NULL;
     if (positions_count > 0) {
-        int *values;
-        Column *source = pos->source;
-
-        pthread_rwlock_rdlock(&column->table->rwlock);
-
-        if (source != NULL) {
-            ColumnIndex *source_index = source->index;
-
-            if (source_index != NULL && source_index->clustered) {
-                values = source_index->clustered_columns[column->order].data;
-            } else {
-                values = column->values.data;
-            }
-        } else {
-            values = column->values.data;
+        ColumnReader reader;
+        column_reader_open(&reader, column, NULL);
+
+        MessageStatus status = positions_check(pos, column->table, reader.values_count,
+                reader.moves);
+        if (status != OK) {
+            column_reader_close(&reader);
+            send_message->status = status;
+            return;
         }
 
+        int **segments = reader.segments;
+
         result = malloc(positions_count * sizeof(int));
         for (unsigned int i = 0; i < positions_count; i++) {
-            result[i] = values[positions[i]];
+            unsigned int position = positions[i];
+            result[i] = segments[position >> COLUMN_SEGMENT_BITS][position & COLUMN_SEGMENT_MASK];
         }
 
-        pthread_rwlock_unlock(&column->table->rwlock);
+        column_reader_close(&reader);
     }
 
-    int_result_put(client_context, val_out_var, result, positions_count);
-}
-
-static inline void index_insert(ColumnIndex *index, int value, unsigned int position, int *values) {
-    if (index->clustered) {
-        pos_vector_append(index->clustered_positions, position);
-        position = index->clustered_positions->size - 1;
+    // Positions ordered by their source column yield sorted values when fetching that column,
+    // unless its rows were updated since they were selected.
+    bool sorted = pos->sorted && pos->source == column;
+    for (unsigned int i = 1; sorted && i < positions_count; i++) {
+        sorted = result[i - 1] <= result[i];
+    }
 
-        for (unsigned int j = 0; j < index->num_columns; j++) {
-            int_vector_append(index->clustered_columns + j, values[j]);
-        }
+    int_result_put(client_context, val_out_var, result, positions_count, sorted);
+}
 
+// Shrinks the clustered prefix of the table if the row at position of the clustered column was
+// rewritten out of order.
+static inline void clustered_touch(Column *column, unsigned int position) {
+    Table *table = column->table;
+    unsigned int clustered_count = table->clustered_count;
+    if (position >= clustered_count) {
+        return;
     }
 
-    switch (index->type) {
-    case BTREE:
-        btree_insert(&index->fields.btree, value, position);
-        break;
-    case SORTED:
-        sorted_insert(&index->fields.sorted, value, position);
-        break;
+    int value = column_value(column, position);
+    if ((position > 0 && column_value(column, position - 1) > value)
+            || (position + 1 < clustered_count && column_value(column, position + 1) < value)) {
+        table->clustered_count = position;
     }
 }
 
+// Writes to rows are logged by the table, readers take them from there until the indexes are
+// rebuilt, so the indexes are left as they are.
 static void insert_row(Table *table, int *values) {
-    bool replace;
-    unsigned int insert_position = 0;
+    unsigned int insert_position;
 
     if (table->delete_queue.size > 0) {
-        replace = true;
         insert_position = queue_pop(&table->delete_queue);
+        table_row_restore(table, insert_position);
     } else {
-        replace = false;
+        insert_position = table_rows_append(table, 1);
     }
 
     for (unsigned int i = 0; i < table->columns_capacity; i++) {
         Column *column = table->columns + i;
 
-        int value = values[i];
+        column_value_set(column, insert_position, values[i]);
 
-        if (replace) {
-            column->values.data[insert_position] = value;
-        } else {
-            int_vector_append(&column->values, value);
-            insert_position = column->values.size - 1;
+        ColumnIndex *index = column->index;
+        if (index != NULL && index->clustered) {
+            clustered_touch(column, insert_position);
         }
+    }
+}
 
-        ColumnIndex *index = column->index;
-        if (index != NULL) {
-            index_insert(index, value, insert_position, values);
+// Rows fill the slots of deleted rows first, the others are appended together, one column at a
+// time.
+static void insert_rows(Table *table, int *values, unsigned int rows_count) {
+    unsigned int columns_count = table->columns_capacity;
+
+    unsigned int reused_count = 0;
+    for (; reused_count < rows_count && table->delete_queue.size > 0; reused_count++) {
+        insert_row(table, values + reused_count * columns_count);
+    }
+
+    unsigned int appended_count = rows_count - reused_count;
+    if (appended_count == 0) {
+        return;
+    }
+
+    int *appended = values + reused_count * columns_count;
+    unsigned int start = table_rows_append(table, appended_count);
+
+    int *column_values = malloc(appended_count * sizeof(int));
+    for (unsigned int i = 0; i < columns_count; i++) {
+        for (unsigned int j = 0; j < appended_count; j++) {
+            column_values[j] = appended[j * columns_count + i];
         }
+        column_values_set(table->columns + i, start, column_values, appended_count);
     }
+    free(column_values);
+}
+
+// An insert queued on its table until an inserter holding the write lock commits it.
+typedef struct InsertRequest {
+    int *values;
+    unsigned int rows_count;
+    unsigned int columns_count;
+    MessageStatus status;
+    bool done;
+} InsertRequest;
+
+// Applies the queued inserts under a single write, called with the write lock held.
+static void insert_requests(Table *table, InsertRequest **requests, unsigned int requests_count) {
+    bool writing = false;
 
-    table->rows_count++;
+    for (unsigned int i = 0; i < requests_count; i++) {
+        InsertRequest *request = requests[i];
 
-    BoolVector *deleted_rows = table->deleted_rows;
-    if (replace) {
-        deleted_rows->data[insert_position] = false;
-    } else if (deleted_rows != NULL) {
-        bool_vector_append(deleted_rows, false);
+        if (request->columns_count != table->columns_capacity) {
+            request->status = INSERT_COLUMNS_MISMATCH;
+            continue;
+        }
+        if (table->columns_count != table->columns_capacity) {
+            request->status = TABLE_NOT_FULLY_INITIALIZED;
+            continue;
+        }
+
+        if (!writing) {
+            table_write_begin(table);
+            writing = true;
+        }
+        insert_rows(table, request->values, request->rows_count);
+    }
+
+    if (writing) {
+        table_write_commit(table);
     }
 }
 
-void dsl_relational_insert(char *table_fqn, IntVector *values, Message *send_message) {
+void dsl_relational_insert(char *table_fqn, int *values, unsigned int rows_count,
+        unsigned int columns_count, Message *send_message) {
     Table *table = table_lookup(table_fqn);
     if (table == NULL) {
         send_message->status = TABLE_NOT_FOUND;
         return;
     }
 
-    pthread_rwlock_wrlock(&table->rwlock);
+    InsertRequest request = {values, rows_count, columns_count, OK, false};
 
-    if (values->size != table->columns_capacity) {
-        send_message->status = INSERT_COLUMNS_MISMATCH;
-        pthread_rwlock_unlock(&table->rwlock);
-        return;
+    pthread_mutex_lock(&table->inserts_mutex);
+
+    vector_append(&table->inserts, &request);
+
+    // Wait until another inserter commits the request, or until none is committing so that this
+    // one commits every request queued meanwhile.
+    while (!request.done && table->inserting) {
+        pthread_cond_wait(&table->inserts_cond, &table->inserts_mutex);
     }
-    if (table->columns_count != table->columns_capacity) {
-        send_message->status = TABLE_NOT_FULLY_INITIALIZED;
+
+    if (!request.done) {
+        table->inserting = true;
+
+        Vector requests = table->inserts;
+        vector_init(&table->inserts, 0);
+
+        pthread_mutex_unlock(&table->inserts_mutex);
+
+        pthread_rwlock_wrlock(&table->rwlock);
+        insert_requests(table, (InsertRequest **) requests.data, requests.size);
         pthread_rwlock_unlock(&table->rwlock);
-        return;
-    }
 
-    insert_row(table, values->data);
+        pthread_mutex_lock(&table->inserts_mutex);
 
-    pthread_rwlock_unlock(&table->rwlock);
-}
+        for (unsigned int i = 0; i < requests.size; i++) {
+            ((InsertRequest *) requests.data[i])->done = true;
+        }
+        vector_destroy(&requests, NULL);
+
+        // Inserts queued meanwhile are committed by one of their inserters.
+        table->inserting = false;
+        pthread_cond_broadcast(&table->inserts_cond);
+    }
 
-static inline void index_remove(ColumnIndex *index, int value, unsigned int position) {
-    unsigned int *positions_map = index->clustered ? index->clustered_positions->data : NULL;
+    pthread_mutex_unlock(&table->inserts_mutex);
 
-    switch (index->type) {
-    case BTREE:
-        btree_remove(&index->fields.btree, value, position, positions_map, NULL);
-        break;
-    case SORTED:
-        sorted_remove(&index->fields.sorted, value, position, positions_map, NULL);
-        break;
+    if (request.status != OK) {
+        send_message->status = request.status;
     }
 }
 
 static bool delete_row(Table *table, unsigned int position) {
-    BoolVector *deleted_rows = table->deleted_rows;
-
-    if (deleted_rows != NULL && deleted_rows->data[position]) {
+    if (table_row_deleted(table, position)) {
         return false;
     }
 
+    queue_push(&table->delete_queue, position);
+
+    table_row_delete(table, position);
+
+    return true;
+}
+
+// Moves the last row of the table into the slot of a deleted row before it.
+static void vacuum_move(Table *table, unsigned int from, unsigned int to) {
+    table_row_restore(table, to);
+
     for (unsigned int i = 0; i < table->columns_capacity; i++) {
         Column *column = table->columns + i;
+
+        column_value_set(column, to, column_value(column, from));
+
         ColumnIndex *index = column->index;
-        if (index != NULL) {
-            int value = column->values.data[position];
-            index_remove(index, value, position);
+        if (index != NULL && index->clustered) {
+            clustered_touch(column, to);
         }
     }
 
-    table->rows_count--;
+    table_row_delete(table, from);
+}
 
-    queue_push(&table->delete_queue, position);
+// Fills the slots of deleted rows with rows from the end of the table, moving at most
+// VACUUM_STEP_ROWS rows, and drops the deleted rows left at the end. Returns whether every
+// deleted row is gone.
+static bool vacuum_step(Table *table) {
+    Queue *delete_queue = &table->delete_queue;
+    unsigned int end = table->pending->values_count;
 
-    if (deleted_rows == NULL) {
-        deleted_rows = table->deleted_rows = malloc(sizeof(BoolVector));
+    for (unsigned int moved = 0; moved < VACUUM_STEP_ROWS && delete_queue->size > 0;) {
+        while (end > 0 && table_row_deleted(table, end - 1)) {
+            end--;
+        }
 
-        IntVector *first_column = &table->columns[0].values;
+        unsigned int position = queue_pop(delete_queue);
+        if (position < end) {
+            vacuum_move(table, --end, position);
+            moved++;
+        }
+    }
 
-        unsigned int size = first_column->size;
-        unsigned int capacity = round_up_power_of_two(size);
+    while (end > 0 && table_row_deleted(table, end - 1)) {
+        end--;
+    }
 
-        deleted_rows->data = calloc(capacity, sizeof(bool));
-        deleted_rows->size = size;
-        deleted_rows->capacity = capacity;
+    // Slots dropped from the end are not reused anymore.
+    for (unsigned int i = delete_queue->size; i > 0; i--) {
+        unsigned int position = queue_pop(delete_queue);
+        if (position < end) {
+            queue_push(delete_queue, position);
+        }
     }
 
-    deleted_rows->data[position] = true;
+    // Positions selected before are told apart once rows moved, or slots past the end may be
+    // appended to.
+    if (end < table->pending->values_count) {
+        table->pending->moves++;
+        table_rows_truncate(table, end);
+    }
 
-    return true;
+    return delete_queue->size == 0;
+}
+
+// Squeezes the deleted rows out of the table a step at a time, releasing the lock in between so
+// that other operators are never held up for long. Rows moved change position.
+static void vacuum_table(Table *table) {
+    bool done = false;
+    while (!done) {
+        pthread_rwlock_wrlock(&table->rwlock);
+        table_write_begin(table);
+        done = vacuum_step(table);
+        table_write_commit(table);
+        pthread_rwlock_unlock(&table->rwlock);
+    }
 }
 
 void dsl_relational_delete(ClientContext *client_context, char *table_fqn, char *pos_var,
@@ -596,83 +761,60 @@ void dsl_relational_delete(ClientContext *client_context, char *table_fqn, char
         return;
     }
 
-    Column *source = pos->source;
-    if (source != NULL) {
-        ColumnIndex *source_index = source->index;
+    MessageStatus status = positions_check(pos, table, table->version->values_count,
+            table->version->moves);
+    if (status != OK) {
+        send_message->status = status;
+        pthread_rwlock_unlock(&table->rwlock);
+        return;
+    }
 
-        if (source_index != NULL && source_index->clustered) {
-            unsigned int *clustered_positions = source_index->clustered_positions->data;
-            for (unsigned int i = 0; i < positions_count; i++) {
-                delete_row(table, clustered_positions[positions[i]]);
-            }
-        } else {
-            for (unsigned int i = 0; i < positions_count; i++) {
-                delete_row(table, positions[i]);
-            }
-        }
-    } else {
-        for (unsigned int i = 0; i < positions_count; i++) {
-            delete_row(table, positions[i]);
-        }
+    table_write_begin(table);
+    for (unsigned int i = 0; i < positions_count; i++) {
+        delete_row(table, positions[i]);
     }
+    table_write_commit(table);
+
+    unsigned int deleted_count = table->version->values_count - table->version->rows_count;
+    bool vacuum = deleted_count >= VACUUM_THRESHOLD
+            && (unsigned long) deleted_count * VACUUM_RATIO >= table->version->values_count;
 
     pthread_rwlock_unlock(&table->rwlock);
+
+    if (vacuum) {
+        vacuum_table(table);
+    }
 }
 
-static inline void update(Table *table, Column *column, unsigned int position, int value) {
-    int old_value = column->values.data[position];
-    if (old_value == value) {
+void dsl_vacuum(char *table_fqn, Message *send_message) {
+    Table *table = table_lookup(table_fqn);
+    if (table == NULL) {
+        send_message->status = TABLE_NOT_FOUND;
         return;
     }
 
-    column->values.data[position] = value;
-
-    // Update ColumnIndex (if any) for updated Column.
-    ColumnIndex *index = column->index;
-    if (index != NULL) {
-        index_remove(index, old_value, position);
-
-        if (index->clustered) {
-            int row_values[table->columns_capacity];
-            for (unsigned int i = 0; i < table->columns_capacity; i++) {
-                row_values[i] = table->columns[i].values.data[position];
-            }
+    pthread_rwlock_rdlock(&table->rwlock);
+    bool initialized = table->columns_count == table->columns_capacity;
+    pthread_rwlock_unlock(&table->rwlock);
 
-            index_insert(index, value, position, row_values);
-        } else {
-            index_insert(index, value, position, NULL);
-        }
+    if (!initialized) {
+        send_message->status = TABLE_NOT_FULLY_INITIALIZED;
+        return;
     }
 
-    // Update other clustered indices to reflect the updated value.
-    for (unsigned int i = 0; i < table->columns_capacity; i++) {
-        if (i == column->order) {
-            continue;
-        }
-
-        Column *column = table->columns + i;
-        ColumnIndex *index = column->index;
-        if (index != NULL && index->clustered) {
-            int column_value = column->values.data[position];
+    vacuum_table(table);
+}
 
-            bool found = false;
-            unsigned int clustered_position;
+static inline void update(Column *column, unsigned int position, int value) {
+    if (column_value(column, position) == value) {
+        return;
+    }
 
-            switch (index->type) {
-            case BTREE:
-                found = btree_search(&index->fields.btree, column_value, position,
-                        index->clustered_positions->data, &clustered_position);
-                break;
-            case SORTED:
-                found = sorted_search(&index->fields.sorted, column_value, position,
-                        index->clustered_positions->data, &clustered_position);
-                break;
-            }
+    column_value_set(column, position, value);
 
-            if (found) {
-                index->clustered_columns[column->order].data[clustered_position] = value;
-            }
-        }
+    ColumnIndex *index = column->index;
+    if (index != NULL && index->clustered) {
+        clustered_touch(column, position);
     }
 }
 
@@ -711,33 +853,26 @@ void dsl_relational_update(ClientContext *client_context, char *column_fqn, char
         return;
     }
 
-    Column *source = pos->source;
-
-    if (source != NULL) {
-        ColumnIndex *source_index = source->index;
+    MessageStatus status = positions_check(pos, table, table->version->values_count,
+            table->version->moves);
+    if (status != OK) {
+        send_message->status = status;
+        pthread_rwlock_unlock(&table->rwlock);
+        return;
+    }
 
-        if (source_index != NULL && source_index->clustered) {
-            unsigned int *clustered_positions = source_index->clustered_positions->data;
-            for (unsigned int i = 0; i < positions_count; i++) {
-                update(table, column, clustered_positions[positions[i]], value);
-            }
-        } else {
-            for (unsigned int i = 0; i < positions_count; i++) {
-                update(table, column, positions[i], value);
-            }
-        }
-    } else {
-        for (unsigned int i = 0; i < positions_count; i++) {
-            update(table, column, positions[i], value);
-        }
+    table_write_begin(table);
+    for (unsigned int i = 0; i < positions_count; i++) {
+        update(column, positions[i], value);
     }
+    table_write_commit(table);
 
     pthread_rwlock_unlock(&table->rwlock);
 }
 
 void dsl_join(ClientContext *client_context, JoinType type, char *val_var1, char *pos_var1,
-        char *val_var2, char *pos_var2, char *pos_out_var1, char *pos_out_var2,
-        Message *send_message) {
+        char *val_var2, char *pos_var2, Comparator *band, char *high_var2, char *pos_out_var1,
+        char *pos_out_var2, Message *send_message) {
     Result *val1 = result_lookup(client_context, val_var1);
     if (val1 == NULL) {
         send_message->status = VARIABLE_NOT_FOUND;
@@ -800,6 +935,48 @@ void dsl_join(ClientContext *client_context, JoinType type, char *val_var1, char
         return;
     }
 
+    int *highs2 = NULL;
+    if (high_var2 != NULL) {
+        Result *high2 = result_lookup(client_context, high_var2);
+        if (high2 == NULL) {
+            send_message->status = VARIABLE_NOT_FOUND;
+            return;
+        }
+        if (high2->type != INT) {
+            send_message->status = WRONG_VARIABLE_TYPE;
+            return;
+        }
+        if (high2->num_tuples != values2_count) {
+            send_message->status = TUPLE_COUNT_MISMATCH;
+            return;
+        }
+
+        highs2 = high2->values.int_values;
+    }
+
+    if (type == INTERVAL_COUNT) {
+        long long int *count = malloc(sizeof(long long int));
+        *count = values1_count > 0 && values2_count > 0
+                ? (long long int) join_interval_count(values1, positions1, values1_count,
+                        val1->sorted, values2, highs2, values2_count)
+                : 0;
+        long_result_put(client_context, pos_out_var1, count, 1);
+        return;
+    }
+
+    long long int band_low = band->has_low ? band->low : -BAND_UNBOUNDED;
+    long long int band_high = band->has_high ? band->high : BAND_UNBOUNDED;
+
+    if (type == BAND_COUNT) {
+        long long int *count = malloc(sizeof(long long int));
+        *count = values1_count > 0 && values2_count > 0
+                ? (long long int) join_band_count(values1, positions1, values1_count, val1->sorted,
+                        values2, positions2, values2_count, val2->sorted, band_low, band_high)
+                : 0;
+        long_result_put(client_context, pos_out_var1, count, 1);
+        return;
+    }
+
     unsigned int *result1 = NULL;
     unsigned int result1_count = 0;
 
@@ -815,16 +992,35 @@ void dsl_join(ClientContext *client_context, JoinType type, char *val_var1, char
 
         switch (type) {
         case HASH:
-            join_hash(values1, positions1, values1_count, values2, positions2, values2_count,
-                    &pos_out1, &pos_out2);
+            if (!join_hash(values1, positions1, values1_count, values2, positions2,
+                    values2_count, &pos_out1, &pos_out2)) {
+                pos_vector_destroy(&pos_out1);
+                pos_vector_destroy(&pos_out2);
+                send_message->status = JOIN_RESULT_TOO_LARGE;
+                return;
+            }
             break;
         case NESTED_LOOP:
             join_nested_loop(values1, positions1, values1_count, values2, positions2, values2_count,
                     &pos_out1, &pos_out2);
             break;
         case SORT_MERGE:
-            join_sort_merge(values1, positions1, values1_count, values2, positions2, values2_count,
-                    &pos_out1, &pos_out2);
+            join_sort_merge(values1, positions1, values1_count, val1->sorted, values2, positions2,
+                    values2_count, val2->sorted, &pos_out1, &pos_out2);
+            break;
+        case SEMI:
+            join_semi(values1, positions1, values1_count, values2, values2_count, &pos_out1);
+            break;
+        case BAND:
+            join_band(values1, positions1, values1_count, val1->sorted, values2, positions2,
+                    values2_count, val2->sorted, band_low, band_high, &pos_out1, &pos_out2);
+            break;
+        case INTERVAL:
+            join_interval(values1, positions1, values1_count, val1->sorted, values2, highs2,
+                    positions2, values2_count, &pos_out1, &pos_out2);
+            break;
+        case BAND_COUNT:
+        case INTERVAL_COUNT:
             break;
         }
 
@@ -849,18 +1045,152 @@ void dsl_join(ClientContext *client_context, JoinType type, char *val_var1, char
         }
     }
 
-    pos_result_put(client_context, pos_out_var1, pos1->source, result1, result1_count);
+    // A semi-join keeps the order of the first side.
+    pos_result_put(client_context, pos_out_var1, pos1->source, pos1->moves, result1,
+            result1_count, type == SEMI && pos1->sorted);
+
+    if (pos_out_var2 != NULL) {
+        pos_result_put(client_context, pos_out_var2, pos2->source, pos2->moves, result2,
+                result2_count, false);
+    }
+}
+
+// Returns the smallest value read, skipping deleted rows, and sets its position if asked for. The
+// reader holds at least one row.
+static inline int scan_min(ColumnReader *reader, unsigned int *min_position) {
+    int min_value = 0;
+    unsigned int position = 0;
+    bool found = false;
+
+    for (unsigned int offset = 0; offset < reader->values_count; offset += COLUMN_SEGMENT_SIZE) {
+        unsigned int s = offset >> COLUMN_SEGMENT_BITS;
+        int *values = reader->segments[s];
+        bool *deleted_rows = reader->deleted_rows != NULL ? reader->deleted_rows[s] : NULL;
+        unsigned int count = reader->values_count - offset < COLUMN_SEGMENT_SIZE
+                ? reader->values_count - offset : COLUMN_SEGMENT_SIZE;
+
+        unsigned int i = 0;
+        if (!found) {
+            for (; deleted_rows != NULL && i < count && deleted_rows[i]; i++) {
+            }
+            if (i == count) {
+                continue;
+            }
+
+            min_value = values[i];
+            position = offset + i++;
+            found = true;
+        }
+
+        if (deleted_rows == NULL) {
+            for (; i < count; i++) {
+                int value = values[i];
+
+                bool smaller = value < min_value;
+
+                position = smaller ? offset + i : position;
+                min_value = smaller ? value : min_value;
+            }
+        } else {
+            for (; i < count; i++) {
+                int value = values[i];
+
+                bool smaller = !deleted_rows[i] & (value < min_value);
+
+                position = smaller ? offset + i : position;
+                min_value = smaller ? value : min_value;
+            }
+        }
+    }
+
+    if (min_position != NULL) {
+        *min_position = position;
+    }
+    return min_value;
+}
+
+// Returns the largest value read, skipping deleted rows, and sets its position if asked for. The
+// reader holds at least one row.
+static inline int scan_max(ColumnReader *reader, unsigned int *max_position) {
+    int max_value = 0;
+    unsigned int position = 0;
+    bool found = false;
+
+    for (unsigned int offset = 0; offset < reader->values_count; offset += COLUMN_SEGMENT_SIZE) {
+        unsigned int s = offset >> COLUMN_SEGMENT_BITS;
+        int *values = reader->segments[s];
+        bool *deleted_rows = reader->deleted_rows != NULL ? reader->deleted_rows[s] : NULL;
+        unsigned int count = reader->values_count - offset < COLUMN_SEGMENT_SIZE
+                ? reader->values_count - offset : COLUMN_SEGMENT_SIZE;
+
+        unsigned int i = 0;
+        if (!found) {
+            for (; deleted_rows != NULL && i < count && deleted_rows[i]; i++) {
+            }
+            if (i == count) {
+                continue;
+            }
+
+            max_value = values[i];
+            position = offset + i++;
+            found = true;
+        }
+
+        if (deleted_rows == NULL) {
+            for (; i < count; i++) {
+                int value = values[i];
+
+                bool larger = value > max_value;
+
+                position = larger ? offset + i : position;
+                max_value = larger ? value : max_value;
+            }
+        } else {
+            for (; i < count; i++) {
+                int value = values[i];
+
+                bool larger = !deleted_rows[i] & (value > max_value);
+
+                position = larger ? offset + i : position;
+                max_value = larger ? value : max_value;
+            }
+        }
+    }
+
+    if (max_position != NULL) {
+        *max_position = position;
+    }
+    return max_value;
+}
+
+// Returns the sum of the values read, skipping deleted rows.
+static inline long long int scan_sum(ColumnReader *reader) {
+    long long int sum = 0;
+
+    for (unsigned int offset = 0; offset < reader->values_count; offset += COLUMN_SEGMENT_SIZE) {
+        unsigned int s = offset >> COLUMN_SEGMENT_BITS;
+        int *values = reader->segments[s];
+        unsigned int count = reader->values_count - offset < COLUMN_SEGMENT_SIZE
+                ? reader->values_count - offset : COLUMN_SEGMENT_SIZE;
+
+        if (reader->deleted_rows == NULL) {
+            for (unsigned int i = 0; i < count; i++) {
+                sum += values[i];
+            }
+        } else {
+            bool *deleted_rows = reader->deleted_rows[s];
+            for (unsigned int i = 0; i < count; i++) {
+                sum += !deleted_rows[i] * values[i];
+            }
+        }
+    }
 
-    pos_result_put(client_context, pos_out_var2, pos2->source, result2, result2_count);
+    return sum;
 }
 
 void dsl_min(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, char *val_out_var,
         Message *send_message) {
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     ColumnIndex *index;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
@@ -868,14 +1198,14 @@ void dsl_min(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, ch
             send_message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
-        pthread_rwlock_rdlock(table_rwlock = &table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->delete_queue.size > 0 ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
-        index = column->index;
+        index = __atomic_load_n(&column->index, __ATOMIC_ACQUIRE);
+        // Hash indexes are unordered, so extrema are found by scanning.
+        if (index != NULL && index->type == HASHED) {
+            index = NULL;
+        }
+
+        column_reader_open(&reader, column, index);
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -887,71 +1217,34 @@ void dsl_min(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, ch
             return;
         }
 
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
         index = NULL;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
-    if (rows_count == 0) {
+    if (reader.rows_count == 0) {
         send_message->status = EMPTY_VECTOR;
-        if (table_rwlock != NULL) {
-            pthread_rwlock_unlock(table_rwlock);
-        }
+        column_reader_close(&reader);
         return;
     }
 
+    // Scan if the index no longer holds the extremum as read.
     int min_value = 0;
-    if (index == NULL) {
-        if (deleted_rows == NULL) {
-            min_value = values[0];
-
-            for (unsigned int i = 1; i < values_count; i++) {
-                int value = values[i];
-                min_value = value < min_value ? value : min_value;
-            }
-        } else {
-            unsigned int i = 0;
-
-            for (; i < values_count; i++) {
-                if (!deleted_rows[i]) {
-                    break;
-                }
-            }
-
-            min_value = values[i++];
-
-            for (; i < values_count; i++) {
-                int value = values[i];
-                min_value = (!deleted_rows[i] & (value < min_value)) ? value : min_value;
-            }
-        }
-    } else {
-        switch (index->type) {
-        case BTREE:
-            min_value = btree_min(&index->fields.btree, NULL);
-            break;
-        case SORTED:
-            min_value = sorted_min(&index->fields.sorted, NULL);
-            break;
-        }
+    if (reader.index == NULL || !column_reader_index_min(&reader, &min_value, NULL)) {
+        min_value = scan_min(&reader, NULL);
     }
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
     int *value_out = malloc(sizeof(int));
     *value_out = min_value;
 
-    int_result_put(client_context, val_out_var, value_out, 1);
+    int_result_put(client_context, val_out_var, value_out, 1, false);
 }
 
 void dsl_min_pos(ClientContext *client_context, char *pos_var, GeneralizedColumnHandle *col_hdl,
         char *pos_out_var, char *val_out_var, Message *send_message) {
     Column *source = NULL;
+    unsigned int moves = 0;
 
     unsigned int *positions;
     unsigned int positions_count;
@@ -967,6 +1260,7 @@ void dsl_min_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
         }
 
         source = pos->source;
+        moves = pos->moves;
         positions = pos->values.pos_values;
         positions_count = pos->num_tuples;
     } else {
@@ -974,11 +1268,7 @@ void dsl_min_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
         positions_count = 0;
     }
 
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     ColumnIndex *index;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
@@ -986,15 +1276,16 @@ void dsl_min_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
             send_message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
         source = column;
-        pthread_rwlock_rdlock(table_rwlock = &column->table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->delete_queue.size > 0 ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
-        index = column->index;
+        index = __atomic_load_n(&column->index, __ATOMIC_ACQUIRE);
+        // Hash indexes are unordered, so extrema are found by scanning.
+        if (index != NULL && index->type == HASHED) {
+            index = NULL;
+        }
+
+        column_reader_open(&reader, column, index);
+        moves = reader.moves;
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -1006,102 +1297,51 @@ void dsl_min_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
             return;
         }
 
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
         index = NULL;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
-    if (rows_count == 0) {
+    if (reader.rows_count == 0) {
         send_message->status = EMPTY_VECTOR;
-        if (table_rwlock != NULL) {
-            pthread_rwlock_unlock(table_rwlock);
-        }
+        column_reader_close(&reader);
         return;
     }
 
     unsigned int min_position = 0;
     int min_value = 0;
-    if (index == NULL) {
-        if (positions != NULL && positions_count != values_count) {
+    if (reader.index == NULL) {
+        if (positions != NULL && positions_count != reader.values_count) {
             send_message->status = TUPLE_COUNT_MISMATCH;
-            if (table_rwlock != NULL) {
-                pthread_rwlock_unlock(table_rwlock);
-            }
+            column_reader_close(&reader);
             return;
         }
 
-        if (deleted_rows == NULL) {
-            min_position = 0;
-            min_value = values[0];
-
-            for (unsigned int i = 1; i < values_count; i++) {
-                int value = values[i];
-
-                bool smaller = value < min_value;
-
-                min_position = smaller ? i : min_position;
-                min_value = smaller ? value : min_value;
-            }
-
-            if (positions != NULL) {
-                min_position = positions[min_position];
-            }
-        } else {
-            min_position = 0;
-
-            for (; min_position < values_count; min_position++) {
-                if (!deleted_rows[min_position]) {
-                    break;
-                }
-            }
-
-            min_value = values[min_position];
-
-            for (unsigned int i = min_position + 1; i < values_count; i++) {
-                int value = values[i];
+        min_value = scan_min(&reader, &min_position);
 
-                bool smaller = !deleted_rows[i] & (value < min_value);
-
-                min_position = smaller ? i : min_position;
-                min_value = smaller ? value : min_value;
-            }
-        }
-    } else {
-        switch (index->type) {
-        case BTREE:
-            min_value = btree_min(&index->fields.btree, &min_position);
-            break;
-        case SORTED:
-            min_value = sorted_min(&index->fields.sorted, &min_position);
-            break;
+        if (positions != NULL && reader.deleted_rows == NULL) {
+            min_position = positions[min_position];
         }
+    } else if (!column_reader_index_min(&reader, &min_value, &min_position)) {
+        // The index no longer holds the extremum as read, the column is scanned for it instead.
+        min_value = scan_min(&reader, &min_position);
     }
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
     unsigned int *position_out = malloc(sizeof(unsigned int));
     *position_out = min_position;
 
-    pos_result_put(client_context, pos_out_var, source, position_out, 1);
+    pos_result_put(client_context, pos_out_var, source, moves, position_out, 1, false);
 
     int *value_out = malloc(sizeof(int));
     *value_out = min_value;
 
-    int_result_put(client_context, val_out_var, value_out, 1);
+    int_result_put(client_context, val_out_var, value_out, 1, false);
 }
 
 void dsl_max(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, char *val_out_var,
         Message *send_message) {
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     ColumnIndex *index;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
@@ -1109,14 +1349,14 @@ void dsl_max(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, ch
             send_message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
-        pthread_rwlock_rdlock(table_rwlock = &table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->delete_queue.size > 0 ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
-        index = column->index;
+        index = __atomic_load_n(&column->index, __ATOMIC_ACQUIRE);
+        // Hash indexes are unordered, so extrema are found by scanning.
+        if (index != NULL && index->type == HASHED) {
+            index = NULL;
+        }
+
+        column_reader_open(&reader, column, index);
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -1128,71 +1368,34 @@ void dsl_max(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, ch
             return;
         }
 
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
         index = NULL;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
-    if (rows_count == 0) {
+    if (reader.rows_count == 0) {
         send_message->status = EMPTY_VECTOR;
-        if (table_rwlock != NULL) {
-            pthread_rwlock_unlock(table_rwlock);
-        }
+        column_reader_close(&reader);
         return;
     }
 
+    // Scan if the index no longer holds the extremum as read.
     int max_value = 0;
-    if (index == NULL) {
-        if (deleted_rows == NULL) {
-            max_value = values[0];
-
-            for (unsigned int i = 1; i < values_count; i++) {
-                int value = values[i];
-                max_value = value > max_value ? value : max_value;
-            }
-        } else {
-            unsigned int i = 0;
-
-            for (; i < values_count; i++) {
-                if (!deleted_rows[i]) {
-                    break;
-                }
-            }
-
-            max_value = values[i++];
-
-            for (; i < values_count; i++) {
-                int value = values[i];
-                max_value = (!deleted_rows[i] & (value > max_value)) ? value : max_value;
-            }
-        }
-    } else {
-        switch (index->type) {
-        case BTREE:
-            max_value = btree_max(&index->fields.btree, NULL);
-            break;
-        case SORTED:
-            max_value = sorted_max(&index->fields.sorted, NULL);
-            break;
-        }
+    if (reader.index == NULL || !column_reader_index_max(&reader, &max_value, NULL)) {
+        max_value = scan_max(&reader, NULL);
     }
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
     int *value_out = malloc(sizeof(int));
     *value_out = max_value;
 
-    int_result_put(client_context, val_out_var, value_out, 1);
+    int_result_put(client_context, val_out_var, value_out, 1, false);
 }
 
 void dsl_max_pos(ClientContext *client_context, char *pos_var, GeneralizedColumnHandle *col_hdl,
         char *pos_out_var, char *val_out_var, Message *send_message) {
     Column *source = NULL;
+    unsigned int moves = 0;
 
     unsigned int *positions;
     unsigned int positions_count;
@@ -1208,6 +1411,7 @@ void dsl_max_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
         }
 
         source = pos->source;
+        moves = pos->moves;
         positions = pos->values.pos_values;
         positions_count = pos->num_tuples;
     } else {
@@ -1215,11 +1419,7 @@ void dsl_max_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
         positions_count = 0;
     }
 
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     ColumnIndex *index;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
@@ -1227,15 +1427,16 @@ void dsl_max_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
             send_message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
         source = column;
-        pthread_rwlock_rdlock(table_rwlock = &table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->delete_queue.size > 0 ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
-        index = column->index;
+        index = __atomic_load_n(&column->index, __ATOMIC_ACQUIRE);
+        // Hash indexes are unordered, so extrema are found by scanning.
+        if (index != NULL && index->type == HASHED) {
+            index = NULL;
+        }
+
+        column_reader_open(&reader, column, index);
+        moves = reader.moves;
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -1247,115 +1448,59 @@ void dsl_max_pos(ClientContext *client_context, char *pos_var, GeneralizedColumn
             return;
         }
 
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
         index = NULL;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
-    if (rows_count == 0) {
+    if (reader.rows_count == 0) {
         send_message->status = EMPTY_VECTOR;
-        if (table_rwlock != NULL) {
-            pthread_rwlock_unlock(table_rwlock);
-        }
+        column_reader_close(&reader);
         return;
     }
 
     unsigned int max_position = 0;
     int max_value = 0;
-    if (index == NULL) {
-        if (positions != NULL && positions_count != values_count) {
+    if (reader.index == NULL) {
+        if (positions != NULL && positions_count != reader.values_count) {
             send_message->status = TUPLE_COUNT_MISMATCH;
-            if (table_rwlock != NULL) {
-                pthread_rwlock_unlock(table_rwlock);
-            }
+            column_reader_close(&reader);
             return;
         }
 
-        if (deleted_rows == NULL) {
-            max_position = 0;
-            max_value = values[0];
-
-            for (unsigned int i = 1; i < values_count; i++) {
-                int value = values[i];
-
-                bool larger = value > max_value;
-
-                max_position = larger ? i : max_position;
-                max_value = larger ? value : max_value;
-            }
-
-            if (positions != NULL) {
-                max_position = positions[max_position];
-            }
-        } else {
-            max_position = 0;
-
-            for (; max_position < values_count; max_position++) {
-                if (!deleted_rows[max_position]) {
-                    break;
-                }
-            }
+        max_value = scan_max(&reader, &max_position);
 
-            max_value = values[max_position];
-
-            for (unsigned int i = max_position + 1; i < values_count; i++) {
-                int value = values[i];
-
-                bool larger = !deleted_rows[i] & (value > max_value);
-
-                max_position = larger ? i : max_position;
-                max_value = larger ? value : max_value;
-            }
-        }
-    } else {
-        switch (index->type) {
-        case BTREE:
-            max_value = btree_max(&index->fields.btree, &max_position);
-            break;
-        case SORTED:
-            max_value = sorted_max(&index->fields.sorted, &max_position);
-            break;
+        if (positions != NULL && reader.deleted_rows == NULL) {
+            max_position = positions[max_position];
         }
+    } else if (!column_reader_index_max(&reader, &max_value, &max_position)) {
+        // The index no longer holds the extremum as read, the column is scanned for it instead.
+        max_value = scan_max(&reader, &max_position);
     }
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
     unsigned int *position_out = malloc(sizeof(unsigned int));
     *position_out = max_position;
 
-    pos_result_put(client_context, pos_out_var, source, position_out, 1);
+    pos_result_put(client_context, pos_out_var, source, moves, position_out, 1, false);
 
     int *value_out = malloc(sizeof(int));
     *value_out = max_value;
 
-    int_result_put(client_context, val_out_var, value_out, 1);
+    int_result_put(client_context, val_out_var, value_out, 1, false);
 }
 
 void dsl_sum(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, char *val_out_var,
         Message *send_message) {
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
         if (column == NULL) {
             send_message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
-        pthread_rwlock_rdlock(table_rwlock = &table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->delete_queue.size > 0 ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
+        column_reader_open(&reader, column, NULL);
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -1367,29 +1512,12 @@ void dsl_sum(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, ch
             return;
         }
 
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
-    long long int result = 0;
-    if (rows_count > 0) {
-        if (deleted_rows == NULL) {
-            for (unsigned int i = 0; i < values_count; i++) {
-                result += values[i];
-            }
-        } else {
-            for (unsigned int i = 0; i < values_count; i++) {
-                result += !deleted_rows[i] * values[i];
-            }
-        }
-    }
+    long long int result = reader.rows_count > 0 ? scan_sum(&reader) : 0;
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
     long long int *value_out = malloc(sizeof(long long int));
     *value_out = result;
@@ -1399,24 +1527,15 @@ void dsl_sum(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, ch
 
 void dsl_avg(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, char *val_out_var,
         Message *send_message) {
-    pthread_rwlock_t *table_rwlock;
-    unsigned int rows_count;
-    bool *deleted_rows;
-    int *values;
-    unsigned int values_count;
+    ColumnReader reader;
     if (col_hdl->is_column_fqn) {
         Column *column = column_lookup(col_hdl->name);
         if (column == NULL) {
             send_message->status = COLUMN_NOT_FOUND;
             return;
         }
-        Table *table = column->table;
 
-        pthread_rwlock_rdlock(table_rwlock = &table->rwlock);
-        rows_count = table->rows_count;
-        deleted_rows = table->delete_queue.size > 0 ? table->deleted_rows->data : NULL;
-        values = column->values.data;
-        values_count = column->values.size;
+        column_reader_open(&reader, column, NULL);
     } else {
         Result *variable = result_lookup(client_context, col_hdl->name);
         if (variable == NULL) {
@@ -1428,36 +1547,19 @@ void dsl_avg(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, ch
             return;
         }
 
-        table_rwlock = NULL;
-        rows_count = variable->num_tuples;
-        deleted_rows = NULL;
-        values = variable->values.int_values;
-        values_count = variable->num_tuples;
+        column_reader_open_values(&reader, variable->values.int_values, variable->num_tuples);
     }
 
-    if (rows_count == 0) {
+    if (reader.rows_count == 0) {
         send_message->status = EMPTY_VECTOR;
-        if (table_rwlock != NULL) {
-            pthread_rwlock_unlock(table_rwlock);
-        }
+        column_reader_close(&reader);
         return;
     }
 
-    long long int sum = 0;
-    if (deleted_rows == NULL) {
-        for (unsigned int i = 0; i < values_count; i++) {
-            sum += values[i];
-        }
-    } else {
-        for (unsigned int i = 0; i < values_count; i++) {
-            sum += !deleted_rows[i] * values[i];
-        }
-    }
-    double result = (double) sum / (double) rows_count;
+    long long int sum = scan_sum(&reader);
+    double result = (double) sum / (double) reader.rows_count;
 
-    if (table_rwlock != NULL) {
-        pthread_rwlock_unlock(table_rwlock);
-    }
+    column_reader_close(&reader);
 
     double *value_out = malloc(sizeof(double));
     *value_out = result;
@@ -1504,7 +1606,7 @@ void dsl_add(ClientContext *client_context, char *val_var1, char *val_var2, char
         }
     }
 
-    int_result_put(client_context, val_out_var, result, values1_count);
+    int_result_put(client_context, val_out_var, result, values1_count, false);
 }
 
 void dsl_sub(ClientContext *client_context, char *val_var1, char *val_var2, char *val_out_var,
@@ -1546,7 +1648,7 @@ void dsl_sub(ClientContext *client_context, char *val_var1, char *val_var2, char
         }
     }
 
-    int_result_put(client_context, val_out_var, result, values1_count);
+    int_result_put(client_context, val_out_var, result, values1_count, false);
 }
 
 void dsl_print(ClientContext *client_context, Vector *val_vars, Message *send_message) {
@@ -0,0 +1,173 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "epoch.h"
+
+// Retired data is freed once the global epoch moved this many times since it was retired. The
+// epoch only moves once every reading thread has seen its current value, so after two moves no
+// reader can have loaded the data before it was unlinked.
+#define EPOCH_GRACE_PERIOD 2
+
+// Threads which read shared data. A record belongs to a single thread at a time, and is taken
+// over by a later thread once its owner exited, so records are only freed on shutdown.
+typedef struct EpochRecord {
+    // Epoch the thread entered in, shifted left by one, with the lowest bit set while it reads.
+    unsigned long state;
+    unsigned int depth;
+    bool owned;
+    struct EpochRecord *next;
+} EpochRecord;
+
+typedef struct EpochRetired {
+    void *ptr;
+    void (*routine)(void *);
+    unsigned long epoch;
+    struct EpochRetired *next;
+} EpochRetired;
+
+static unsigned long epoch_global = 0;
+static EpochRecord *epoch_records = NULL;
+// Newest first, so that the epochs of the list never increase.
+static EpochRetired *epoch_retired = NULL;
+static pthread_mutex_t epoch_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t epoch_key;
+static pthread_once_t epoch_key_once = PTHREAD_ONCE_INIT;
+static bool epoch_key_created = false;
+
+static __thread EpochRecord *epoch_local = NULL;
+
+// Locks the mutex so that the exit of a thread is ordered before the shutdown freeing its record.
+static void epoch_release(void *data) {
+    EpochRecord *record = data;
+
+    pthread_mutex_lock(&epoch_mutex);
+    __atomic_store_n(&record->owned, false, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&epoch_mutex);
+}
+
+static void epoch_key_create() {
+    pthread_key_create(&epoch_key, &epoch_release);
+    epoch_key_created = true;
+}
+
+static EpochRecord *epoch_acquire() {
+    pthread_once(&epoch_key_once, &epoch_key_create);
+
+    EpochRecord *record = __atomic_load_n(&epoch_records, __ATOMIC_ACQUIRE);
+    for (; record != NULL; record = record->next) {
+        bool owned = false;
+        if (__atomic_compare_exchange_n(&record->owned, &owned, true, false, __ATOMIC_ACQUIRE,
+                __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (record == NULL) {
+        record = malloc(sizeof(EpochRecord));
+        record->state = 0;
+        record->owned = true;
+
+        pthread_mutex_lock(&epoch_mutex);
+        record->next = epoch_records;
+        __atomic_store_n(&epoch_records, record, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&epoch_mutex);
+    }
+
+    record->depth = 0;
+    pthread_setspecific(epoch_key, record);
+    return record;
+}
+
+void epoch_enter() {
+    EpochRecord *record = epoch_local;
+    if (record == NULL) {
+        record = epoch_local = epoch_acquire();
+    }
+
+    if (record->depth++ == 0) {
+        unsigned long epoch = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&record->state, epoch << 1 | 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void epoch_exit() {
+    EpochRecord *record = epoch_local;
+    if (--record->depth == 0) {
+        __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// Moves the global epoch forward if every reading thread has seen it. Called with the mutex held.
+static void epoch_advance() {
+    unsigned long epoch = __atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST);
+
+    EpochRecord *record = __atomic_load_n(&epoch_records, __ATOMIC_ACQUIRE);
+    for (; record != NULL; record = record->next) {
+        unsigned long state = __atomic_load_n(&record->state, __ATOMIC_SEQ_CST);
+        if ((state & 1) && state >> 1 != epoch) {
+            return;
+        }
+    }
+
+    __atomic_store_n(&epoch_global, epoch + 1, __ATOMIC_SEQ_CST);
+}
+
+void epoch_retire(void *ptr, void (*routine)(void *)) {
+    EpochRetired *retired = malloc(sizeof(EpochRetired));
+    retired->ptr = ptr;
+    retired->routine = routine;
+
+    pthread_mutex_lock(&epoch_mutex);
+
+    retired->epoch = epoch_global;
+    retired->next = epoch_retired;
+    epoch_retired = retired;
+
+    epoch_advance();
+
+    // Cut the list before the first entry old enough, all entries after it are older still.
+    EpochRetired *reclaimed = NULL;
+    for (EpochRetired **link = &epoch_retired; *link != NULL; link = &(*link)->next) {
+        if ((*link)->epoch + EPOCH_GRACE_PERIOD <= epoch_global) {
+            reclaimed = *link;
+            *link = NULL;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&epoch_mutex);
+
+    for (EpochRetired *next; reclaimed != NULL; reclaimed = next) {
+        next = reclaimed->next;
+        reclaimed->routine(reclaimed->ptr);
+        free(reclaimed);
+    }
+}
+
+void epoch_shutdown() {
+    // Threads exiting from now on must not release records that are freed below.
+    if (epoch_key_created) {
+        pthread_key_delete(epoch_key);
+    }
+
+    pthread_mutex_lock(&epoch_mutex);
+
+    for (EpochRetired *retired = epoch_retired, *next; retired != NULL; retired = next) {
+        next = retired->next;
+        retired->routine(retired->ptr);
+        free(retired);
+    }
+
+    for (EpochRecord *record = epoch_records, *next; record != NULL; record = next) {
+        next = record->next;
+        free(record);
+    }
+
+    epoch_local = NULL;
+    epoch_retired = NULL;
+    epoch_records = NULL;
+
+    pthread_mutex_unlock(&epoch_mutex);
+}
@@ -0,0 +1,278 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_index.h"
+#include "utils.h"
+
+#define HASH_INDEX_INITIAL_CAPACITY 16
+
+static inline unsigned int hash_index_hash(int value) {
+    unsigned int hash = (unsigned int) value * 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+static inline void hash_index_alloc(HashIndex *index, unsigned int num_keys) {
+    // Keep the load factor at most 1/2, so probe sequences stay within a line or two.
+    unsigned int num_slots = round_up_power_of_two(2 * num_keys);
+    if (num_slots < HASH_INDEX_INITIAL_CAPACITY) {
+        num_slots = HASH_INDEX_INITIAL_CAPACITY;
+    }
+
+    index->slots = calloc(num_slots, sizeof(HashIndexSlot));
+    index->num_slots = num_slots;
+}
+
+// Returns the slot holding value, or the empty slot where it would be placed.
+static inline HashIndexSlot *hash_index_find(HashIndex *index, int value) {
+    unsigned int mask = index->num_slots - 1;
+    unsigned int i = hash_index_hash(value) & mask;
+    while (index->slots[i].count > 0 && index->slots[i].value != value) {
+        i = (i + 1) & mask;
+    }
+    return index->slots + i;
+}
+
+static inline void hash_index_resize(HashIndex *index) {
+    HashIndexSlot *slots = index->slots;
+    unsigned int num_slots = index->num_slots;
+
+    hash_index_alloc(index, 2 * index->num_keys);
+
+    // Runs are moved, not copied.
+    for (unsigned int i = 0; i < num_slots; i++) {
+        if (slots[i].count > 0) {
+            *hash_index_find(index, slots[i].value) = slots[i];
+        }
+    }
+
+    free(slots);
+}
+
+static inline unsigned int *hash_index_run(HashIndexSlot *slot) {
+    return slot->count == 1 ? &slot->run.position : slot->run.positions;
+}
+
+void hash_index_init(HashIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    hash_index_alloc(index, size);
+    index->num_keys = 0;
+    index->size = 0;
+
+    for (unsigned int i = 0; i < size; i++) {
+        hash_index_insert(index, values[i], positions != NULL ? positions[i] : i);
+    }
+}
+
+void hash_index_destroy(HashIndex *index) {
+    for (unsigned int i = 0; i < index->num_slots; i++) {
+        if (index->slots[i].count > 1) {
+            free(index->slots[i].run.positions);
+        }
+    }
+    free(index->slots);
+}
+
+void hash_index_merge(HashIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    for (unsigned int i = 0; i < size; i++) {
+        hash_index_insert(index, values[i], positions[i]);
+    }
+}
+
+bool hash_index_save(HashIndex *index, FILE *file) {
+    if (fwrite(&index->num_keys, sizeof(index->num_keys), 1, file) != 1) {
+        log_err("Unable to write hash index num_keys\n");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < index->num_slots; i++) {
+        HashIndexSlot *slot = index->slots + i;
+        if (slot->count == 0) {
+            continue;
+        }
+
+        if (fwrite(&slot->value, sizeof(slot->value), 1, file) != 1) {
+            log_err("Unable to write hash index value\n");
+            return false;
+        }
+
+        if (fwrite(&slot->count, sizeof(slot->count), 1, file) != 1) {
+            log_err("Unable to write hash index count\n");
+            return false;
+        }
+
+        if (fwrite(hash_index_run(slot), sizeof(unsigned int), slot->count, file) != slot->count) {
+            log_err("Unable to write hash index positions\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool hash_index_load(HashIndex *index, FILE *file) {
+    unsigned int num_keys;
+    if (fread(&num_keys, sizeof(num_keys), 1, file) != 1) {
+        log_err("Unable to read hash index num_keys\n");
+        return false;
+    }
+
+    hash_index_alloc(index, num_keys);
+    index->num_keys = 0;
+    index->size = 0;
+
+    for (unsigned int i = 0; i < num_keys; i++) {
+        int value;
+        if (fread(&value, sizeof(value), 1, file) != 1) {
+            log_err("Unable to read hash index value\n");
+            hash_index_destroy(index);
+            return false;
+        }
+
+        unsigned int count;
+        if (fread(&count, sizeof(count), 1, file) != 1 || count == 0) {
+            log_err("Unable to read hash index count\n");
+            hash_index_destroy(index);
+            return false;
+        }
+
+        HashIndexSlot *slot = hash_index_find(index, value);
+        slot->value = value;
+        if (count == 1) {
+            slot->run.position = 0;
+        } else {
+            slot->run.positions = malloc(round_up_power_of_two(count) * sizeof(unsigned int));
+        }
+        slot->count = count;
+
+        index->num_keys++;
+        index->size += count;
+
+        if (fread(hash_index_run(slot), sizeof(unsigned int), count, file) != count) {
+            log_err("Unable to read hash index positions\n");
+            hash_index_destroy(index);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void hash_index_insert(HashIndex *index, int value, unsigned int position) {
+    if (2 * (index->num_keys + 1) > index->num_slots) {
+        hash_index_resize(index);
+    }
+
+    HashIndexSlot *slot = hash_index_find(index, value);
+    if (slot->count == 0) {
+        slot->value = value;
+        slot->run.position = position;
+        slot->count = 1;
+        index->num_keys++;
+    } else {
+        if (slot->count == 1) {
+            unsigned int first = slot->run.position;
+            slot->run.positions = malloc(2 * sizeof(unsigned int));
+            slot->run.positions[0] = first;
+        } else if ((slot->count & (slot->count - 1)) == 0) {
+            slot->run.positions = realloc(slot->run.positions,
+                    2 * slot->count * sizeof(unsigned int));
+        }
+        slot->run.positions[slot->count++] = position;
+    }
+
+    index->size++;
+}
+
+// Empties a slot with backward shift deletion, moving later entries of the probe sequence into
+// the hole so that lookups never need tombstones.
+static inline void hash_index_clear(HashIndex *index, HashIndexSlot *slot) {
+    HashIndexSlot *slots = index->slots;
+    unsigned int mask = index->num_slots - 1;
+
+    unsigned int i = slot - slots;
+    for (unsigned int j = (i + 1) & mask; slots[j].count > 0; j = (j + 1) & mask) {
+        unsigned int home = hash_index_hash(slots[j].value) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+
+    slots[i].count = 0;
+    index->num_keys--;
+}
+
+// Returns the offset of position within the run of slot, or -1.
+static inline int hash_index_run_search(HashIndexSlot *slot, unsigned int position,
+        unsigned int *positions_map) {
+    unsigned int *run = hash_index_run(slot);
+    for (unsigned int i = 0; i < slot->count; i++) {
+        unsigned int pos = positions_map != NULL ? positions_map[run[i]] : run[i];
+        if (pos == position) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool hash_index_remove(HashIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr) {
+    HashIndexSlot *slot = hash_index_find(index, value);
+    if (slot->count == 0) {
+        return false;
+    }
+
+    int idx = hash_index_run_search(slot, position, positions_map);
+    if (idx == -1) {
+        return false;
+    }
+
+    unsigned int *run = hash_index_run(slot);
+    if (position_ptr != NULL) {
+        *position_ptr = run[idx];
+    }
+
+    if (slot->count == 1) {
+        hash_index_clear(index, slot);
+    } else if (slot->count == 2) {
+        unsigned int other = run[1 - idx];
+        free(run);
+        slot->run.position = other;
+        slot->count = 1;
+    } else {
+        memmove(run + idx, run + idx + 1, (slot->count - idx - 1) * sizeof(unsigned int));
+        slot->count--;
+    }
+
+    index->size--;
+
+    return true;
+}
+
+bool hash_index_search(HashIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr) {
+    HashIndexSlot *slot = hash_index_find(index, value);
+    if (slot->count == 0) {
+        return false;
+    }
+
+    int idx = hash_index_run_search(slot, position, positions_map);
+    if (idx == -1) {
+        return false;
+    }
+
+    if (position_ptr != NULL) {
+        *position_ptr = hash_index_run(slot)[idx];
+    }
+
+    return true;
+}
+
+unsigned int hash_index_select(HashIndex *index, int value, unsigned int *result) {
+    HashIndexSlot *slot = hash_index_find(index, value);
+    if (slot->count > 0) {
+        memcpy(result, hash_index_run(slot), slot->count * sizeof(unsigned int));
+    }
+    return slot->count;
+}
@@ -66,6 +66,15 @@ void *hash_table_put(HashTable *h, char *key, void *value) {
     return NULL;
 }
 
+// Keys are copied, values are shared.
+void hash_table_copy(HashTable *dst, HashTable *src) {
+    hash_table_init(dst, src->num_buckets, src->load_factor);
+
+    for (HashTableNode *node = src->nodes; node != NULL; node = node->nodes_next) {
+        hash_table_put(dst, node->key, node->value);
+    }
+}
+
 void *hash_table_get(HashTable *h, char *key) {
     size_t idx = hash_string(key) & (h->num_buckets - 1);
 
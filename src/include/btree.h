@@ -4,16 +4,29 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+// Node capacities can be tuned at compile time, e.g. with -DBTREE_INTERNAL_NODE_CAPACITY=256.
+#ifndef BTREE_INTERNAL_NODE_CAPACITY
 #define BTREE_INTERNAL_NODE_CAPACITY 512
+#endif
+#ifndef BTREE_LEAF_NODE_CAPACITY
 #define BTREE_LEAF_NODE_CAPACITY 512
+#endif
+
+#define BTREE_CACHE_LINE_SIZE 64
+#define BTREE_LINE_VALUES (BTREE_CACHE_LINE_SIZE / sizeof(int))
+#define BTREE_INTERNAL_NODE_LINES \
+        ((BTREE_INTERNAL_NODE_CAPACITY + BTREE_LINE_VALUES - 1) / BTREE_LINE_VALUES)
 
 typedef struct BTreeNode BTreeNode;
 typedef union BTreeNodeFields BTreeNodeFields;
 typedef struct BTreeInternalNode BTreeInternalNode;
 typedef struct BTreeLeafNode BTreeLeafNode;
 
+// Internal nodes keep the first value of every cache line of values in a small summary, so a
+// search touches the summary and then a single line of values.
 struct BTreeInternalNode {
-    int values[BTREE_INTERNAL_NODE_CAPACITY];
+    int leaders[BTREE_INTERNAL_NODE_LINES] __attribute__((aligned(BTREE_CACHE_LINE_SIZE)));
+    int values[BTREE_INTERNAL_NODE_CAPACITY] __attribute__((aligned(BTREE_CACHE_LINE_SIZE)));
     BTreeNode *children[BTREE_INTERNAL_NODE_CAPACITY];
     unsigned int size;
 };
@@ -22,8 +35,8 @@ struct BTreeLeafNode {
     int values[BTREE_LEAF_NODE_CAPACITY];
     unsigned int positions[BTREE_LEAF_NODE_CAPACITY];
     unsigned int size;
-    BTreeLeafNode *prev;
-    BTreeLeafNode *next;
+    BTreeNode *prev;
+    BTreeNode *next;
 };
 
 union BTreeNodeFields {
@@ -31,21 +44,49 @@ union BTreeNodeFields {
     BTreeLeafNode leaf;
 };
 
+// Separators are lower bounds of their child, so removes only touch internal nodes to unlink a
+// leaf they emptied. Every leaf holds at least one entry.
 struct BTreeNode {
     bool leaf;
     BTreeNodeFields fields;
 };
 
+// Leaf and slot holding the entry for a position.
+typedef struct BTreeEntry {
+    BTreeNode *leaf;
+    unsigned int slot;
+} BTreeEntry;
+
+// Not safe for concurrent use, writers must be serialized with each other and with readers.
 typedef struct BTreeIndex {
     BTreeNode *root;
-    BTreeLeafNode *head;
-    BTreeLeafNode *tail;
+    BTreeNode *head;
+    BTreeNode *tail;
     unsigned int size;
+    // Optional map from positions to entries, so removes don't scan every duplicate of a value.
+    // Entries of positions that are not in the tree are empty.
+    BTreeEntry *entries;
+    unsigned int entries_capacity;
 } BTreeIndex;
 
 void btree_init(BTreeIndex *index, int *values, unsigned int *positions, unsigned int size);
 void btree_destroy(BTreeIndex *index);
 
+/**
+ * Merges a batch sorted by value into the tree, bulk loading it again in a single pass.
+ */
+void btree_merge(BTreeIndex *index, int *values, unsigned int *positions, unsigned int size);
+
+/**
+ * Removes every entry for which removed(data, position) is true, bulk loading the tree again.
+ */
+void btree_remove_if(BTreeIndex *index, bool (*removed)(void *, unsigned int), void *data);
+
+/**
+ * Builds the map from positions to entries, if not built already. Every write keeps it current.
+ */
+void btree_track_positions(BTreeIndex *index);
+
 bool btree_save(BTreeIndex *index, FILE *file);
 bool btree_load(BTreeIndex *index, FILE *file);
 
@@ -19,12 +19,18 @@ typedef union ResultValues {
 /**
  * Declares the type of a result column, which includes the number of tuples in
  * the result, the data type of the result, and a pointer to the result data.
+ *
+ * A sorted result holds values in ascending order, or for positions, positions
+ * ordered by the values of their source column. Positions are only valid as long
+ * as no rows of the table of their source were moved since they were selected.
  */
 typedef struct Result {
     DataType type;
     Column *source;
+    unsigned int moves;
     ResultValues values;
     unsigned int num_tuples;
+    bool sorted;
 } Result;
 
 /**
@@ -42,26 +48,26 @@ void client_context_init(ClientContext *client_context, int client_socket);
 void client_context_destroy(ClientContext *client_context);
 
 void result_put(ClientContext *client_context, char *name, DataType type, Column *source,
-        void *values, unsigned int num_tuples);
+        unsigned int moves, void *values, unsigned int num_tuples, bool sorted);
 
 static inline void pos_result_put(ClientContext *client_context, char *name, Column *source,
-        unsigned int *pos_values, unsigned int num_tuples) {
-    result_put(client_context, name, POS, source, pos_values, num_tuples);
+        unsigned int moves, unsigned int *pos_values, unsigned int num_tuples, bool sorted) {
+    result_put(client_context, name, POS, source, moves, pos_values, num_tuples, sorted);
 }
 
 static inline void int_result_put(ClientContext *client_context, char *name,
-        int *int_values, unsigned int num_tuples) {
-    result_put(client_context, name, INT, NULL, int_values, num_tuples);
+        int *int_values, unsigned int num_tuples, bool sorted) {
+    result_put(client_context, name, INT, NULL, 0, int_values, num_tuples, sorted);
 }
 
 static inline void long_result_put(ClientContext *client_context, char *name,
         long long int *long_values, unsigned int num_tuples) {
-    result_put(client_context, name, LONG, NULL, long_values, num_tuples);
+    result_put(client_context, name, LONG, NULL, 0, long_values, num_tuples, false);
 }
 
 static inline void float_result_put(ClientContext *client_context, char *name,
         double *float_values, unsigned int num_tuples) {
-    result_put(client_context, name, FLOAT, NULL, float_values, num_tuples);
+    result_put(client_context, name, FLOAT, NULL, 0, float_values, num_tuples, false);
 }
 
 Result *result_lookup(ClientContext *client_context, char *name);
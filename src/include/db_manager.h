@@ -6,16 +6,26 @@
 
 #include "btree.h"
 #include "common.h"
+#include "hash_index.h"
 #include "hash_table.h"
+#include "learned.h"
 #include "message.h"
 #include "queue.h"
 #include "sorted.h"
 #include "vector.h"
 
+// Columns are stored in segments of COLUMN_SEGMENT_SIZE values, so that a writer only copies the
+// segments it overwrites.
+#define COLUMN_SEGMENT_BITS 14
+#define COLUMN_SEGMENT_SIZE (1u << COLUMN_SEGMENT_BITS)
+#define COLUMN_SEGMENT_MASK (COLUMN_SEGMENT_SIZE - 1)
+
 typedef struct Db Db;
 typedef struct Table Table;
+typedef struct TableVersion TableVersion;
 typedef struct Column Column;
 typedef struct ColumnIndex ColumnIndex;
+typedef struct IndexBuild IndexBuild;
 
 /**
  * Db
@@ -50,41 +60,120 @@ struct Table {
     Column *columns;
     unsigned int columns_count;
     unsigned int columns_capacity;
-    unsigned int rows_count;
-    Queue delete_queue;
-    BoolVector *deleted_rows;
+    // Rows as last published by a writer.
+    TableVersion *version;
+    // Serializes writers. Readers never take it.
     pthread_rwlock_t rwlock;
+    // The fields below belong to the writer holding the lock. Rows it is changing are kept in
+    // pending until published, and the data and indexes they replace are retired once they are.
+    TableVersion *pending;
+    Vector retired;
+    Vector retired_indexes;
+    unsigned int segments_capacity;
+    unsigned int changes_capacity;
+    // Changes to rows from this position onwards are not logged, as no index holds them.
+    unsigned int indexed_count;
+    // Changes logged before this one were made by earlier writes, or before the indexes were last
+    // rebuilt, so rows they changed are logged again if changed.
+    unsigned int changes_logged;
+    // Rows before this position are in the order of the clustered index. Rows after it were
+    // appended or rewritten since and are sorted in by the next load.
+    unsigned int clustered_count;
+    Queue delete_queue;
+    // Inserts waiting for the write lock. One inserter at a time takes every insert queued so far
+    // and commits them together, while the others wait for theirs to be done.
+    pthread_mutex_t inserts_mutex;
+    pthread_cond_t inserts_cond;
+    Vector inserts;
+    bool inserting;
     Db *db;
     Table *next;
 };
 
+// Rows of a table at one point in time, which never change once published. Readers scan and probe
+// the version they loaded without any lock, while a writer copies the segments it overwrites into
+// the next version. Rows and changes are only appended in place, past the end of every published
+// version.
+struct TableVersion {
+    unsigned int rows_count;
+    unsigned int values_count;
+    // Segments of every column, in column order.
+    int ***columns;
+    // Segments of flags of deleted rows, NULL until a row is first deleted.
+    bool **deleted_rows;
+    // Times rows of the table were moved to other positions, by vacuums or by clustering.
+    unsigned int moves;
+    // Indexes of every column, in column order, NULL for columns without one. Indexes never change
+    // once published: writers log the rows they change instead, and readers take those from the
+    // table until the indexes are rebuilt.
+    ColumnIndex **indexes;
+    // Segments of the number of changes logged up to the last change of every row, 0 for rows that
+    // did not change. NULL until a row changes.
+    unsigned int **changed_rows;
+    // Positions of the rows changed, one per change, for the changes from changes_start up to
+    // changes_count.
+    unsigned int *changes;
+    unsigned int changes_start;
+    unsigned int changes_count;
+};
+
 struct Column {
     char *name;
     unsigned int order;
-    IntVector values;
+    // Index of the last version written, set by writers under the table lock and loaded atomically
+    // by readers to choose how to read. Readers probe the index of the version they read.
     ColumnIndex *index;
+    // Set while an index is built for the column without blocking writers.
+    IndexBuild *index_build;
     Table *table;
 };
 
 typedef enum ColumnIndexType {
-    BTREE, SORTED
+    BTREE, SORTED, HASHED, LEARNED
 } ColumnIndexType;
 
 typedef union IndexFields {
     BTreeIndex btree;
     SortedIndex sorted;
+    HashIndex hash;
+    LearnedIndex learned;
 } IndexFields;
 
+// A clustered index keeps the rows of its table physically sorted by its column, so its positions
+// are plain row positions like those of any other index. Indexes hold the rows_count live rows
+// before indexed_count as they were after the first changes_count changes to the table, sorted by
+// value and then by position.
 struct ColumnIndex {
     ColumnIndexType type;
     bool clustered;
     IndexFields fields;
-    PosVector *clustered_positions;
-    IntVector *clustered_columns;
-    unsigned int num_columns;
+    unsigned int rows_count;
+    unsigned int indexed_count;
+    unsigned int changes_count;
     Column *column;
 };
 
+// An index built from a snapshot of its table without blocking writers. The changes made since
+// the snapshot are kept logged until the index is published.
+struct IndexBuild {
+    unsigned int changes_count;
+};
+
+// Values an operator reads segment by segment, either of a column in the version of its table
+// published when the read started, or of a variable, whose values are split alike.
+typedef struct ColumnReader {
+    int **segments;
+    // Segments of flags of deleted rows, NULL if no row is deleted.
+    bool **deleted_rows;
+    unsigned int values_count;
+    unsigned int rows_count;
+    unsigned int moves;
+    // Index of the column in the version read, if the reader probes it.
+    ColumnIndex *index;
+    TableVersion *version;
+    Table *table;
+} ColumnReader;
+
 void db_manager_startup();
 void db_manager_shutdown();
 
@@ -92,8 +181,74 @@ void db_create(char *name, Message *send_message);
 void table_create(char *name, char *db_name, unsigned int num_columns, Message *send_message);
 void column_create(char *name, char *table_fqn, Message *send_message);
 void index_create(char *column_fqn, ColumnIndexType type, bool clustered, Message *send_message);
-void index_rebuild(ColumnIndex *index);
-void index_rebuild_all(Table *table);
+ColumnIndex *table_clustered_index(Table *table);
+
+/**
+ * Starts reading a column without blocking writers. If index is set, the reader probes the index
+ * of the column in the version it reads.
+ */
+void column_reader_open(ColumnReader *reader, Column *column, ColumnIndex *index);
+
+/**
+ * Selects the rows of a reader whose values are >= low if has_low and < high if has_high, through
+ * its index. Rows changed or appended since the index was built are read from the table. Returns
+ * the number of positions written to result, which has room for rows_count of them, ordered by
+ * value and then by position.
+ */
+unsigned int column_reader_index_select(ColumnReader *reader, bool has_low, int low,
+        bool has_high, int high, unsigned int *result);
+
+/**
+ * Finds the smallest or largest value of the rows of a reader through its index, and its position.
+ * Returns false if the rows have to be scanned instead, as the index holds no current extremum.
+ */
+bool column_reader_index_min(ColumnReader *reader, int *value_ptr, unsigned int *position_ptr);
+bool column_reader_index_max(ColumnReader *reader, int *value_ptr, unsigned int *position_ptr);
+
+/**
+ * Starts reading the values of a variable like those of a column.
+ */
+void column_reader_open_values(ColumnReader *reader, int *values, unsigned int values_count);
+
+void column_reader_close(ColumnReader *reader);
+
+/**
+ * Starts changing the rows of a table whose write lock is held. Readers see none of the changes
+ * until table_write_commit publishes them all at once.
+ */
+void table_write_begin(Table *table);
+void table_write_commit(Table *table);
+
+/**
+ * Appends count rows to the table being written, returning the position of the first one. Their
+ * values are set by the caller.
+ */
+unsigned int table_rows_append(Table *table, unsigned int count);
+
+/**
+ * Drops the rows of the table being written from position count onwards, which must all be
+ * deleted. They are removed from the delete queue by the caller.
+ */
+void table_rows_truncate(Table *table, unsigned int count);
+
+/**
+ * Rebuilds the indexes of the table being written that do not hold every row as written. If
+ * cluster is set, the rows appended or rewritten since the last load are first sorted into the
+ * clustered order, which may move rows.
+ */
+void table_delta_merge(Table *table, bool cluster);
+
+bool table_row_deleted(Table *table, unsigned int position);
+void table_row_delete(Table *table, unsigned int position);
+void table_row_restore(Table *table, unsigned int position);
+
+/**
+ * Reads and writes values as seen by the writer of the table. Changes to rows held by indexes are
+ * logged, as are deletes and restores.
+ */
+int column_value(Column *column, unsigned int position);
+void column_value_set(Column *column, unsigned int position, int value);
+void column_values_set(Column *column, unsigned int start, int *values, unsigned int count);
 
 Db *db_lookup(char *db_name);
 Table *table_lookup(char *table_fqn);
@@ -80,7 +80,12 @@ typedef struct FetchOperator {
  */
 typedef struct RelationalInsertOperator {
     char *table_fqn;
+    // Values of the rows, one row after the other.
     IntVector values;
+    unsigned int columns_count;
+    unsigned int rows_count;
+    // Set if the rows are sent in binary after the query, and received by the server.
+    bool framed;
 } RelationalInsertOperator;
 
 typedef struct RelationalDeleteOperator {
@@ -94,12 +99,20 @@ typedef struct RelationalUpdateOperator {
     int value;
 } RelationalUpdateOperator;
 
+typedef struct VacuumOperator {
+    char *table_fqn;
+} VacuumOperator;
+
 typedef struct JoinOperator {
     JoinType type;
     char *val_var1;
     char *pos_var1;
     char *val_var2;
     char *pos_var2;
+    Comparator band;
+    // Variable holding the high ends of the intervals of interval joins, whose low ends are in
+    // val_var2.
+    char *high_var2;
     char *pos_out_var1;
     char *pos_out_var2;
 } JoinOperator;
@@ -169,6 +182,7 @@ typedef enum OperatorType {
     RELATIONAL_INSERT,
 	RELATIONAL_DELETE,
 	RELATIONAL_UPDATE,
+	VACUUM,
 	JOIN,
 	MIN,
     MIN_POS,
@@ -199,6 +213,7 @@ typedef union OperatorFields {
     RelationalInsertOperator relational_insert;
     RelationalDeleteOperator relational_delete;
     RelationalUpdateOperator relational_update;
+    VacuumOperator vacuum;
     JoinOperator join;
     MinOperator min;
     MinPosOperator min_pos;
@@ -9,7 +9,7 @@
 #include "vector.h"
 
 typedef enum JoinType {
-    HASH, NESTED_LOOP, SORT_MERGE
+    HASH, NESTED_LOOP, SORT_MERGE, SEMI, BAND, BAND_COUNT, INTERVAL, INTERVAL_COUNT
 } JoinType;
 
 typedef struct Comparator {
@@ -41,15 +41,26 @@ void dsl_select_pos(ClientContext *client_context, char *pos_var, char *val_var,
 void dsl_fetch(ClientContext *client_context, char *column_fqn, char *pos_var, char *val_out_var,
         Message *send_message);
 
-void dsl_relational_insert(char *table_fqn, IntVector *values, Message *send_message);
+/**
+ * Inserts rows_count rows, whose values are stored one row after the other. Inserts into a table
+ * made concurrently are committed together under a single write.
+ */
+void dsl_relational_insert(char *table_fqn, int *values, unsigned int rows_count,
+        unsigned int columns_count, Message *send_message);
 void dsl_relational_delete(ClientContext *client_context, char *table_fqn, char *pos_var,
         Message *send_message);
 void dsl_relational_update(ClientContext *client_context, char *column_fqn, char *pos_var,
         int value, Message *send_message);
 
+/**
+ * Moves rows of the table into the slots of deleted rows and drops the deleted rows, so that
+ * scans skip them. The positions of moved rows change.
+ */
+void dsl_vacuum(char *table_fqn, Message *send_message);
+
 void dsl_join(ClientContext *client_context, JoinType type, char *val_var1, char *pos_var1,
-        char *val_var2, char *pos_var2, char *pos_out_var1, char *pos_out_var2,
-        Message *send_message);
+        char *val_var2, char *pos_var2, Comparator *band, char *high_var2, char *pos_out_var1,
+        char *pos_out_var2, Message *send_message);
 
 void dsl_min(ClientContext *client_context, GeneralizedColumnHandle *col_hdl, char *val_out_var,
         Message *send_message);
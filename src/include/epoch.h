@@ -0,0 +1,26 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+/**
+ * Marks the calling thread as reading shared data, which writers may unlink and retire meanwhile.
+ * Pointers to such data must be loaded with sequentially consistent loads after entering. Calls
+ * may be nested.
+ */
+void epoch_enter();
+
+/**
+ * Ends the read started by the matching epoch_enter.
+ */
+void epoch_exit();
+
+/**
+ * Calls routine(ptr) once no thread that may have loaded ptr before it was unlinked still reads.
+ */
+void epoch_retire(void *ptr, void (*routine)(void *));
+
+/**
+ * Frees everything retired so far. No thread may read shared data anymore.
+ */
+void epoch_shutdown();
+
+#endif /* EPOCH_H */
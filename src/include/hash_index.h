@@ -0,0 +1,49 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct HashIndexSlot {
+    int value;
+    // Number of positions holding value, 0 for an empty slot.
+    unsigned int count;
+    // A single position is stored inline. Longer runs are kept in insertion order, in an
+    // array whose capacity is count rounded up to a power of two.
+    union {
+        unsigned int position;
+        unsigned int *positions;
+    } run;
+} HashIndexSlot;
+
+typedef struct HashIndex {
+    HashIndexSlot *slots;
+    unsigned int num_slots;
+    unsigned int num_keys;
+    unsigned int size;
+} HashIndex;
+
+void hash_index_init(HashIndex *index, int *values, unsigned int *positions, unsigned int size);
+void hash_index_destroy(HashIndex *index);
+
+/**
+ * Inserts a batch of values into the index. The batch does not need to be sorted.
+ */
+void hash_index_merge(HashIndex *index, int *values, unsigned int *positions, unsigned int size);
+
+bool hash_index_save(HashIndex *index, FILE *file);
+bool hash_index_load(HashIndex *index, FILE *file);
+
+void hash_index_insert(HashIndex *index, int value, unsigned int position);
+bool hash_index_remove(HashIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr);
+
+bool hash_index_search(HashIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr);
+
+/**
+ * Writes the positions holding value to result, returning their count.
+ */
+unsigned int hash_index_select(HashIndex *index, int value, unsigned int *result);
+
+#endif /* HASH_INDEX_H */
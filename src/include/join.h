@@ -1,15 +1,70 @@
 #ifndef JOIN_H
 #define JOIN_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "vector.h"
 
-void join_hash(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
+/**
+ * Sets the peak memory, in bytes, a hash join may use before spilling partitions to disk.
+ * A budget of 0 keeps every join in memory. The budget covers copies of the inputs and hash
+ * tables, but not the output vectors, nor the cross products of keys the join treats as hot.
+ */
+void join_set_memory_budget(size_t bytes);
+
+/**
+ * Returns false, leaving the outputs partly filled, if the result would hold more pairs than
+ * positions can count.
+ */
+bool join_hash(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
         unsigned int *positions2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2);
 
 void join_nested_loop(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
         unsigned int *positions2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2);
 
-void join_sort_merge(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
-        unsigned int *positions2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2);
+void join_sort_merge(int *values1, unsigned int *positions1, unsigned int count1, bool sorted1,
+        int *values2, unsigned int *positions2, unsigned int count2, bool sorted2,
+        PosVector *pos_out1, PosVector *pos_out2);
+
+/**
+ * Bound for join_band and join_band_count that no difference between two ints can reach.
+ */
+#define BAND_UNBOUNDED ((long long int) 1 << 32)
+
+/**
+ * Joins pairs where low <= value2 - value1 < high, by sorting both sides and sweeping a window.
+ */
+void join_band(int *values1, unsigned int *positions1, unsigned int count1, bool sorted1,
+        int *values2, unsigned int *positions2, unsigned int count2, bool sorted2,
+        long long int low, long long int high, PosVector *pos_out1, PosVector *pos_out2);
+
+/**
+ * Counts the pairs join_band would produce without materializing them.
+ */
+unsigned long long int join_band_count(int *values1, unsigned int *positions1,
+        unsigned int count1, bool sorted1, int *values2, unsigned int *positions2,
+        unsigned int count2, bool sorted2, long long int low, long long int high);
+
+/**
+ * Joins pairs where low2 <= value1 < high2, the second side holding intervals given by their ends.
+ * The values are sorted, and swept with the intervals open at each of them.
+ */
+void join_interval(int *values1, unsigned int *positions1, unsigned int count1, bool sorted1,
+        int *lows2, int *highs2, unsigned int *positions2, unsigned int count2,
+        PosVector *pos_out1, PosVector *pos_out2);
+
+/**
+ * Counts the pairs join_interval would produce without materializing them.
+ */
+unsigned long long int join_interval_count(int *values1, unsigned int *positions1,
+        unsigned int count1, bool sorted1, int *lows2, int *highs2, unsigned int count2);
+
+/**
+ * Returns the positions of the first side whose values appear in the second side, in the order of
+ * the first side.
+ */
+void join_semi(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
+        unsigned int count2, PosVector *pos_out1);
 
 #endif /* JOIN_H */
@@ -0,0 +1,64 @@
+#ifndef LEARNED_H
+#define LEARNED_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "vector.h"
+
+// Linear model predicting the rank of the first entry >= a value, for values from key up to the
+// key of the next segment.
+typedef struct LearnedSegment {
+    int key;
+    unsigned int start;
+    double slope;
+} LearnedSegment;
+
+typedef struct LearnedIndex {
+    // Sorted base array, and a piecewise linear model of it whose predictions are off by at most
+    // LEARNED_EPSILON entries.
+    IntVector values;
+    PosVector positions;
+    LearnedSegment *segments;
+    unsigned int num_segments;
+    // Inserts go to a small sorted delta buffer, and removed base entries are only flagged, by
+    // rank. Both are applied to the base array and the model refitted when either grows too
+    // large, on merges and on rebuilds.
+    IntVector delta_values;
+    PosVector delta_positions;
+    bool *removed;
+    unsigned int removed_count;
+} LearnedIndex;
+
+void learned_init(LearnedIndex *index, int *values, unsigned int *positions, unsigned int size);
+void learned_destroy(LearnedIndex *index);
+
+/**
+ * Merges a batch sorted by value into the index, refitting the model.
+ */
+void learned_merge(LearnedIndex *index, int *values, unsigned int *positions, unsigned int size);
+
+bool learned_save(LearnedIndex *index, FILE *file);
+bool learned_load(LearnedIndex *index, FILE *file);
+
+void learned_insert(LearnedIndex *index, int value, unsigned int position);
+bool learned_remove(LearnedIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr);
+
+/**
+ * Removes every entry for which removed(data, position) is true, in a single pass, then refits
+ * the model once.
+ */
+void learned_remove_if(LearnedIndex *index, bool (*removed)(void *, unsigned int), void *data);
+
+bool learned_search(LearnedIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr);
+
+unsigned int learned_select_lower(LearnedIndex *index, int high, unsigned int *result);
+unsigned int learned_select_higher(LearnedIndex *index, int low, unsigned int *result);
+unsigned int learned_select_range(LearnedIndex *index, int low, int high, unsigned int *result);
+
+int learned_min(LearnedIndex *index, unsigned int *position_ptr);
+int learned_max(LearnedIndex *index, unsigned int *position_ptr);
+
+#endif /* LEARNED_H */
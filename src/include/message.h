@@ -24,9 +24,13 @@
     ENUM(COLUMN_ALREADY_EXISTS) \
     ENUM(COLUMN_NOT_FOUND) \
     ENUM(INDEX_ALREADY_EXISTS) \
+    ENUM(CLUSTERED_INDEX_ALREADY_EXISTS) \
     ENUM(VARIABLE_NOT_FOUND) \
     ENUM(WRONG_VARIABLE_TYPE) \
     ENUM(TUPLE_COUNT_MISMATCH) \
+    ENUM(POSITIONS_OUT_OF_RANGE) \
+    ENUM(POSITIONS_OUT_OF_DATE) \
+    ENUM(JOIN_RESULT_TOO_LARGE) \
     ENUM(EMPTY_VECTOR) \
     ENUM(NO_SELECT_CONDITION) \
     ENUM(INSERT_COLUMNS_MISMATCH) \
@@ -4,15 +4,12 @@
 #include <stdbool.h>
 #include <stdio.h>
 
-typedef struct QueueNode {
-    unsigned int value;
-    struct QueueNode *next;
-} QueueNode;
-
+// Ring buffer of values, whose capacity is a power of two.
 typedef struct Queue {
-    QueueNode *head;
-    QueueNode *tail;
+    unsigned int *values;
+    unsigned int head;
     unsigned int size;
+    unsigned int capacity;
 } Queue;
 
 void queue_init(Queue *q);
@@ -0,0 +1,15 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+
+#include "utils.h"
+
+/**
+ * Sorts an array of integers in ascending order, and stores the indices corresponding to the original array.
+ * The sort is stable, runs on multiple threads for large inputs, and may be done in place.
+ */
+void radix_sort_indices(int *values_in, unsigned int *indices_in, int *values_out,
+        unsigned int *indices_out, size_t size);
+
+#endif /* SORT_H */
@@ -7,13 +7,42 @@
 #include "vector.h"
 
 typedef struct SortedIndex {
-    IntVector values;
-    PosVector positions;
+    // Packed-memory array: entries live in fixed size segments, each packed to the left and
+    // followed by a gap, so inserts and removes only shift within one segment between rebalances.
+    // Every segment holds at least one entry unless the index is empty.
+    int *values;
+    unsigned int *positions;
+    unsigned int *counts;
+    unsigned int num_segments;
+    unsigned int size;
+    // First value of every segment, in Eytzinger (BFS) order and padded to a perfect tree.
+    // Searches walk it to find the segment holding a key.
+    int *tree;
+    unsigned int tree_size;
+    // Optional map from positions to slots, so removes don't scan every duplicate of a value.
+    // Slots of removed positions are stale and are validated before use.
+    unsigned int *slots;
+    unsigned int slots_capacity;
 } SortedIndex;
 
 void sorted_init(SortedIndex *index, int *values, unsigned int *positions, unsigned int size);
 void sorted_destroy(SortedIndex *index);
 
+/**
+ * Merges a batch sorted by value into the index.
+ */
+void sorted_merge(SortedIndex *index, int *values, unsigned int *positions, unsigned int size);
+
+/**
+ * Removes every entry for which removed(data, position) is true, in a single pass.
+ */
+void sorted_remove_if(SortedIndex *index, bool (*removed)(void *, unsigned int), void *data);
+
+/**
+ * Builds the map from positions to slots, if not built already. Every write keeps it current.
+ */
+void sorted_track_positions(SortedIndex *index);
+
 bool sorted_save(SortedIndex *index, FILE *file);
 bool sorted_load(SortedIndex *index, FILE *file);
 
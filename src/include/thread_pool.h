@@ -0,0 +1,47 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+// Tasks forked into a group, which have not finished yet.
+typedef struct ThreadPoolGroup {
+    unsigned int pending;
+} ThreadPoolGroup;
+
+/**
+ * Starts the server-wide worker threads. A count of 0 starts one per core.
+ */
+void thread_pool_startup(unsigned int threads_count);
+
+/**
+ * Finishes all queued work and stops the worker threads.
+ */
+void thread_pool_shutdown();
+
+/**
+ * Returns the number of worker threads, or 1 if the pool was not started.
+ */
+unsigned int thread_pool_size();
+
+void thread_pool_group_init(ThreadPoolGroup *group);
+
+/**
+ * Queues routine(arg) as a task of group, for this thread to run later or for an idle worker to
+ * steal. Without a started pool, it runs right away.
+ */
+void thread_pool_fork(ThreadPoolGroup *group, void *(*routine)(void *), void *arg);
+
+/**
+ * Returns once all tasks forked into group finished, running queued tasks of the group meanwhile,
+ * but no others, so that the caller may hold locks those take. Tasks may fork and join groups of
+ * their own, and fork more tasks into group from any thread.
+ */
+void thread_pool_join(ThreadPoolGroup *group);
+
+/**
+ * Calls routine on each of count tasks, laid out task_size bytes apart from tasks, and returns
+ * once all calls returned. The first task runs on the calling thread.
+ */
+void thread_pool_run(void *(*routine)(void *), void *tasks, size_t task_size, unsigned int count);
+
+#endif /* THREAD_POOL_H */
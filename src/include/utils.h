@@ -14,17 +14,13 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "vector.h"
+
 typedef struct Record {
     int value;
     unsigned int position;
 } Record;
 
-/**
- * Sorts an array of integers in ascending order, and stores the indices corresponding to the original array.
- */
-void radix_sort_indices(int *values_in, unsigned int *indices_in, int *values_out,
-        unsigned int *indices_out, size_t size);
-
 /**
  * Binary searches through a sorted array of values, returning the position of the left-most
  * element that is >= value.
@@ -77,6 +73,13 @@ char *strip_whitespace(char *str);
  */
 char *strip_quotes(char *str);
 
+/**
+ * Parses comma separated tuples of integers of the form (1,2),(3,4) (in place), appending their
+ * values to values. Returns the number of values per tuple, or 0 if the tuples are malformed or
+ * differ in size.
+ */
+unsigned int parse_int_tuples(char *str, IntVector *values);
+
 /**
  * Checks if a string is a valid database/table/column/variable name.
  */
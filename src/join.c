@@ -1,11 +1,40 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "join.h"
+#include "sort.h"
+#include "thread_pool.h"
 #include "utils.h"
 #include "vector.h"
 
 #define RADIX_THRESHOLD 134217728
 
+#define DENSE_RANGE_FACTOR 2
+#define SEMI_BITMAP_RANGE_FACTOR 64
+
+#define SKEW_MIN_COUNT 65536
+#define SKEW_SAMPLE_SIZE 4096
+// Sides sampled less than this are too small to tell hot keys apart from chance repeats.
+#define SKEW_MIN_SAMPLE 1024
+#define SKEW_HOT_FRACTION 64
+#define SKEW_MAX_HOT_KEYS 64
+#define SKEW_TASK_SIZE 262144
+
+#define GRACE_FANOUT 0x100
+#define GRACE_BLOCK_SIZE 65536
+#define GRACE_BUFFER_SIZE 1024
+
 #define NESTED_BLOCK_SIZE 32768
 
+static size_t join_memory_budget = 0;
+
+void join_set_memory_budget(size_t bytes) {
+    join_memory_budget = bytes;
+}
+
 static inline void radix_probe(unsigned int *table, unsigned int *counts, unsigned int *offsets,
         int *values2, unsigned int *positions2, unsigned int count2, PosVector *pos_out1,
         PosVector *pos_out2) {
@@ -240,8 +269,347 @@ static inline void join_hash_static_count(int *values1, unsigned int *positions1
     }
 }
 
-void join_hash(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
+// Finds the key range of a side, returning false if the range spans more than factor slots per
+// value.
+static inline bool dense_range(int *values, unsigned int count, unsigned int factor, int *min_out,
+        unsigned int *range_out) {
+    int min = values[0];
+    int max = values[0];
+    for (unsigned int i = 1; i < count; i++) {
+        int value = values[i];
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+
+    long long int range = (long long int) max - min + 1;
+    if (range > (long long int) count * factor || range > UINT_MAX) {
+        return false;
+    }
+
+    *min_out = min;
+    *range_out = range;
+    return true;
+}
+
+static inline void direct_address_probe(unsigned int *table, unsigned int *counts,
+        unsigned int *offsets, int min, unsigned int range, int *values2,
         unsigned int *positions2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2) {
+    for (unsigned int i = 0; i < count2; i++) {
+        // Keys below the minimum wrap around past the range.
+        unsigned int key = (unsigned int) values2[i] - (unsigned int) min;
+        if (key >= range) {
+            continue;
+        }
+
+        unsigned int count = counts[key];
+        if (count > 0) {
+            unsigned int pos2 = positions2[i];
+
+            unsigned int start = offsets[key];
+            unsigned int end = start + count;
+            for (unsigned int j = start; j < end; j++) {
+                pos_vector_append(pos_out1, table[j]);
+                pos_vector_append(pos_out2, pos2);
+            }
+        }
+    }
+}
+
+static inline bool direct_address_build(int *values1, unsigned int *positions1,
+        unsigned int count1, int *values2, unsigned int *positions2, unsigned int count2,
+        PosVector *pos_out1, PosVector *pos_out2) {
+    int min;
+    unsigned int range;
+    if (!dense_range(values1, count1, DENSE_RANGE_FACTOR, &min, &range)) {
+        return false;
+    }
+
+    unsigned int *counts = calloc(range, sizeof(unsigned int));
+    for (unsigned int i = 0; i < count1; i++) {
+        counts[(unsigned int) values1[i] - (unsigned int) min]++;
+    }
+
+    unsigned int *offsets = malloc(range * sizeof(unsigned int));
+    unsigned int *ends = malloc(range * sizeof(unsigned int));
+    unsigned int accum = 0;
+    for (unsigned int i = 0; i < range; i++) {
+        offsets[i] = ends[i] = accum;
+        accum += counts[i];
+    }
+
+    unsigned int *table = malloc(count1 * sizeof(unsigned int));
+    for (unsigned int i = 0; i < count1; i++) {
+        table[ends[(unsigned int) values1[i] - (unsigned int) min]++] = positions1[i];
+    }
+
+    free(ends);
+
+    direct_address_probe(table, counts, offsets, min, range, values2, positions2, count2,
+            pos_out1, pos_out2);
+
+    free(counts);
+    free(offsets);
+
+    free(table);
+
+    return true;
+}
+
+// Joins by indexing directly with key - min when the smaller side's keys are dense.
+static inline bool join_hash_direct(int *values1, unsigned int *positions1, unsigned int count1,
+        int *values2, unsigned int *positions2, unsigned int count2, PosVector *pos_out1,
+        PosVector *pos_out2) {
+    if (count1 <= count2) {
+        return direct_address_build(values1, positions1, count1, values2, positions2, count2,
+                pos_out1, pos_out2);
+    } else {
+        return direct_address_build(values2, positions2, count2, values1, positions1, count1,
+                pos_out2, pos_out1);
+    }
+}
+
+// Estimates the memory needed by an in-memory hash join, including copies of both inputs.
+static inline size_t hash_join_memory(unsigned int count1, unsigned int count2) {
+    size_t build = count1 <= count2 ? count1 : count2;
+    return ((size_t) count1 + count2) * sizeof(Record) + build * 8 * sizeof(unsigned int);
+}
+
+// Records of a join input, either in memory or in a region of a spill file.
+typedef struct GraceSource {
+    int *values;
+    unsigned int *positions;
+    int fd;
+    off_t start;
+    unsigned int count;
+} GraceSource;
+
+static inline bool grace_read(GraceSource *source, unsigned int offset, Record *block,
+        unsigned int size) {
+    if (source->fd < 0) {
+        for (unsigned int i = 0; i < size; i++) {
+            block[i].value = source->values[offset + i];
+            block[i].position = source->positions[offset + i];
+        }
+        return true;
+    }
+
+    size_t bytes = size * sizeof(Record);
+    off_t file_offset = (source->start + offset) * sizeof(Record);
+    return pread(source->fd, block, bytes, file_offset) == (ssize_t) bytes;
+}
+
+static inline bool grace_write(int fd, off_t start, Record *records, unsigned int size) {
+    size_t bytes = size * sizeof(Record);
+    if (pwrite(fd, records, bytes, start * sizeof(Record)) != (ssize_t) bytes) {
+        log_err("Unable to write join partition\n");
+        return false;
+    }
+    return true;
+}
+
+// Scatters a source into contiguous partitions of a spill file, one per value of the byte at
+// shift. Each partition is written through its own buffer in large sequential blocks.
+static bool grace_partition(GraceSource *source, unsigned int shift, Record *block, int fd,
+        unsigned int *counts, off_t *starts) {
+    memset(counts, 0, GRACE_FANOUT * sizeof(unsigned int));
+    for (unsigned int i = 0; i < source->count; i += GRACE_BLOCK_SIZE) {
+        unsigned int size = source->count - i < GRACE_BLOCK_SIZE ? source->count - i
+                : GRACE_BLOCK_SIZE;
+        if (!grace_read(source, i, block, size)) {
+            log_err("Unable to read join partition\n");
+            return false;
+        }
+        for (unsigned int j = 0; j < size; j++) {
+            counts[(block[j].value >> shift) & 0xFF]++;
+        }
+    }
+
+    off_t ends[GRACE_FANOUT];
+    off_t accum = 0;
+    for (unsigned int i = 0; i < GRACE_FANOUT; i++) {
+        starts[i] = ends[i] = accum;
+        accum += counts[i];
+    }
+
+    bool success = true;
+
+    Record *buffers = malloc(GRACE_FANOUT * GRACE_BUFFER_SIZE * sizeof(Record));
+    unsigned int fill[GRACE_FANOUT] = { 0 };
+
+    for (unsigned int i = 0; success && i < source->count; i += GRACE_BLOCK_SIZE) {
+        unsigned int size = source->count - i < GRACE_BLOCK_SIZE ? source->count - i
+                : GRACE_BLOCK_SIZE;
+        if (!grace_read(source, i, block, size)) {
+            log_err("Unable to read join partition\n");
+            success = false;
+            break;
+        }
+        for (unsigned int j = 0; j < size; j++) {
+            unsigned int partition = (block[j].value >> shift) & 0xFF;
+            Record *buffer = buffers + partition * GRACE_BUFFER_SIZE;
+
+            buffer[fill[partition]++] = block[j];
+            if (fill[partition] == GRACE_BUFFER_SIZE) {
+                if (!grace_write(fd, ends[partition], buffer, GRACE_BUFFER_SIZE)) {
+                    success = false;
+                    break;
+                }
+                ends[partition] += GRACE_BUFFER_SIZE;
+                fill[partition] = 0;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; success && i < GRACE_FANOUT; i++) {
+        if (fill[i] > 0) {
+            success = grace_write(fd, ends[i], buffers + i * GRACE_BUFFER_SIZE, fill[i]);
+        }
+    }
+
+    free(buffers);
+
+    return success;
+}
+
+static inline bool grace_load(int fd, off_t start, unsigned int count, int **values,
+        unsigned int **positions) {
+    Record *records = malloc(count * sizeof(Record));
+    size_t bytes = count * sizeof(Record);
+    if (pread(fd, records, bytes, start * sizeof(Record)) != (ssize_t) bytes) {
+        log_err("Unable to read join partition\n");
+        free(records);
+        return false;
+    }
+
+    *values = malloc(count * sizeof(int));
+    *positions = malloc(count * sizeof(unsigned int));
+    for (unsigned int i = 0; i < count; i++) {
+        (*values)[i] = records[i].value;
+        (*positions)[i] = records[i].position;
+    }
+
+    free(records);
+    return true;
+}
+
+// Joins a pair of partitions in memory.
+static bool grace_join_partition(int fd1, off_t start1, unsigned int count1, int fd2,
+        off_t start2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2) {
+    int *values1;
+    unsigned int *positions1;
+    if (!grace_load(fd1, start1, count1, &values1, &positions1)) {
+        return false;
+    }
+
+    int *values2;
+    unsigned int *positions2;
+    if (!grace_load(fd2, start2, count2, &values2, &positions2)) {
+        free(values1);
+        free(positions1);
+        return false;
+    }
+
+    if (count1 <= count2) {
+        static_count_build(values1, positions1, count1, values2, positions2, count2, pos_out1,
+                pos_out2);
+    } else {
+        static_count_build(values2, positions2, count2, values1, positions1, count1, pos_out2,
+                pos_out1);
+    }
+
+    free(values1);
+    free(positions1);
+
+    free(values2);
+    free(positions2);
+
+    return true;
+}
+
+// Partitions both sides to temporary files on the byte at shift, then joins each pair of
+// partitions that fits the memory budget, recursing on the next byte for those that do not.
+static bool grace_join(GraceSource *source1, GraceSource *source2, unsigned int shift,
+        Record *block, PosVector *pos_out1, PosVector *pos_out2) {
+    FILE *file1 = tmpfile();
+    FILE *file2 = tmpfile();
+    if (file1 == NULL || file2 == NULL) {
+        log_err("Unable to create join partition files\n");
+        if (file1 != NULL) {
+            fclose(file1);
+        }
+        if (file2 != NULL) {
+            fclose(file2);
+        }
+        return false;
+    }
+
+    int fd1 = fileno(file1);
+    int fd2 = fileno(file2);
+
+    unsigned int counts1[GRACE_FANOUT];
+    off_t starts1[GRACE_FANOUT];
+    unsigned int counts2[GRACE_FANOUT];
+    off_t starts2[GRACE_FANOUT];
+
+    bool success = grace_partition(source1, shift, block, fd1, counts1, starts1)
+            && grace_partition(source2, shift, block, fd2, counts2, starts2);
+
+    for (unsigned int i = 0; success && i < GRACE_FANOUT; i++) {
+        unsigned int count1 = counts1[i];
+        unsigned int count2 = counts2[i];
+
+        if (count1 == 0 || count2 == 0) {
+            continue;
+        }
+
+        // Once every byte has been partitioned on, all keys in a partition are equal.
+        if (shift + 8 >= sizeof(int) * 8
+                || hash_join_memory(count1, count2) <= join_memory_budget) {
+            success = grace_join_partition(fd1, starts1[i], count1, fd2, starts2[i], count2,
+                    pos_out1, pos_out2);
+        } else {
+            GraceSource partition1 = { NULL, NULL, fd1, starts1[i], count1 };
+            GraceSource partition2 = { NULL, NULL, fd2, starts2[i], count2 };
+            success = grace_join(&partition1, &partition2, shift + 8, block, pos_out1, pos_out2);
+        }
+    }
+
+    fclose(file1);
+    fclose(file2);
+
+    return success;
+}
+
+static inline bool join_hash_grace(int *values1, unsigned int *positions1, unsigned int count1,
+        int *values2, unsigned int *positions2, unsigned int count2, PosVector *pos_out1,
+        PosVector *pos_out2) {
+    GraceSource source1 = { values1, positions1, -1, 0, count1 };
+    GraceSource source2 = { values2, positions2, -1, 0, count2 };
+
+    Record *block = malloc(GRACE_BLOCK_SIZE * sizeof(Record));
+    bool success = grace_join(&source1, &source2, 0, block, pos_out1, pos_out2);
+    free(block);
+
+    return success;
+}
+
+static void join_hash_uniform(int *values1, unsigned int *positions1, unsigned int count1,
+        int *values2, unsigned int *positions2, unsigned int count2, PosVector *pos_out1,
+        PosVector *pos_out2) {
+    if (join_memory_budget > 0 && hash_join_memory(count1, count2) > join_memory_budget) {
+        unsigned int size1 = pos_out1->size;
+        unsigned int size2 = pos_out2->size;
+
+        if (join_hash_grace(values1, positions1, count1, values2, positions2, count2, pos_out1,
+                pos_out2)) {
+            return;
+        }
+
+        // Spilling failed, so fall back to joining in memory.
+        pos_out1->size = size1;
+        pos_out2->size = size2;
+    }
+
     if (count1 >= RADIX_THRESHOLD && count2 >= RADIX_THRESHOLD) {
         join_hash_radix(values1, positions1, count1, values2, positions2, count2, pos_out1, pos_out2);
     } else {
@@ -249,6 +617,251 @@ void join_hash(int *values1, unsigned int *positions1, unsigned int count1, int
     }
 }
 
+// Samples a side and adds keys that fill more than 1 / SKEW_HOT_FRACTION of the sample to the
+// sorted set of hot keys.
+static inline void skew_sample(int *values, unsigned int count, int *hot_keys,
+        unsigned int *hot_count) {
+    unsigned int sample_size = count < SKEW_SAMPLE_SIZE ? count : SKEW_SAMPLE_SIZE;
+    if (sample_size < SKEW_MIN_SAMPLE) {
+        return;
+    }
+
+    unsigned int stride = count / sample_size;
+
+    int sample[SKEW_SAMPLE_SIZE];
+    unsigned int indices[SKEW_SAMPLE_SIZE];
+    for (unsigned int i = 0; i < sample_size; i++) {
+        sample[i] = values[i * stride];
+        indices[i] = i;
+    }
+
+    int sorted_sample[SKEW_SAMPLE_SIZE];
+    unsigned int sorted_indices[SKEW_SAMPLE_SIZE];
+    radix_sort_indices(sample, indices, sorted_sample, sorted_indices, sample_size);
+
+    unsigned int threshold = sample_size / SKEW_HOT_FRACTION;
+    for (unsigned int i = 0; i < sample_size;) {
+        unsigned int j = i + 1;
+        while (j < sample_size && sorted_sample[j] == sorted_sample[i]) {
+            j++;
+        }
+
+        if (j - i > threshold && *hot_count < SKEW_MAX_HOT_KEYS) {
+            int key = sorted_sample[i];
+            unsigned int idx = binary_search_left(hot_keys, *hot_count, key);
+            if (idx == *hot_count || hot_keys[idx] != key) {
+                memmove(hot_keys + idx + 1, hot_keys + idx, (*hot_count - idx) * sizeof(int));
+                hot_keys[idx] = key;
+                (*hot_count)++;
+            }
+        }
+
+        i = j;
+    }
+}
+
+// Moves tuples with hot keys out of a side, grouping their positions by key. The remaining cold
+// tuples are compacted into cold_values and cold_positions.
+static inline unsigned int skew_split(int *values, unsigned int *positions, unsigned int count,
+        int *hot_keys, unsigned int hot_count, unsigned int *hot_offsets,
+        unsigned int *hot_positions, int *cold_values, unsigned int *cold_positions) {
+    unsigned char *keys = malloc(count);
+    unsigned int hot_counts[SKEW_MAX_HOT_KEYS] = { 0 };
+    for (unsigned int i = 0; i < count; i++) {
+        int value = values[i];
+        unsigned int idx = binary_search_left(hot_keys, hot_count, value);
+        keys[i] = idx < hot_count && hot_keys[idx] == value ? idx : SKEW_MAX_HOT_KEYS;
+        if (keys[i] < SKEW_MAX_HOT_KEYS) {
+            hot_counts[idx]++;
+        }
+    }
+
+    unsigned int ends[SKEW_MAX_HOT_KEYS];
+    unsigned int accum = 0;
+    for (unsigned int i = 0; i < hot_count; i++) {
+        hot_offsets[i] = ends[i] = accum;
+        accum += hot_counts[i];
+    }
+    hot_offsets[hot_count] = accum;
+
+    unsigned int cold_count = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (keys[i] < SKEW_MAX_HOT_KEYS) {
+            hot_positions[ends[keys[i]]++] = positions[i];
+        } else {
+            cold_values[cold_count] = values[i];
+            cold_positions[cold_count] = positions[i];
+            cold_count++;
+        }
+    }
+
+    free(keys);
+
+    return cold_count;
+}
+
+typedef struct SkewTask {
+    unsigned int *hot_offsets1;
+    unsigned int *hot_positions1;
+    unsigned int *hot_offsets2;
+    unsigned int *hot_positions2;
+    unsigned int *out_offsets;
+    unsigned int hot_count;
+    unsigned int out_start;
+    unsigned int out_end;
+    unsigned int *out1;
+    unsigned int *out2;
+} SkewTask;
+
+// Writes a range of the hot keys' cross products directly into the outputs. Large ranges are
+// halved, and one half is forked for another thread to steal.
+static void *skew_cross_product_routine(void *arg) {
+    SkewTask *task = arg;
+
+    if (task->out_end - task->out_start > SKEW_TASK_SIZE) {
+        unsigned int middle = task->out_start + (task->out_end - task->out_start) / 2;
+        SkewTask upper = *task;
+        upper.out_start = middle;
+        SkewTask lower = *task;
+        lower.out_end = middle;
+
+        ThreadPoolGroup group;
+        thread_pool_group_init(&group);
+        thread_pool_fork(&group, &skew_cross_product_routine, &upper);
+        skew_cross_product_routine(&lower);
+        thread_pool_join(&group);
+        return NULL;
+    }
+
+    for (unsigned int k = 0; k < task->hot_count; k++) {
+        unsigned int start2 = task->hot_offsets2[k];
+        unsigned int count2 = task->hot_offsets2[k + 1] - start2;
+        unsigned int key_start = task->out_offsets[k];
+        unsigned int key_end = key_start + (task->hot_offsets1[k + 1] - task->hot_offsets1[k])
+                * count2;
+
+        unsigned int out = key_start > task->out_start ? key_start : task->out_start;
+        unsigned int end = key_end < task->out_end ? key_end : task->out_end;
+
+        while (out < end) {
+            unsigned int r = task->hot_offsets1[k] + (out - key_start) / count2;
+            unsigned int s = (out - key_start) % count2;
+            unsigned int pos1 = task->hot_positions1[r];
+
+            for (; s < count2 && out < end; s++, out++) {
+                task->out1[out] = pos1;
+                task->out2[out] = task->hot_positions2[start2 + s];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Handles keys that dominate either side separately: they are joined by emitting their cross
+// products in bulk across threads, and only the remaining tuples go through hashing. Sets overflow
+// and outputs nothing more if the hot keys' cross products cannot be addressed.
+static inline bool join_hash_skewed(int *values1, unsigned int *positions1, unsigned int count1,
+        int *values2, unsigned int *positions2, unsigned int count2, PosVector *pos_out1,
+        PosVector *pos_out2, bool *overflow) {
+    int hot_keys[SKEW_MAX_HOT_KEYS];
+    unsigned int hot_count = 0;
+    skew_sample(values1, count1, hot_keys, &hot_count);
+    skew_sample(values2, count2, hot_keys, &hot_count);
+
+    if (hot_count == 0) {
+        return false;
+    }
+
+    unsigned int hot_offsets1[SKEW_MAX_HOT_KEYS + 1];
+    unsigned int *hot_positions1 = malloc(count1 * sizeof(unsigned int));
+    int *cold_values1 = malloc(count1 * sizeof(int));
+    unsigned int *cold_positions1 = malloc(count1 * sizeof(unsigned int));
+    unsigned int cold_count1 = skew_split(values1, positions1, count1, hot_keys, hot_count,
+            hot_offsets1, hot_positions1, cold_values1, cold_positions1);
+
+    unsigned int hot_offsets2[SKEW_MAX_HOT_KEYS + 1];
+    unsigned int *hot_positions2 = malloc(count2 * sizeof(unsigned int));
+    int *cold_values2 = malloc(count2 * sizeof(int));
+    unsigned int *cold_positions2 = malloc(count2 * sizeof(unsigned int));
+    unsigned int cold_count2 = skew_split(values2, positions2, count2, hot_keys, hot_count,
+            hot_offsets2, hot_positions2, cold_values2, cold_positions2);
+
+    unsigned int out_offsets[SKEW_MAX_HOT_KEYS];
+    unsigned long long int out_count = 0;
+    for (unsigned int k = 0; k < hot_count; k++) {
+        out_offsets[k] = pos_out1->size + out_count;
+        out_count += (unsigned long long int) (hot_offsets1[k + 1] - hot_offsets1[k])
+                * (hot_offsets2[k + 1] - hot_offsets2[k]);
+    }
+
+    if (pos_out1->size + out_count > UINT_MAX) {
+        free(hot_positions1);
+        free(hot_positions2);
+        free(cold_values1);
+        free(cold_positions1);
+        free(cold_values2);
+        free(cold_positions2);
+        *overflow = true;
+        return true;
+    }
+
+    unsigned int total = pos_out1->size + out_count;
+    pos_vector_ensure_capacity(pos_out1, total);
+    pos_vector_ensure_capacity(pos_out2, total);
+
+    SkewTask task;
+    task.hot_offsets1 = hot_offsets1;
+    task.hot_positions1 = hot_positions1;
+    task.hot_offsets2 = hot_offsets2;
+    task.hot_positions2 = hot_positions2;
+    task.out_offsets = out_offsets;
+    task.hot_count = hot_count;
+    task.out_start = pos_out1->size;
+    task.out_end = total;
+    task.out1 = pos_out1->data;
+    task.out2 = pos_out2->data;
+    skew_cross_product_routine(&task);
+
+    pos_out1->size = total;
+    pos_out2->size = total;
+
+    free(hot_positions1);
+    free(hot_positions2);
+
+    if (cold_count1 > 0 && cold_count2 > 0) {
+        join_hash_uniform(cold_values1, cold_positions1, cold_count1, cold_values2,
+                cold_positions2, cold_count2, pos_out1, pos_out2);
+    }
+
+    free(cold_values1);
+    free(cold_positions1);
+
+    free(cold_values2);
+    free(cold_positions2);
+
+    return true;
+}
+
+bool join_hash(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
+        unsigned int *positions2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2) {
+    if (join_hash_direct(values1, positions1, count1, values2, positions2, count2, pos_out1,
+            pos_out2)) {
+        return true;
+    }
+
+    bool overflow = false;
+    if ((count1 >= SKEW_MIN_COUNT || count2 >= SKEW_MIN_COUNT)
+            && join_hash_skewed(values1, positions1, count1, values2, positions2, count2,
+                    pos_out1, pos_out2, &overflow)) {
+        return !overflow;
+    }
+
+    join_hash_uniform(values1, positions1, count1, values2, positions2, count2, pos_out1,
+            pos_out2);
+    return true;
+}
+
 void join_nested_loop(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
         unsigned int *positions2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2) {
     for (unsigned int i = 0; i < count1; i += NESTED_BLOCK_SIZE) {
@@ -279,15 +892,43 @@ void join_nested_loop(int *values1, unsigned int *positions1, unsigned int count
     }
 }
 
-void join_sort_merge(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
-        unsigned int *positions2, unsigned int count2, PosVector *pos_out1, PosVector *pos_out2) {
-    int *sorted_values1 = malloc(count1 * sizeof(int));
-    unsigned int *sorted_positions1 = malloc(count1 * sizeof(unsigned int));
-    radix_sort_indices(values1, positions1, sorted_values1, sorted_positions1, count1);
+// Sorts a join input by value unless it is already ordered, in which case it is used in place.
+// Inputs flagged as sorted are checked anyway, since the flag of a result is not updated when its
+// column is written afterwards.
+static inline void sort_input(int *values, unsigned int *positions, unsigned int count,
+        bool sorted, int **sorted_values, unsigned int **sorted_positions) {
+    for (unsigned int i = 1; sorted && i < count; i++) {
+        sorted = values[i - 1] <= values[i];
+    }
+
+    if (sorted) {
+        *sorted_values = values;
+        *sorted_positions = positions;
+    } else {
+        *sorted_values = malloc(count * sizeof(int));
+        *sorted_positions = malloc(count * sizeof(unsigned int));
+        radix_sort_indices(values, positions, *sorted_values, *sorted_positions, count);
+    }
+}
 
-    int *sorted_values2 = malloc(count2 * sizeof(int));
-    unsigned int *sorted_positions2 = malloc(count2 * sizeof(unsigned int));
-    radix_sort_indices(values2, positions2, sorted_values2, sorted_positions2, count2);
+static inline void free_sorted_input(bool sorted, int *sorted_values,
+        unsigned int *sorted_positions) {
+    if (!sorted) {
+        free(sorted_values);
+        free(sorted_positions);
+    }
+}
+
+void join_sort_merge(int *values1, unsigned int *positions1, unsigned int count1, bool sorted1,
+        int *values2, unsigned int *positions2, unsigned int count2, bool sorted2,
+        PosVector *pos_out1, PosVector *pos_out2) {
+    int *sorted_values1;
+    unsigned int *sorted_positions1;
+    sort_input(values1, positions1, count1, sorted1, &sorted_values1, &sorted_positions1);
+
+    int *sorted_values2;
+    unsigned int *sorted_positions2;
+    sort_input(values2, positions2, count2, sorted2, &sorted_values2, &sorted_positions2);
 
     unsigned int i = 0;
     unsigned int j = 0;
@@ -321,9 +962,244 @@ void join_sort_merge(int *values1, unsigned int *positions1, unsigned int count1
         }
     }
 
-    free(sorted_values1);
-    free(sorted_positions1);
+    free_sorted_input(sorted1, sorted_values1, sorted_positions1);
+    free_sorted_input(sorted2, sorted_values2, sorted_positions2);
+}
+
+// Sweeps the sorted second side with a window [val1 + low, val1 + high) that only moves forward as
+// the sorted first side ascends. Pairs are emitted if the outputs are given, and counted otherwise.
+static inline unsigned long long int band_sweep(int *sorted_values1,
+        unsigned int *sorted_positions1, unsigned int count1, int *sorted_values2,
+        unsigned int *sorted_positions2, unsigned int count2, long long int low,
+        long long int high, PosVector *pos_out1, PosVector *pos_out2) {
+    unsigned long long int matches = 0;
+
+    unsigned int start = 0;
+    unsigned int end = 0;
+    for (unsigned int i = 0; i < count1; i++) {
+        long long int val1 = sorted_values1[i];
+
+        while (start < count2 && sorted_values2[start] < val1 + low) {
+            start++;
+        }
+        end = end > start ? end : start;
+        while (end < count2 && sorted_values2[end] < val1 + high) {
+            end++;
+        }
+
+        matches += end - start;
+
+        if (pos_out1 != NULL) {
+            unsigned int pos1 = sorted_positions1[i];
+            for (unsigned int j = start; j < end; j++) {
+                pos_vector_append(pos_out1, pos1);
+                pos_vector_append(pos_out2, sorted_positions2[j]);
+            }
+        }
+    }
+
+    return matches;
+}
+
+void join_band(int *values1, unsigned int *positions1, unsigned int count1, bool sorted1,
+        int *values2, unsigned int *positions2, unsigned int count2, bool sorted2,
+        long long int low, long long int high, PosVector *pos_out1, PosVector *pos_out2) {
+    int *sorted_values1;
+    unsigned int *sorted_positions1;
+    sort_input(values1, positions1, count1, sorted1, &sorted_values1, &sorted_positions1);
+
+    int *sorted_values2;
+    unsigned int *sorted_positions2;
+    sort_input(values2, positions2, count2, sorted2, &sorted_values2, &sorted_positions2);
+
+    band_sweep(sorted_values1, sorted_positions1, count1, sorted_values2, sorted_positions2,
+            count2, low, high, pos_out1, pos_out2);
+
+    free_sorted_input(sorted1, sorted_values1, sorted_positions1);
+    free_sorted_input(sorted2, sorted_values2, sorted_positions2);
+}
+
+unsigned long long int join_band_count(int *values1, unsigned int *positions1,
+        unsigned int count1, bool sorted1, int *values2, unsigned int *positions2,
+        unsigned int count2, bool sorted2, long long int low, long long int high) {
+    int *sorted_values1;
+    unsigned int *sorted_positions1;
+    sort_input(values1, positions1, count1, sorted1, &sorted_values1, &sorted_positions1);
+
+    int *sorted_values2;
+    unsigned int *sorted_positions2;
+    sort_input(values2, positions2, count2, sorted2, &sorted_values2, &sorted_positions2);
+
+    unsigned long long int matches = band_sweep(sorted_values1, sorted_positions1, count1,
+            sorted_values2, sorted_positions2, count2, low, high, NULL, NULL);
+
+    free_sorted_input(sorted1, sorted_values1, sorted_positions1);
+    free_sorted_input(sorted2, sorted_values2, sorted_positions2);
+
+    return matches;
+}
+
+// Min-heap of intervals, by index into the second side, ordered by their high ends.
+static inline void interval_heap_push(unsigned int *heap, unsigned int *size, int *highs,
+        unsigned int interval) {
+    unsigned int i = (*size)++;
+    while (i > 0 && highs[heap[(i - 1) / 2]] > highs[interval]) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = interval;
+}
+
+static inline void interval_heap_pop(unsigned int *heap, unsigned int *size, int *highs) {
+    unsigned int last = heap[--(*size)];
+    unsigned int i = 0;
+    while (2 * i + 1 < *size) {
+        unsigned int child = 2 * i + 1;
+        if (child + 1 < *size && highs[heap[child + 1]] < highs[heap[child]]) {
+            child++;
+        }
+        if (highs[heap[child]] >= highs[last]) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+}
+
+// Sweeps the sorted first side against the intervals sorted by their low ends. Intervals open once
+// the values reach their low end, and close once the values reach their high end, which they never
+// fall below again. Every interval open at a value matches it. Pairs are emitted if the outputs are
+// given, and counted otherwise.
+static unsigned long long int interval_sweep(int *values1, unsigned int *positions1,
+        unsigned int count1, bool sorted1, int *lows2, int *highs2, unsigned int *positions2,
+        unsigned int count2, PosVector *pos_out1, PosVector *pos_out2) {
+    int *sorted_values1;
+    unsigned int *sorted_positions1;
+    sort_input(values1, positions1, count1, sorted1, &sorted_values1, &sorted_positions1);
+
+    unsigned int *intervals = malloc(count2 * sizeof(unsigned int));
+    int *sorted_lows2 = malloc(count2 * sizeof(int));
+    radix_sort_indices(lows2, NULL, sorted_lows2, intervals, count2);
+
+    unsigned int *open = malloc(count2 * sizeof(unsigned int));
+    unsigned int open_count = 0;
+
+    unsigned long long int matches = 0;
+    unsigned int next = 0;
+    for (unsigned int i = 0; i < count1; i++) {
+        int val1 = sorted_values1[i];
+
+        while (next < count2 && sorted_lows2[next] <= val1) {
+            interval_heap_push(open, &open_count, highs2, intervals[next++]);
+        }
+        while (open_count > 0 && highs2[open[0]] <= val1) {
+            interval_heap_pop(open, &open_count, highs2);
+        }
+
+        matches += open_count;
+
+        if (pos_out1 != NULL) {
+            unsigned int pos1 = sorted_positions1[i];
+            for (unsigned int j = 0; j < open_count; j++) {
+                pos_vector_append(pos_out1, pos1);
+                pos_vector_append(pos_out2, positions2[open[j]]);
+            }
+        }
+    }
+
+    free(open);
+    free(sorted_lows2);
+    free(intervals);
+    free_sorted_input(sorted1, sorted_values1, sorted_positions1);
+
+    return matches;
+}
+
+void join_interval(int *values1, unsigned int *positions1, unsigned int count1, bool sorted1,
+        int *lows2, int *highs2, unsigned int *positions2, unsigned int count2,
+        PosVector *pos_out1, PosVector *pos_out2) {
+    interval_sweep(values1, positions1, count1, sorted1, lows2, highs2, positions2, count2,
+            pos_out1, pos_out2);
+}
+
+unsigned long long int join_interval_count(int *values1, unsigned int *positions1,
+        unsigned int count1, bool sorted1, int *lows2, int *highs2, unsigned int count2) {
+    return interval_sweep(values1, positions1, count1, sorted1, lows2, highs2, NULL, count2, NULL,
+            NULL);
+}
+
+static inline void semi_bitmap(int *values1, unsigned int *positions1, unsigned int count1,
+        int *values2, unsigned int count2, int min, unsigned int range, PosVector *pos_out1) {
+    uint64_t *bitmap = calloc((range + 63) / 64, sizeof(uint64_t));
+    for (unsigned int i = 0; i < count2; i++) {
+        unsigned int key = (unsigned int) values2[i] - (unsigned int) min;
+        bitmap[key >> 6] |= (uint64_t) 1 << (key & 63);
+    }
+
+    for (unsigned int i = 0; i < count1; i++) {
+        unsigned int key = (unsigned int) values1[i] - (unsigned int) min;
+        if (key < range && (bitmap[key >> 6] >> (key & 63)) & 1) {
+            pos_vector_append(pos_out1, positions1[i]);
+        }
+    }
+
+    free(bitmap);
+}
+
+static inline void semi_static_count(int *values1, unsigned int *positions1, unsigned int count1,
+        int *values2, unsigned int count2, PosVector *pos_out1) {
+    unsigned int table_size = round_up_power_of_two(count2);
+    unsigned int mask = table_size - 1;
+
+    unsigned int *counts = calloc(table_size, sizeof(unsigned int));
+    for (unsigned int i = 0; i < count2; i++) {
+        counts[values2[i] & mask]++;
+    }
+
+    unsigned int *offsets = malloc(table_size * sizeof(unsigned int));
+    unsigned int *ends = malloc(table_size * sizeof(unsigned int));
+    unsigned int accum = 0;
+    for (unsigned int i = 0; i < table_size; i++) {
+        offsets[i] = ends[i] = accum;
+        accum += counts[i];
+    }
+
+    int *table = malloc(count2 * sizeof(int));
+    for (unsigned int i = 0; i < count2; i++) {
+        int value = values2[i];
+        table[ends[value & mask]++] = value;
+    }
+
+    free(ends);
+
+    for (unsigned int i = 0; i < count1; i++) {
+        int val1 = values1[i];
+        unsigned int bucket = val1 & mask;
+
+        unsigned int start = offsets[bucket];
+        unsigned int end = start + counts[bucket];
+        for (unsigned int j = start; j < end; j++) {
+            if (table[j] == val1) {
+                pos_vector_append(pos_out1, positions1[i]);
+                break;
+            }
+        }
+    }
+
+    free(counts);
+    free(offsets);
 
-    free(sorted_values2);
-    free(sorted_positions2);
+    free(table);
+}
+
+void join_semi(int *values1, unsigned int *positions1, unsigned int count1, int *values2,
+        unsigned int count2, PosVector *pos_out1) {
+    int min;
+    unsigned int range;
+    if (dense_range(values2, count2, SEMI_BITMAP_RANGE_FACTOR, &min, &range)) {
+        semi_bitmap(values1, positions1, count1, values2, count2, min, range, pos_out1);
+    } else {
+        semi_static_count(values1, positions1, count1, values2, count2, pos_out1);
+    }
 }
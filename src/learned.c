@@ -0,0 +1,531 @@
+#include <float.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "learned.h"
+#include "utils.h"
+#include "vector.h"
+
+// Maximum distance between the predicted and the actual rank of a key, so a lookup searches a
+// window of about 2 * LEARNED_EPSILON entries around the prediction.
+#define LEARNED_EPSILON 32
+#define LEARNED_INITIAL_SEGMENTS 16
+// The delta buffer is merged once its size squared reaches LEARNED_DELTA_RATIO times the size of
+// the base array, and it holds at least LEARNED_DELTA_MIN_SIZE entries. Growing it as the square
+// root of the base balances shifting entries on insert against the cost of each merge.
+#define LEARNED_DELTA_RATIO 64
+#define LEARNED_DELTA_MIN_SIZE 1024
+// Removed base entries are dropped once they are a 1/LEARNED_REMOVED_RATIO of the base array.
+#define LEARNED_REMOVED_RATIO 8
+
+static inline unsigned int learned_run_end(int *values, unsigned int size, unsigned int i) {
+    int value = values[i];
+    while (i < size && values[i] == value) {
+        i++;
+    }
+    return i;
+}
+
+// Fits segments greedily: each one is extended for as long as some slope keeps the first rank of
+// every distinct key it covers within LEARNED_EPSILON of its prediction.
+static void learned_fit(LearnedIndex *index) {
+    int *values = index->values.data;
+    unsigned int size = index->values.size;
+
+    unsigned int capacity = LEARNED_INITIAL_SEGMENTS;
+    index->segments = realloc(index->segments, capacity * sizeof(LearnedSegment));
+    index->num_segments = 0;
+
+    unsigned int i = 0;
+    while (i < size) {
+        int key = values[i];
+        double slope_low = 0;
+        double slope_high = DBL_MAX;
+
+        unsigned int j = learned_run_end(values, size, i);
+        while (j < size) {
+            double dx = (double) values[j] - key;
+            double low = ((double) j - i - LEARNED_EPSILON) / dx;
+            double high = ((double) j - i + LEARNED_EPSILON) / dx;
+            if (low > slope_high || high < slope_low) {
+                break;
+            }
+
+            slope_low = low > slope_low ? low : slope_low;
+            slope_high = high < slope_high ? high : slope_high;
+
+            j = learned_run_end(values, size, j);
+        }
+
+        if (index->num_segments == capacity) {
+            capacity *= 2;
+            index->segments = realloc(index->segments, capacity * sizeof(LearnedSegment));
+        }
+
+        LearnedSegment *segment = index->segments + index->num_segments++;
+        segment->key = key;
+        segment->start = i;
+        segment->slope = slope_high == DBL_MAX ? 0 : (slope_low + slope_high) / 2;
+
+        i = j;
+    }
+}
+
+// Returns the rank of the left-most base entry that is >= value, like binary_search_left.
+static inline unsigned int learned_bound(LearnedIndex *index, int value) {
+    int *values = index->values.data;
+    unsigned int size = index->values.size;
+    if (size == 0 || value <= values[0]) {
+        return 0;
+    }
+
+    LearnedSegment *segments = index->segments;
+    unsigned int left = 0;
+    unsigned int right = index->num_segments;
+    while (left < right) {
+        unsigned int mid = (left + right) / 2;
+        if (segments[mid].key <= value) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    LearnedSegment *segment = segments + (left > 0 ? left - 1 : 0);
+
+    double prediction = segment->start + segment->slope * ((double) value - segment->key);
+    unsigned int guess = prediction <= 0 ? 0 : prediction >= size ? size : prediction;
+
+    unsigned int error = LEARNED_EPSILON + 1;
+    unsigned int low = guess > error ? guess - error : 0;
+    unsigned int high = guess + error < size ? guess + error : size;
+
+    // The bound is within the window for keys of the base array. Values between two keys may be
+    // further off if the smaller key has many duplicates, so widen the window until it holds.
+    for (unsigned int step = error; low > 0 && values[low - 1] >= value; step *= 2) {
+        high = low - 1;
+        low = low > step ? low - step : 0;
+    }
+    for (unsigned int step = error; high < size && values[high] < value; step *= 2) {
+        low = high + 1;
+        high = size - high > step ? high + step : size;
+    }
+
+    return low + binary_search_left(values + low, high - low, value);
+}
+
+// Merges a sorted batch into the base array. Equal values from the batch go after existing ones.
+static void learned_merge_base(LearnedIndex *index, int *values, unsigned int *positions,
+        unsigned int size) {
+    if (size == 0) {
+        return;
+    }
+
+    unsigned int i = index->values.size;
+    unsigned int j = size;
+    unsigned int k = i + size;
+
+    int_vector_ensure_capacity(&index->values, k);
+    pos_vector_ensure_capacity(&index->positions, k);
+
+    int *dst_values = index->values.data;
+    unsigned int *dst_positions = index->positions.data;
+
+    // Merge from the back, so that existing entries are moved at most once.
+    while (j > 0) {
+        k--;
+        if (i > 0 && dst_values[i - 1] > values[j - 1]) {
+            i--;
+            dst_values[k] = dst_values[i];
+            dst_positions[k] = dst_positions[i];
+        } else {
+            j--;
+            dst_values[k] = values[j];
+            dst_positions[k] = positions[j];
+        }
+    }
+
+    index->values.size += size;
+    index->positions.size += size;
+}
+
+// Returns the rank of the first removed base entry from rank on, or the size of the base array.
+static inline unsigned int learned_next_removed(LearnedIndex *index, unsigned int rank) {
+    unsigned int size = index->values.size;
+    if (index->removed_count == 0 || rank >= size) {
+        return size;
+    }
+
+    bool *removed = memchr(index->removed + rank, true, size - rank);
+    return removed != NULL ? removed - index->removed : size;
+}
+
+static inline bool learned_is_removed(LearnedIndex *index, unsigned int rank) {
+    return index->removed_count > 0 && index->removed[rank];
+}
+
+// Drops the removed entries from the base array, keeping the others in order.
+static void learned_drop_removed(LearnedIndex *index) {
+    if (index->removed_count == 0) {
+        return;
+    }
+
+    int *values = index->values.data;
+    unsigned int *positions = index->positions.data;
+    unsigned int size = index->values.size;
+
+    unsigned int k = learned_next_removed(index, 0);
+    for (unsigned int first = k + 1; first < size;) {
+        unsigned int end = learned_next_removed(index, first);
+        memmove(values + k, values + first, (end - first) * sizeof(int));
+        memmove(positions + k, positions + first, (end - first) * sizeof(unsigned int));
+        k += end - first;
+        first = end + 1;
+    }
+
+    index->values.size = k;
+    index->positions.size = k;
+
+    free(index->removed);
+    index->removed = NULL;
+    index->removed_count = 0;
+}
+
+// Applies the pending inserts and removes to the base array. The model must be refitted after.
+static inline void learned_merge_delta(LearnedIndex *index) {
+    learned_drop_removed(index);
+    learned_merge_base(index, index->delta_values.data, index->delta_positions.data,
+            index->delta_values.size);
+    index->delta_values.size = 0;
+    index->delta_positions.size = 0;
+}
+
+void learned_init(LearnedIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    int_vector_init(&index->values, size);
+    pos_vector_init(&index->positions, size);
+    int_vector_init(&index->delta_values, 0);
+    pos_vector_init(&index->delta_positions, 0);
+    index->removed = NULL;
+    index->removed_count = 0;
+    index->segments = NULL;
+
+    if (size > 0) {
+        memcpy(index->values.data, values, size * sizeof(int));
+        if (positions == NULL) {
+            for (unsigned int i = 0; i < size; i++) {
+                index->positions.data[i] = i;
+            }
+        } else {
+            memcpy(index->positions.data, positions, size * sizeof(unsigned int));
+        }
+    }
+    index->values.size = size;
+    index->positions.size = size;
+
+    learned_fit(index);
+}
+
+void learned_destroy(LearnedIndex *index) {
+    int_vector_destroy(&index->values);
+    pos_vector_destroy(&index->positions);
+    int_vector_destroy(&index->delta_values);
+    pos_vector_destroy(&index->delta_positions);
+    free(index->removed);
+    free(index->segments);
+}
+
+void learned_merge(LearnedIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    learned_merge_delta(index);
+    learned_merge_base(index, values, positions, size);
+    learned_fit(index);
+}
+
+// Writes the base entries of data that were not removed, in the layout of a saved vector.
+static bool learned_base_save(LearnedIndex *index, void *data, size_t element_size, FILE *file) {
+    unsigned int size = index->values.size - index->removed_count;
+    if (fwrite(&size, sizeof(size), 1, file) != 1) {
+        return false;
+    }
+
+    char *bytes = data;
+    for (unsigned int first = 0; first < index->values.size;) {
+        unsigned int end = learned_next_removed(index, first);
+        if (fwrite(bytes + first * element_size, element_size, end - first, file) != end - first) {
+            return false;
+        }
+        first = end + 1;
+    }
+
+    return true;
+}
+
+bool learned_save(LearnedIndex *index, FILE *file) {
+    // The model is cheap to fit again, so only the entries are saved.
+    return learned_base_save(index, index->values.data, sizeof(int), file)
+            && learned_base_save(index, index->positions.data, sizeof(unsigned int), file)
+            && int_vector_save(&index->delta_values, file)
+            && pos_vector_save(&index->delta_positions, file);
+}
+
+bool learned_load(LearnedIndex *index, FILE *file) {
+    learned_init(index, NULL, NULL, 0);
+
+    if (!int_vector_load(&index->values, file) || !pos_vector_load(&index->positions, file)
+            || !int_vector_load(&index->delta_values, file)
+            || !pos_vector_load(&index->delta_positions, file)) {
+        log_err("Unable to read learned index\n");
+        learned_destroy(index);
+        return false;
+    }
+
+    learned_fit(index);
+
+    return true;
+}
+
+void learned_insert(LearnedIndex *index, int value, unsigned int position) {
+    IntVector *delta_values = &index->delta_values;
+    unsigned int idx = binary_search_right(delta_values->data, delta_values->size, value);
+
+    int_vector_insert(delta_values, idx, value);
+    pos_vector_insert(&index->delta_positions, idx, position);
+
+    if (delta_values->size >= LEARNED_DELTA_MIN_SIZE
+            && (size_t) delta_values->size * delta_values->size
+                    >= (size_t) LEARNED_DELTA_RATIO * index->values.size) {
+        learned_merge_delta(index);
+        learned_fit(index);
+    }
+}
+
+// Returns the offset of the entry for value at position in a sorted run starting at idx, or -1.
+static inline int learned_run_search(int *values, unsigned int *positions, unsigned int size,
+        unsigned int idx, int value, unsigned int position, unsigned int *positions_map) {
+    for (; idx < size && values[idx] == value; idx++) {
+        unsigned int raw_pos = positions[idx];
+        unsigned int pos = positions_map != NULL ? positions_map[raw_pos] : raw_pos;
+
+        if (pos == position) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+// Like learned_run_search on the base array, skipping removed entries.
+static inline int learned_base_search(LearnedIndex *index, int value, unsigned int position,
+        unsigned int *positions_map) {
+    unsigned int idx = learned_bound(index, value);
+    int found;
+    while ((found = learned_run_search(index->values.data, index->positions.data,
+            index->values.size, idx, value, position, positions_map)) != -1
+            && learned_is_removed(index, found)) {
+        idx = found + 1;
+    }
+    return found;
+}
+
+bool learned_remove(LearnedIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr) {
+    IntVector *delta_values = &index->delta_values;
+    PosVector *delta_positions = &index->delta_positions;
+    int idx = learned_run_search(delta_values->data, delta_positions->data, delta_values->size,
+            binary_search_left(delta_values->data, delta_values->size, value), value, position,
+            positions_map);
+    if (idx != -1) {
+        if (position_ptr != NULL) {
+            *position_ptr = delta_positions->data[idx];
+        }
+
+        int_vector_remove(delta_values, idx);
+        pos_vector_remove(delta_positions, idx);
+
+        return true;
+    }
+
+    idx = learned_base_search(index, value, position, positions_map);
+    if (idx == -1) {
+        return false;
+    }
+
+    if (position_ptr != NULL) {
+        *position_ptr = index->positions.data[idx];
+    }
+
+    // Base entries are only marked as removed, so that ranks and the model stay valid.
+    if (index->removed == NULL) {
+        index->removed = calloc(index->values.size, sizeof(bool));
+    }
+    index->removed[idx] = true;
+
+    if ((size_t) ++index->removed_count * LEARNED_REMOVED_RATIO >= index->values.size) {
+        learned_merge_delta(index);
+        learned_fit(index);
+    }
+
+    return true;
+}
+
+// Keeps the entries of values and positions for which removed is false, returning their number.
+static unsigned int learned_filter(int *values, unsigned int *positions, unsigned int size,
+        bool (*removed)(void *, unsigned int), void *data) {
+    unsigned int k = 0;
+    for (unsigned int i = 0; i < size; i++) {
+        if (!removed(data, positions[i])) {
+            values[k] = values[i];
+            positions[k] = positions[i];
+            k++;
+        }
+    }
+    return k;
+}
+
+void learned_remove_if(LearnedIndex *index, bool (*removed)(void *, unsigned int), void *data) {
+    learned_drop_removed(index);
+
+    index->values.size = learned_filter(index->values.data, index->positions.data,
+            index->values.size, removed, data);
+    index->positions.size = index->values.size;
+
+    index->delta_values.size = learned_filter(index->delta_values.data,
+            index->delta_positions.data, index->delta_values.size, removed, data);
+    index->delta_positions.size = index->delta_values.size;
+
+    learned_fit(index);
+}
+
+bool learned_search(LearnedIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr) {
+    int idx = learned_base_search(index, value, position, positions_map);
+    if (idx != -1) {
+        if (position_ptr != NULL) {
+            *position_ptr = index->positions.data[idx];
+        }
+        return true;
+    }
+
+    IntVector *delta_values = &index->delta_values;
+    idx = learned_run_search(delta_values->data, index->delta_positions.data, delta_values->size,
+            binary_search_left(delta_values->data, delta_values->size, value), value, position,
+            positions_map);
+    if (idx != -1) {
+        if (position_ptr != NULL) {
+            *position_ptr = index->delta_positions.data[idx];
+        }
+        return true;
+    }
+
+    return false;
+}
+
+// Copies the positions of base entries [first, last) that were not removed and of delta entries
+// [delta_first, delta_last) to result, merged by value so that they are ordered like those of the
+// other index types.
+static unsigned int learned_copy(LearnedIndex *index, unsigned int first, unsigned int last,
+        unsigned int delta_first, unsigned int delta_last, unsigned int *result) {
+    int *values = index->values.data;
+    unsigned int *positions = index->positions.data;
+    int *delta_values = index->delta_values.data;
+    unsigned int *delta_positions = index->delta_positions.data;
+
+    last = last > first ? last : first;
+    delta_last = delta_last > delta_first ? delta_last : delta_first;
+
+    unsigned int result_count = 0;
+    while (first < last) {
+        // Base entries up to the next removed one are all copied.
+        unsigned int end = learned_next_removed(index, first);
+        end = end < last ? end : last;
+
+        while (first < end && delta_first < delta_last) {
+            if (delta_values[delta_first] < values[first]) {
+                result[result_count++] = delta_positions[delta_first++];
+            } else {
+                result[result_count++] = positions[first++];
+            }
+        }
+
+        memcpy(result + result_count, positions + first, (end - first) * sizeof(unsigned int));
+        result_count += end - first;
+
+        first = end < last ? end + 1 : last;
+    }
+
+    if (delta_first < delta_last) {
+        memcpy(result + result_count, delta_positions + delta_first,
+                (delta_last - delta_first) * sizeof(unsigned int));
+        result_count += delta_last - delta_first;
+    }
+
+    return result_count;
+}
+
+unsigned int learned_select_lower(LearnedIndex *index, int high, unsigned int *result) {
+    IntVector *delta_values = &index->delta_values;
+    return learned_copy(index, 0, learned_bound(index, high), 0,
+            binary_search_left(delta_values->data, delta_values->size, high), result);
+}
+
+unsigned int learned_select_higher(LearnedIndex *index, int low, unsigned int *result) {
+    IntVector *delta_values = &index->delta_values;
+    return learned_copy(index, learned_bound(index, low), index->values.size,
+            binary_search_left(delta_values->data, delta_values->size, low), delta_values->size,
+            result);
+}
+
+unsigned int learned_select_range(LearnedIndex *index, int low, int high, unsigned int *result) {
+    IntVector *delta_values = &index->delta_values;
+    return learned_copy(index, learned_bound(index, low), learned_bound(index, high),
+            binary_search_left(delta_values->data, delta_values->size, low),
+            binary_search_left(delta_values->data, delta_values->size, high), result);
+}
+
+int learned_min(LearnedIndex *index, unsigned int *position_ptr) {
+    IntVector *values = &index->values;
+    IntVector *delta_values = &index->delta_values;
+
+    // The first base entry that was not removed.
+    unsigned int idx = 0;
+    while (idx < values->size && learned_is_removed(index, idx)) {
+        idx++;
+    }
+
+    bool delta = idx == values->size
+            || (delta_values->size > 0 && delta_values->data[0] < values->data[idx]);
+    if (delta && delta_values->size == 0) {
+        return 0;
+    }
+
+    if (position_ptr != NULL) {
+        *position_ptr = delta ? index->delta_positions.data[0] : index->positions.data[idx];
+    }
+
+    return delta ? delta_values->data[0] : values->data[idx];
+}
+
+int learned_max(LearnedIndex *index, unsigned int *position_ptr) {
+    IntVector *values = &index->values;
+    IntVector *delta_values = &index->delta_values;
+    unsigned int delta_idx = delta_values->size - 1;
+
+    // One past the last base entry that was not removed.
+    unsigned int end = values->size;
+    while (end > 0 && learned_is_removed(index, end - 1)) {
+        end--;
+    }
+    unsigned int idx = end - 1;
+
+    bool delta = end == 0
+            || (delta_values->size > 0 && delta_values->data[delta_idx] >= values->data[idx]);
+    if (delta && delta_values->size == 0) {
+        return 0;
+    }
+
+    if (position_ptr != NULL) {
+        *position_ptr = delta ? index->delta_positions.data[delta_idx]
+                : index->positions.data[idx];
+    }
+
+    return delta ? delta_values->data[delta_idx] : values->data[idx];
+}
@@ -183,6 +183,10 @@ DbOperator *parse_create_idx(char *create_arguments, Message *message) {
         type = BTREE;
     } else if (strcmp(index_type, "sorted") == 0) {
         type = SORTED;
+    } else if (strcmp(index_type, "hash") == 0) {
+        type = HASHED;
+    } else if (strcmp(index_type, "learned") == 0) {
+        type = LEARNED;
     } else {
         message->status = UNKNOWN_COMMAND;
         return NULL;
@@ -198,6 +202,12 @@ DbOperator *parse_create_idx(char *create_arguments, Message *message) {
         return NULL;
     }
 
+    // Clustering orders the table by value, which a hash index cannot make use of.
+    if (type == HASHED && clustered) {
+        message->status = QUERY_UNSUPPORTED;
+        return NULL;
+    }
+
     DbOperator *dbo = malloc(sizeof(DbOperator));
     dbo->type = CREATE_IDX;
     dbo->fields.create_index.column_fqn = strdup(column_fqn);
@@ -477,29 +487,43 @@ DbOperator *parse_relational_insert(char *handle, char *insert_arguments, Messag
         return NULL;
     }
 
-    if (insert_arguments_stripped == NULL) {
-        message->status = WRONG_NUMBER_OF_ARGUMENTS;
-        return NULL;
-    }
-
     IntVector values;
     int_vector_init(&values, 4);
-    char *token;
-    while ((token = strsep(insert_arguments_index, ",")) != NULL) {
-        char *endptr;
-        int value = strtoi(token, &endptr);
-        if (endptr == token || *endptr != '\0') {
+
+    // Without values, the rows follow the query in binary.
+    bool framed = insert_arguments_stripped == NULL;
+    unsigned int columns_count = 0;
+
+    if (!framed && *insert_arguments_stripped == '(') {
+        // Several rows, each in parenthesis.
+        columns_count = parse_int_tuples(insert_arguments_stripped, &values);
+        if (columns_count == 0) {
             message->status = INCORRECT_FORMAT;
             int_vector_destroy(&values);
             return NULL;
         }
-        int_vector_append(&values, value);
+    } else if (!framed) {
+        char *token;
+        while ((token = strsep(insert_arguments_index, ",")) != NULL) {
+            char *endptr;
+            int value = strtoi(token, &endptr);
+            if (endptr == token || *endptr != '\0') {
+                message->status = INCORRECT_FORMAT;
+                int_vector_destroy(&values);
+                return NULL;
+            }
+            int_vector_append(&values, value);
+        }
+        columns_count = values.size;
     }
 
     DbOperator *dbo = malloc(sizeof(DbOperator));
     dbo->type = RELATIONAL_INSERT;
     dbo->fields.relational_insert.table_fqn = strdup(table_fqn);
     int_vector_shallow_copy(&dbo->fields.relational_insert.values, &values);
+    dbo->fields.relational_insert.columns_count = columns_count;
+    dbo->fields.relational_insert.rows_count = framed ? 0 : values.size / columns_count;
+    dbo->fields.relational_insert.framed = framed;
     return dbo;
 }
 
@@ -606,6 +630,35 @@ DbOperator *parse_relational_update(char *handle, char *update_arguments, Messag
     return dbo;
 }
 
+DbOperator *parse_vacuum(char *handle, char *vacuum_arguments, Message *message) {
+    if (handle != NULL) {
+        message->status = WRONG_NUMBER_OF_HANDLES;
+        return NULL;
+    }
+
+    char *table_fqn = strip_parenthesis(vacuum_arguments);
+    if (table_fqn == vacuum_arguments) {
+        // Parenthesis was not stripped.
+        message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+
+    if (*table_fqn == '\0') {
+        message->status = WRONG_NUMBER_OF_ARGUMENTS;
+        return NULL;
+    }
+
+    if (!is_valid_fqn(table_fqn, 1)) {
+        message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+
+    DbOperator *dbo = malloc(sizeof(DbOperator));
+    dbo->type = VACUUM;
+    dbo->fields.vacuum.table_fqn = strdup(table_fqn);
+    return dbo;
+}
+
 DbOperator *parse_join(char *handle, char *join_arguments, Message *message) {
     if (handle == NULL) {
         message->status = WRONG_NUMBER_OF_HANDLES;
@@ -633,18 +686,6 @@ DbOperator *parse_join(char *handle, char *join_arguments, Message *message) {
         return NULL;
     }
 
-    if (join_arguments_stripped != NULL) {
-        // Too many arguments.
-        message->status = WRONG_NUMBER_OF_ARGUMENTS;
-        return NULL;
-    }
-
-    if (!is_valid_name(val_var1) || !is_valid_name(pos_var1)
-            || !is_valid_name(val_var2) || !is_valid_name(pos_var2)) {
-        message->status = INCORRECT_FORMAT;
-        return NULL;
-    }
-
     JoinType type;
     if (strcmp(join_type, "hash") == 0) {
         type = HASH;
@@ -652,13 +693,72 @@ DbOperator *parse_join(char *handle, char *join_arguments, Message *message) {
         type = NESTED_LOOP;
     } else if (strcmp(join_type, "sort-merge") == 0) {
         type = SORT_MERGE;
+    } else if (strcmp(join_type, "semi") == 0) {
+        type = SEMI;
+    } else if (strcmp(join_type, "band") == 0) {
+        type = BAND;
+    } else if (strcmp(join_type, "band-count") == 0) {
+        type = BAND_COUNT;
+    } else if (strcmp(join_type, "interval") == 0) {
+        type = INTERVAL;
+    } else if (strcmp(join_type, "interval-count") == 0) {
+        type = INTERVAL_COUNT;
     } else {
         message->status = UNKNOWN_COMMAND;
         return NULL;
     }
 
+    // Band joins match low <= val2 - val1 < high, where either bound may be null.
+    Comparator band = { INT_MIN, false, INT_MAX, false };
+    if (type == BAND || type == BAND_COUNT) {
+        char *low = next_token(join_arguments_index, ",", status, WRONG_NUMBER_OF_ARGUMENTS);
+        char *high = next_token(join_arguments_index, ",", status, WRONG_NUMBER_OF_ARGUMENTS);
+
+        if (message->status == WRONG_NUMBER_OF_ARGUMENTS) {
+            // Not enough arguments.
+            return NULL;
+        }
+
+        parse_optional_number(low, &band.low, &band.has_low, status);
+        parse_optional_number(high, &band.high, &band.has_high, status);
+        if (message->status == INCORRECT_FORMAT) {
+            return NULL;
+        }
+    }
+
+    // Interval joins match low2 <= val1 < high2, with the low ends in val2 and the high ends in
+    // the variable given last.
+    char *high_var2 = NULL;
+    if (type == INTERVAL || type == INTERVAL_COUNT) {
+        high_var2 = next_token(join_arguments_index, ",", status, WRONG_NUMBER_OF_ARGUMENTS);
+
+        if (message->status == WRONG_NUMBER_OF_ARGUMENTS) {
+            // Not enough arguments.
+            return NULL;
+        }
+
+        if (!is_valid_name(high_var2)) {
+            message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+    }
+
+    if (join_arguments_stripped != NULL) {
+        // Too many arguments.
+        message->status = WRONG_NUMBER_OF_ARGUMENTS;
+        return NULL;
+    }
+
+    if (!is_valid_name(val_var1) || !is_valid_name(pos_var1)
+            || !is_valid_name(val_var2) || !is_valid_name(pos_var2)) {
+        message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+
+    // Semi-joins only produce positions for the first side, and counts a single value.
     char *pos_out_var1 = next_token(&handle, ",", status, WRONG_NUMBER_OF_HANDLES);
-    char *pos_out_var2 = next_token(&handle, ",", status, WRONG_NUMBER_OF_HANDLES);
+    char *pos_out_var2 = type == SEMI || type == BAND_COUNT || type == INTERVAL_COUNT ? NULL
+            : next_token(&handle, ",", status, WRONG_NUMBER_OF_HANDLES);
 
     if (message->status == WRONG_NUMBER_OF_HANDLES) {
         // Not enough handles.
@@ -671,7 +771,7 @@ DbOperator *parse_join(char *handle, char *join_arguments, Message *message) {
         return NULL;
     }
 
-    if (!is_valid_name(pos_out_var1) || !is_valid_name(pos_out_var2)) {
+    if (!is_valid_name(pos_out_var1) || (pos_out_var2 != NULL && !is_valid_name(pos_out_var2))) {
         message->status = INCORRECT_FORMAT;
         return NULL;
     }
@@ -683,8 +783,10 @@ DbOperator *parse_join(char *handle, char *join_arguments, Message *message) {
     dbo->fields.join.pos_var1 = strdup(pos_var1);
     dbo->fields.join.val_var2 = strdup(val_var2);
     dbo->fields.join.pos_var2 = strdup(pos_var2);
+    dbo->fields.join.band = band;
+    dbo->fields.join.high_var2 = high_var2 != NULL ? strdup(high_var2) : NULL;
     dbo->fields.join.pos_out_var1 = strdup(pos_out_var1);
-    dbo->fields.join.pos_out_var2 = strdup(pos_out_var2);
+    dbo->fields.join.pos_out_var2 = pos_out_var2 != NULL ? strdup(pos_out_var2) : NULL;
     return dbo;
 }
 
@@ -1207,6 +1309,9 @@ DbOperator *parse_command(char *query_command, Message *message, ClientContext *
     } else if (strncmp(query_command, "relational_update", 17) == 0) {
         query_command += 17;
         dbo = parse_relational_update(handle, query_command, message);
+    } else if (strncmp(query_command, "vacuum", 6) == 0) {
+        query_command += 6;
+        dbo = parse_vacuum(handle, query_command, message);
     } else if (strncmp(query_command, "join", 4) == 0) {
         query_command += 4;
         dbo = parse_join(handle, query_command, message);
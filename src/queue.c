@@ -3,19 +3,17 @@
 #include <stdlib.h>
 
 #include "queue.h"
+#include "utils.h"
 
 void queue_init(Queue *q) {
-    q->head = NULL;
-    q->tail = NULL;
+    q->values = NULL;
+    q->head = 0;
     q->size = 0;
+    q->capacity = 0;
 }
 
 void queue_destroy(Queue *q) {
-    for (QueueNode *n = q->head; n != NULL;) {
-        QueueNode *node = n;
-        n = node->next;
-        free(node);
-    }
+    free(q->values);
 }
 
 bool queue_save(Queue *q, FILE *file) {
@@ -23,74 +21,62 @@ bool queue_save(Queue *q, FILE *file) {
         return false;
     }
 
-    for (QueueNode *n = q->head; n != NULL; n = n->next) {
-        if (fwrite(&n->value, sizeof(n->value), 1, file) != 1) {
-            return false;
-        }
+    // Written from the head, in two parts if the values wrap around.
+    unsigned int first = q->capacity - q->head < q->size ? q->capacity - q->head : q->size;
+    if (fwrite(q->values + q->head, sizeof(unsigned int), first, file) != first) {
+        return false;
+    }
+    if (fwrite(q->values, sizeof(unsigned int), q->size - first, file) != q->size - first) {
+        return false;
     }
 
     return true;
 }
 
 bool queue_load(Queue *q, FILE *file) {
-    if (fread(&q->size, sizeof(q->size), 1, file) != 1) {
+    unsigned int size;
+    if (fread(&size, sizeof(size), 1, file) != 1) {
         return false;
     }
 
-    for (unsigned i = 0; i < q->size; i++) {
-        QueueNode *node = malloc(sizeof(QueueNode));
-
-        if (fread(&node->value, sizeof(node->value), 1, file) != 1) {
-            free(node);
-            return false;
-        }
-
-        node->next = NULL;
+    q->head = 0;
+    q->size = 0;
+    q->capacity = round_up_power_of_two(size);
+    q->values = realloc(q->values, q->capacity * sizeof(unsigned int));
 
-        if (q->head == NULL) {
-            q->head = node;
-        } else {
-            q->tail->next = node;
-        }
-        q->tail = node;
+    if (fread(q->values, sizeof(unsigned int), size, file) != size) {
+        return false;
     }
+    q->size = size;
 
     return true;
 }
 
 void queue_push(Queue *q, unsigned int value) {
-    QueueNode *node = malloc(sizeof(QueueNode));
-    node->value = value;
-    node->next = NULL;
-
-    if (q->head == NULL) {
-        q->head = node;
-    } else {
-        q->tail->next = node;
+    if (q->size == q->capacity) {
+        unsigned int capacity = q->capacity == 0 ? 1 : q->capacity * 2;
+        q->values = realloc(q->values, capacity * sizeof(unsigned int));
+
+        // Move the values that wrapped around past the old end.
+        for (unsigned int i = 0; i < q->head; i++) {
+            q->values[q->capacity + i] = q->values[i];
+        }
+        q->capacity = capacity;
     }
-    q->tail = node;
 
+    q->values[(q->head + q->size) & (q->capacity - 1)] = value;
     q->size++;
 }
 
 unsigned int queue_peek(Queue *q) {
-    return q->head->value;
+    return q->values[q->head];
 }
 
 unsigned int queue_pop(Queue *q) {
-    QueueNode *node = q->head;
-
-    unsigned int value = node->value;
-
-    if (node->next != NULL) {
-        q->head = node->next;
-    } else {
-        q->head = q->tail = NULL;
-    }
+    unsigned int value = q->values[q->head];
 
+    q->head = (q->head + 1) & (q->capacity - 1);
     q->size--;
 
-    free(node);
-
     return value;
 }
@@ -16,6 +16,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -31,8 +32,11 @@
 #include "client_context.h"
 #include "db_manager.h"
 #include "db_operator.h"
+#include "epoch.h"
+#include "join.h"
 #include "message.h"
 #include "parser.h"
+#include "thread_pool.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -52,6 +56,9 @@ ClientNode *clients_tail;
 pthread_mutex_t clients_mutex;
 pthread_cond_t clients_cond;
 
+// Worker thread pool size, 0 for one per core.
+static unsigned int worker_threads = 0;
+
 /**
  * setup_server()
  *
@@ -89,6 +96,7 @@ static inline bool setup_server() {
     pthread_mutex_init(&clients_mutex, NULL);
     pthread_cond_init(&clients_cond, NULL);
 
+    thread_pool_startup(worker_threads);
     db_manager_startup();
 
     return true;
@@ -96,6 +104,8 @@ static inline bool setup_server() {
 
 void tear_down_server() {
     db_manager_shutdown();
+    thread_pool_shutdown();
+    epoch_shutdown();
 
     pthread_mutex_destroy(&clients_mutex);
     pthread_cond_destroy(&clients_cond);
@@ -239,6 +249,45 @@ ERROR:
     return false;
 }
 
+// Receives the rows of a framed insert: the number of columns and rows, then the values of the
+// rows, one row after the other.
+bool recv_rows(DbOperator *dbo, MessageStatus *status) {
+    int client_socket = dbo->context->client_socket;
+
+    unsigned int columns_count;
+    if (!recv_and_check(client_socket, &columns_count, sizeof(columns_count), MSG_WAITALL)) {
+        *status = COMMUNICATION_ERROR;
+        return false;
+    }
+
+    unsigned int rows_count;
+    if (!recv_and_check(client_socket, &rows_count, sizeof(rows_count), MSG_WAITALL)) {
+        *status = COMMUNICATION_ERROR;
+        return false;
+    }
+
+    if (columns_count == 0 || rows_count > INT_MAX / columns_count) {
+        *status = COMMUNICATION_ERROR;
+        return false;
+    }
+
+    IntVector *values = &dbo->fields.relational_insert.values;
+    unsigned int values_count = rows_count * columns_count;
+    int_vector_ensure_capacity(values, values_count);
+    if (values_count > 0
+            && !recv_and_check(client_socket, values->data, values_count * sizeof(int),
+                    MSG_WAITALL)) {
+        *status = COMMUNICATION_ERROR;
+        return false;
+    }
+    values->size = values_count;
+
+    dbo->fields.relational_insert.columns_count = columns_count;
+    dbo->fields.relational_insert.rows_count = rows_count;
+
+    return true;
+}
+
 static inline void handle_operator(DbOperator *dbo, Message *message) {
     db_operator_log(dbo);
 
@@ -247,6 +296,12 @@ static inline void handle_operator(DbOperator *dbo, Message *message) {
         return;
     }
 
+    if (dbo->type == RELATIONAL_INSERT && dbo->fields.relational_insert.framed
+            && !recv_rows(dbo, &message->status)) {
+        db_operator_free(dbo);
+        return;
+    }
+
     if (dbo->context->is_batching
             && dbo->type != BATCH_QUERIES
             && dbo->type != BATCH_EXECUTE
@@ -379,7 +434,51 @@ void *client_thread_routine(void *data) {
 // After handling the client, it will exit.
 // You will need to extend this to handle multiple concurrent clients
 // and remain running until it receives a shut-down command.
-int main(void) {
+/**
+ * parse_options()
+ *
+ * Parses the server's command line options:
+ *   -j <megabytes>  peak memory for a single hash join before it spills to disk
+ *   -t <threads>    number of worker threads, defaults to one per core
+ */
+static inline bool parse_options(int argc, char *argv[]) {
+    int option;
+    while ((option = getopt(argc, argv, "j:t:")) != -1) {
+        switch (option) {
+        case 'j': {
+            char *end;
+            unsigned long long megabytes = strtoull(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0') {
+                log_err("Invalid join memory budget: %s\n", optarg);
+                return false;
+            }
+            join_set_memory_budget(megabytes << 20);
+            break;
+        }
+        case 't': {
+            char *end;
+            unsigned long threads = strtoul(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || threads == 0 || threads > UINT_MAX) {
+                log_err("Invalid number of worker threads: %s\n", optarg);
+                return false;
+            }
+            worker_threads = threads;
+            break;
+        }
+        default:
+            log_err("Usage: %s [-j join_memory_mb] [-t threads]\n", argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (!parse_options(argc, argv)) {
+        return 1;
+    }
+
     if (!setup_server()) {
         return 1;
     }
@@ -0,0 +1,322 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sort.h"
+#include "thread_pool.h"
+
+// Inputs of at least this many values are sorted in parallel, with every thread taking a chunk of
+// at least RADIX_SORT_MIN_CHUNK values.
+#define RADIX_SORT_PARALLEL_THRESHOLD (1 << 20)
+#define RADIX_SORT_MIN_CHUNK (1 << 18)
+#define RADIX_SORT_BUCKETS 0x100
+// Buckets of at least this many values fork the sorts of their sub-buckets as tasks of their own,
+// so that skewed inputs, with most values in a few buckets, are still sorted in parallel.
+#define RADIX_SORT_SPLIT_SIZE (1 << 16)
+
+// State shared by the threads of a sort. Records are scattered into buffer by the top byte of
+// their value, then every bucket is sorted by the lower bytes on its own. Passes alternate
+// between buffer and the output arrays, so that the last one lands in the output arrays.
+typedef struct RadixSort {
+    int *values_in;
+    unsigned int *indices_in;
+    int *values_out;
+    unsigned int *indices_out;
+    Record *buffer;
+    size_t bucket_starts[RADIX_SORT_BUCKETS + 1];
+    unsigned char bucket_order[RADIX_SORT_BUCKETS];
+    bool parallel;
+} RadixSort;
+
+typedef struct RadixSortTask {
+    RadixSort *sort;
+    size_t start;
+    size_t end;
+    // Number of values of the chunk per bucket, then where the chunk scatters them to.
+    size_t offsets[RADIX_SORT_BUCKETS];
+    bool ascending;
+} RadixSortTask;
+
+// Records from start to end, sorted by a task of their own.
+typedef struct RadixSortRange {
+    RadixSort *sort;
+    size_t start;
+    size_t end;
+} RadixSortRange;
+
+// Flipping the sign bit orders the top bytes of negative values first.
+static inline unsigned int radix_sort_top_byte(int value) {
+    return ((unsigned int) value >> 24) ^ 0x80;
+}
+
+static void *radix_sort_count_routine(void *data) {
+    RadixSortTask *task = data;
+    int *values = task->sort->values_in;
+
+    memset(task->offsets, 0, sizeof(task->offsets));
+
+    bool ascending = true;
+    int prev = task->start > 0 ? values[task->start - 1] : INT_MIN;
+    for (size_t i = task->start; i < task->end; i++) {
+        int value = values[i];
+        task->offsets[radix_sort_top_byte(value)]++;
+        ascending &= prev <= value;
+        prev = value;
+    }
+    task->ascending = ascending;
+
+    return NULL;
+}
+
+static void *radix_sort_scatter_routine(void *data) {
+    RadixSortTask *task = data;
+    RadixSort *sort = task->sort;
+    int *values = sort->values_in;
+    unsigned int *indices = sort->indices_in;
+    Record *buffer = sort->buffer;
+
+    for (size_t i = task->start; i < task->end; i++) {
+        Record *r = &buffer[task->offsets[radix_sort_top_byte(values[i])]++];
+        r->value = values[i];
+        r->position = indices != NULL ? indices[i] : i;
+    }
+
+    return NULL;
+}
+
+// Sorts values and their indices by their two lowest bytes, least significant first, skipping
+// bytes that all of them share. The first pass moves them to tmp and the last one moves them
+// back, so with a single byte to sort by, the first pass only copies.
+static void radix_sort_lsb(int *values, unsigned int *indices, Record *tmp, size_t size) {
+    size_t counts[2][RADIX_SORT_BUCKETS] = {{0}};
+    bool ascending = true;
+    int prev = INT_MIN;
+    for (size_t i = 0; i < size; i++) {
+        int value = values[i];
+        counts[0][value & 0xFF]++;
+        counts[1][(value >> 8) & 0xFF]++;
+        ascending &= prev <= value;
+        prev = value;
+    }
+
+    unsigned int passes[2];
+    unsigned int passes_count = 0;
+    for (unsigned int p = 0; p < 2 && !ascending; p++) {
+        if (counts[p][(values[0] >> (8 * p)) & 0xFF] < size) {
+            passes[passes_count++] = p;
+        }
+    }
+
+    if (passes_count == 0) {
+        return;
+    }
+
+    size_t offsets[RADIX_SORT_BUCKETS];
+    size_t offset = 0;
+    if (passes_count == 2) {
+        for (unsigned int b = 0; b < RADIX_SORT_BUCKETS; b++) {
+            offsets[b] = offset;
+            offset += counts[0][b];
+        }
+
+        for (size_t i = 0; i < size; i++) {
+            Record *r = &tmp[offsets[values[i] & 0xFF]++];
+            r->value = values[i];
+            r->position = indices[i];
+        }
+    } else {
+        for (size_t i = 0; i < size; i++) {
+            tmp[i].value = values[i];
+            tmp[i].position = indices[i];
+        }
+    }
+
+    unsigned int shift = 8 * passes[passes_count - 1];
+    offset = 0;
+    for (unsigned int b = 0; b < RADIX_SORT_BUCKETS; b++) {
+        offsets[b] = offset;
+        offset += counts[passes[passes_count - 1]][b];
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        size_t o = offsets[(tmp[i].value >> shift) & 0xFF]++;
+        values[o] = tmp[i].value;
+        indices[o] = tmp[i].position;
+    }
+}
+
+static void *radix_sort_lsb_routine(void *data) {
+    RadixSortRange *range = data;
+    RadixSort *sort = range->sort;
+    radix_sort_lsb(sort->values_out + range->start, sort->indices_out + range->start,
+            sort->buffer + range->start, range->end - range->start);
+    return NULL;
+}
+
+// Sorts the records of a bucket, which share their top byte. They are split once more by their
+// third byte into the output arrays, so that the remaining passes run on chunks small enough to
+// stay in cache.
+static void radix_sort_bucket(RadixSort *sort, size_t start, size_t end) {
+    size_t size = end - start;
+    Record *src = sort->buffer + start;
+    int *values_out = sort->values_out + start;
+    unsigned int *indices_out = sort->indices_out + start;
+
+    size_t counts[RADIX_SORT_BUCKETS] = {0};
+    for (size_t i = 0; i < size; i++) {
+        counts[(src[i].value >> 16) & 0xFF]++;
+    }
+
+    size_t offsets[RADIX_SORT_BUCKETS];
+    size_t offset = 0;
+    for (unsigned int b = 0; b < RADIX_SORT_BUCKETS; b++) {
+        offsets[b] = offset;
+        offset += counts[b];
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        size_t o = offsets[(src[i].value >> 16) & 0xFF]++;
+        values_out[o] = src[i].value;
+        indices_out[o] = src[i].position;
+    }
+
+    if (!sort->parallel || size < RADIX_SORT_SPLIT_SIZE) {
+        offset = 0;
+        for (unsigned int b = 0; b < RADIX_SORT_BUCKETS; b++) {
+            radix_sort_lsb(values_out + offset, indices_out + offset, src + offset, counts[b]);
+            offset += counts[b];
+        }
+        return;
+    }
+
+    RadixSortRange ranges[RADIX_SORT_BUCKETS];
+    ThreadPoolGroup group;
+    thread_pool_group_init(&group);
+
+    offset = start;
+    for (unsigned int b = 0; b < RADIX_SORT_BUCKETS; b++) {
+        ranges[b].sort = sort;
+        ranges[b].start = offset;
+        ranges[b].end = offset + counts[b];
+        if (counts[b] > 0) {
+            thread_pool_fork(&group, &radix_sort_lsb_routine, ranges + b);
+        }
+        offset += counts[b];
+    }
+
+    thread_pool_join(&group);
+}
+
+static void *radix_sort_bucket_routine(void *data) {
+    RadixSortRange *range = data;
+    radix_sort_bucket(range->sort, range->start, range->end);
+    return NULL;
+}
+
+// The input is split into one chunk per thread. Each thread counts the top bytes of its chunk,
+// then scatters it to the buckets at offsets derived from all counts, so that the scatter is
+// stable. Every bucket is then sorted by the remaining bytes as a task of its own, and idle
+// threads steal the largest ones first.
+void radix_sort_indices(int *values_in, unsigned int *indices_in, int *values_out,
+        unsigned int *indices_out, size_t size) {
+    unsigned int threads_count = 1;
+    if (size >= RADIX_SORT_PARALLEL_THRESHOLD) {
+        size_t max_threads = size / RADIX_SORT_MIN_CHUNK;
+        threads_count = thread_pool_size() < max_threads ? thread_pool_size() : max_threads;
+    }
+
+    RadixSort sort;
+    sort.values_in = values_in;
+    sort.indices_in = indices_in;
+    sort.values_out = values_out;
+    sort.indices_out = indices_out;
+    sort.parallel = threads_count > 1;
+
+    RadixSortTask tasks[threads_count];
+    for (unsigned int t = 0; t < threads_count; t++) {
+        tasks[t].sort = &sort;
+        tasks[t].start = size * t / threads_count;
+        tasks[t].end = size * (t + 1) / threads_count;
+    }
+
+    thread_pool_run(&radix_sort_count_routine, tasks, sizeof(RadixSortTask), threads_count);
+
+    bool ascending = true;
+    for (unsigned int t = 0; t < threads_count; t++) {
+        ascending &= tasks[t].ascending;
+    }
+
+    if (ascending) {
+        if (values_out != values_in) {
+            memcpy(values_out, values_in, size * sizeof(int));
+        }
+        if (indices_in == NULL) {
+            for (size_t i = 0; i < size; i++) {
+                indices_out[i] = i;
+            }
+        } else if (indices_out != indices_in) {
+            memcpy(indices_out, indices_in, size * sizeof(unsigned int));
+        }
+        return;
+    }
+
+    size_t offset = 0;
+    for (unsigned int b = 0; b < RADIX_SORT_BUCKETS; b++) {
+        sort.bucket_starts[b] = offset;
+        for (unsigned int t = 0; t < threads_count; t++) {
+            size_t count = tasks[t].offsets[b];
+            tasks[t].offsets[b] = offset;
+            offset += count;
+        }
+        sort.bucket_order[b] = b;
+    }
+    sort.bucket_starts[RADIX_SORT_BUCKETS] = size;
+
+    if (sort.parallel) {
+        for (unsigned int i = 1; i < RADIX_SORT_BUCKETS; i++) {
+            unsigned char bucket = sort.bucket_order[i];
+            size_t bucket_size = sort.bucket_starts[bucket + 1] - sort.bucket_starts[bucket];
+
+            unsigned int j = i;
+            for (; j > 0; j--) {
+                unsigned char other = sort.bucket_order[j - 1];
+                if (sort.bucket_starts[other + 1] - sort.bucket_starts[other] >= bucket_size) {
+                    break;
+                }
+                sort.bucket_order[j] = other;
+            }
+            sort.bucket_order[j] = bucket;
+        }
+    }
+
+    sort.buffer = malloc(size * sizeof(Record));
+
+    thread_pool_run(&radix_sort_scatter_routine, tasks, sizeof(RadixSortTask), threads_count);
+
+    if (sort.parallel) {
+        RadixSortRange ranges[RADIX_SORT_BUCKETS];
+        ThreadPoolGroup group;
+        thread_pool_group_init(&group);
+
+        // Forked largest first, as threads steal the oldest tasks.
+        for (unsigned int i = 0; i < RADIX_SORT_BUCKETS; i++) {
+            unsigned char bucket = sort.bucket_order[i];
+            ranges[i].sort = &sort;
+            ranges[i].start = sort.bucket_starts[bucket];
+            ranges[i].end = sort.bucket_starts[bucket + 1];
+            if (ranges[i].start < ranges[i].end) {
+                thread_pool_fork(&group, &radix_sort_bucket_routine, ranges + i);
+            }
+        }
+
+        thread_pool_join(&group);
+    } else {
+        for (unsigned int b = 0; b < RADIX_SORT_BUCKETS; b++) {
+            radix_sort_bucket(&sort, sort.bucket_starts[b], sort.bucket_starts[b + 1]);
+        }
+    }
+
+    free(sort.buffer);
+}
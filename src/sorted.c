@@ -1,99 +1,545 @@
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "sorted.h"
 #include "utils.h"
 #include "vector.h"
 
-void sorted_init(SortedIndex *index, int *values, unsigned int *positions, unsigned int size) {
-    if (size == 0) {
-        int_vector_init(&index->values, 0);
-        pos_vector_init(&index->positions, 0);
+#define SORTED_CACHE_LINE_SIZE 64
+#define SORTED_LINE_VALUES (SORTED_CACHE_LINE_SIZE / sizeof(int))
+#define SORTED_SEGMENT_SIZE 64
+// Densities allowed for a window spanning the whole array. Windows of a single segment may be
+// anywhere from one entry to full, and thresholds in between are interpolated by window height.
+#define SORTED_ROOT_UPPER_DENSITY 0.75
+#define SORTED_ROOT_LOWER_DENSITY 0.25
+
+static inline void *sorted_alloc(size_t size) {
+    void *data;
+    if (posix_memalign(&data, SORTED_CACHE_LINE_SIZE, size) != 0) {
+        return NULL;
+    }
+    return data;
+}
+
+// Grows the position map, if any, to hold position.
+static inline void sorted_slots_reserve(SortedIndex *index, unsigned int position) {
+    if (index->slots == NULL || position < index->slots_capacity) {
         return;
     }
 
-    int_vector_init(&index->values, size);
-    memcpy(index->values.data, values, size * sizeof(int));
-    index->values.size = size;
+    unsigned int capacity = round_up_power_of_two(position + 1);
+    index->slots = realloc(index->slots, capacity * sizeof(unsigned int));
+    index->slots_capacity = capacity;
+}
+
+// Points the positions in slots [from, to) back at them, after they moved.
+static inline void sorted_slots_update(SortedIndex *index, unsigned int from, unsigned int to) {
+    if (index->slots == NULL) {
+        return;
+    }
+
+    for (unsigned int slot = from; slot < to; slot++) {
+        index->slots[index->positions[slot]] = slot;
+    }
+}
+
+// Sets the tree node of a segment to its first value. In a perfect tree, the node of in-order rank
+// r sits at depth given by the trailing zeros of r + 1.
+static inline void sorted_tree_set(SortedIndex *index, unsigned int segment) {
+    unsigned int x = segment + 1;
+    unsigned int k = (index->tree_size + x) >> (__builtin_ctz(x) + 1);
+    index->tree[k] = index->counts[segment] > 0 ? index->values[segment * SORTED_SEGMENT_SIZE]
+            : INT_MAX;
+}
+
+// Returns the number of segments whose first value is < value (or <= value if inclusive). The
+// tree is perfect, so the bits of the path taken below the root are exactly that count. Each step
+// prefetches the line holding the node's descendants four levels down.
+static inline unsigned int sorted_tree_search(SortedIndex *index, int value, bool inclusive) {
+    int *tree = index->tree;
+    unsigned int tree_size = index->tree_size;
+
+    unsigned int k = 1;
+    while (k < tree_size) {
+        __builtin_prefetch(tree + k * SORTED_LINE_VALUES);
+        k = 2 * k + (inclusive ? tree[k] <= value : tree[k] < value);
+    }
+
+    // Padding compares as INT_MAX, so an inclusive search for INT_MAX can count it.
+    unsigned int segments = k - tree_size;
+    return segments < index->num_segments ? segments : index->num_segments;
+}
+
+// Returns the segment a value belongs to, i.e. the last one starting at or before it.
+static inline unsigned int sorted_segment(SortedIndex *index, int value, bool inclusive) {
+    unsigned int segments = sorted_tree_search(index, value, inclusive);
+    return segments > 0 ? segments - 1 : 0;
+}
+
+// Returns the slot of the first value >= value (or > value if inclusive). Slots are offsets into
+// the gapped arrays, and the result is either an occupied slot or the start of the next segment.
+static inline unsigned int sorted_bound(SortedIndex *index, int value, bool inclusive) {
+    unsigned int segment = sorted_segment(index, value, inclusive);
+    unsigned int start = segment * SORTED_SEGMENT_SIZE;
+    unsigned int count = index->counts[segment];
+
+    int *values = index->values + start;
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        offset += inclusive ? values[i] <= value : values[i] < value;
+    }
+
+    return offset < count ? start + offset : start + SORTED_SEGMENT_SIZE;
+}
+
+// Returns the occupied slot after the given one, or the capacity at the end.
+static inline unsigned int sorted_next(SortedIndex *index, unsigned int slot) {
+    unsigned int segment = slot / SORTED_SEGMENT_SIZE;
+    unsigned int start = segment * SORTED_SEGMENT_SIZE;
+    return slot + 1 < start + index->counts[segment] ? slot + 1 : start + SORTED_SEGMENT_SIZE;
+}
+
+// Copies the positions of the occupied slots in [from, to), skipping the gaps.
+static inline unsigned int sorted_copy(SortedIndex *index, unsigned int from, unsigned int to,
+        unsigned int *result) {
+    unsigned int result_count = 0;
+    while (from < to) {
+        unsigned int segment = from / SORTED_SEGMENT_SIZE;
+        unsigned int start = segment * SORTED_SEGMENT_SIZE;
+        unsigned int end = start + index->counts[segment];
+        end = end < to ? end : to;
+
+        if (from < end) {
+            memcpy(result + result_count, index->positions + from,
+                    (end - from) * sizeof(unsigned int));
+            result_count += end - from;
+        }
+
+        from = start + SORTED_SEGMENT_SIZE;
+    }
+    return result_count;
+}
+
+// Copies the entries of segments [first, first + num) to values and positions.
+static inline unsigned int sorted_gather(SortedIndex *index, unsigned int first, unsigned int num,
+        int *values, unsigned int *positions) {
+    unsigned int size = 0;
+    for (unsigned int i = first; i < first + num; i++) {
+        unsigned int start = i * SORTED_SEGMENT_SIZE;
+        unsigned int count = index->counts[i];
+        memcpy(values + size, index->values + start, count * sizeof(int));
+        memcpy(positions + size, index->positions + start, count * sizeof(unsigned int));
+        size += count;
+    }
+    return size;
+}
+
+// Spreads size entries evenly over segments [first, first + num).
+static inline void sorted_spread(SortedIndex *index, unsigned int first, unsigned int num,
+        int *values, unsigned int *positions, unsigned int size) {
+    unsigned int per_segment = size / num;
+    unsigned int remainder = size % num;
+
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < num; i++) {
+        unsigned int segment = first + i;
+        unsigned int start = segment * SORTED_SEGMENT_SIZE;
+        unsigned int count = per_segment + (i < remainder);
+
+        memcpy(index->values + start, values + offset, count * sizeof(int));
+        memcpy(index->positions + start, positions + offset, count * sizeof(unsigned int));
+        index->counts[segment] = count;
+        sorted_tree_set(index, segment);
+        sorted_slots_update(index, start, start + count);
+
+        offset += count;
+    }
+}
+
+// Replaces the arrays with num_segments segments holding the given entries.
+static void sorted_layout(SortedIndex *index, unsigned int num_segments, int *values,
+        unsigned int *positions, unsigned int size) {
+    free(index->values);
+    free(index->positions);
+    free(index->counts);
+    free(index->tree);
+
+    unsigned int capacity = num_segments * SORTED_SEGMENT_SIZE;
+    index->values = sorted_alloc(capacity * sizeof(int));
+    index->positions = sorted_alloc(capacity * sizeof(unsigned int));
+    index->counts = malloc(num_segments * sizeof(unsigned int));
+    index->num_segments = num_segments;
+    index->size = size;
+
+    index->tree_size = 2 * num_segments;
+    index->tree = sorted_alloc(index->tree_size * sizeof(int));
+    for (unsigned int i = 0; i < index->tree_size; i++) {
+        index->tree[i] = INT_MAX;
+    }
+
+    sorted_spread(index, 0, num_segments, values, positions, size);
+}
+
+// Returns the number of segments that leaves an array of size entries about half full.
+static inline unsigned int sorted_num_segments(unsigned int size) {
+    unsigned int num_segments = round_up_power_of_two(
+            (2 * size + SORTED_SEGMENT_SIZE - 1) / SORTED_SEGMENT_SIZE);
+    return num_segments > 0 ? num_segments : 1;
+}
+
+static void sorted_resize(SortedIndex *index, unsigned int num_segments, int value,
+        unsigned int position, bool insert) {
+    unsigned int size = index->size + insert;
+    int *values = malloc(size * sizeof(int));
+    unsigned int *positions = malloc(size * sizeof(unsigned int));
+
+    unsigned int gathered = sorted_gather(index, 0, index->num_segments, values, positions);
+    if (insert) {
+        unsigned int idx = binary_search_right(values, gathered, value);
+        memmove(values + idx + 1, values + idx, (gathered - idx) * sizeof(int));
+        memmove(positions + idx + 1, positions + idx, (gathered - idx) * sizeof(unsigned int));
+        values[idx] = value;
+        positions[idx] = position;
+    }
+
+    sorted_layout(index, num_segments, values, positions, size);
 
-    pos_vector_init(&index->positions, size);
-    if (positions == NULL) {
+    free(values);
+    free(positions);
+}
+
+void sorted_init(SortedIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    index->values = NULL;
+    index->positions = NULL;
+    index->counts = NULL;
+    index->tree = NULL;
+    index->slots = NULL;
+    index->slots_capacity = 0;
+
+    unsigned int *default_positions = NULL;
+    if (positions == NULL && size > 0) {
+        positions = default_positions = malloc(size * sizeof(unsigned int));
         for (unsigned int i = 0; i < size; i++) {
-            index->positions.data[i] = i;
+            positions[i] = i;
         }
-    } else {
-        memcpy(index->positions.data, positions, size * sizeof(unsigned int));
     }
-    index->positions.size = size;
+
+    sorted_layout(index, sorted_num_segments(size), values, positions, size);
+
+    free(default_positions);
 }
 
 void sorted_destroy(SortedIndex *index) {
-    int_vector_destroy(&index->values);
-    pos_vector_destroy(&index->positions);
+    free(index->values);
+    free(index->positions);
+    free(index->counts);
+    free(index->tree);
+    free(index->slots);
 }
 
-bool sorted_save(SortedIndex *index, FILE *file) {
-    if (!int_vector_save(&index->values, file)) {
-        return false;
+void sorted_track_positions(SortedIndex *index) {
+    if (index->slots != NULL) {
+        return;
     }
 
-    if (!pos_vector_save(&index->positions, file)) {
-        return false;
+    unsigned int max_position = 0;
+    for (unsigned int i = 0; i < index->num_segments; i++) {
+        unsigned int start = i * SORTED_SEGMENT_SIZE;
+        for (unsigned int slot = start; slot < start + index->counts[i]; slot++) {
+            unsigned int position = index->positions[slot];
+            max_position = position > max_position ? position : max_position;
+        }
     }
 
-    return true;
+    index->slots_capacity = round_up_power_of_two(max_position + 1);
+    index->slots = malloc(index->slots_capacity * sizeof(unsigned int));
+
+    for (unsigned int i = 0; i < index->num_segments; i++) {
+        unsigned int start = i * SORTED_SEGMENT_SIZE;
+        sorted_slots_update(index, start, start + index->counts[i]);
+    }
 }
 
-bool sorted_load(SortedIndex *index, FILE *file) {
-    int_vector_init(&index->values, 0);
-    pos_vector_init(&index->positions, 0);
+void sorted_merge(SortedIndex *index, int *values, unsigned int *positions, unsigned int size) {
+    // Small batches go through the gaps. Large ones are cheaper to merge with a full pass.
+    if ((unsigned long long int) size * SORTED_SEGMENT_SIZE < index->size) {
+        for (unsigned int i = 0; i < size; i++) {
+            sorted_insert(index, values[i], positions[i]);
+        }
+        return;
+    }
 
-    if (!int_vector_load(&index->values, file)) {
-        return false;
+    for (unsigned int i = 0; i < size; i++) {
+        sorted_slots_reserve(index, positions[i]);
+    }
+
+    unsigned int i = index->size;
+    unsigned int j = size;
+    unsigned int k = i + size;
+
+    int *dst_values = malloc(k * sizeof(int));
+    unsigned int *dst_positions = malloc(k * sizeof(unsigned int));
+    sorted_gather(index, 0, index->num_segments, dst_values, dst_positions);
+
+    // Merge from the back, so that existing entries are moved at most once. Equal values from the
+    // batch go after existing ones, as with sorted_insert.
+    while (j > 0) {
+        k--;
+        if (i > 0 && dst_values[i - 1] > values[j - 1]) {
+            i--;
+            dst_values[k] = dst_values[i];
+            dst_positions[k] = dst_positions[i];
+        } else {
+            j--;
+            dst_values[k] = values[j];
+            dst_positions[k] = positions[j];
+        }
+    }
+
+    unsigned int merged_size = index->size + size;
+    sorted_layout(index, sorted_num_segments(merged_size), dst_values, dst_positions,
+            merged_size);
+
+    free(dst_values);
+    free(dst_positions);
+}
+
+void sorted_remove_if(SortedIndex *index, bool (*removed)(void *, unsigned int), void *data) {
+    int *kept_values = malloc(index->size * sizeof(int));
+    unsigned int *kept_positions = malloc(index->size * sizeof(unsigned int));
+
+    unsigned int k = 0;
+    for (unsigned int segment = 0; segment < index->num_segments; segment++) {
+        unsigned int start = segment * SORTED_SEGMENT_SIZE;
+        for (unsigned int slot = start; slot < start + index->counts[segment]; slot++) {
+            if (!removed(data, index->positions[slot])) {
+                kept_values[k] = index->values[slot];
+                kept_positions[k] = index->positions[slot];
+                k++;
+            }
+        }
     }
 
-    if (!pos_vector_load(&index->positions, file)) {
+    sorted_layout(index, sorted_num_segments(k), kept_values, kept_positions, k);
+
+    free(kept_values);
+    free(kept_positions);
+}
+
+bool sorted_save(SortedIndex *index, FILE *file) {
+    // Saved packed, in the same format as a plain sorted array.
+    IntVector values;
+    int_vector_init(&values, index->size);
+    PosVector positions;
+    pos_vector_init(&positions, index->size);
+
+    sorted_gather(index, 0, index->num_segments, values.data, positions.data);
+    values.size = index->size;
+    positions.size = index->size;
+
+    bool success = int_vector_save(&values, file) && pos_vector_save(&positions, file);
+
+    int_vector_destroy(&values);
+    pos_vector_destroy(&positions);
+
+    return success;
+}
+
+bool sorted_load(SortedIndex *index, FILE *file) {
+    IntVector values;
+    int_vector_init(&values, 0);
+    PosVector positions;
+    pos_vector_init(&positions, 0);
+
+    if (!int_vector_load(&values, file) || !pos_vector_load(&positions, file)) {
+        int_vector_destroy(&values);
+        pos_vector_destroy(&positions);
         return false;
     }
 
+    sorted_init(index, values.data, positions.data, values.size);
+
+    int_vector_destroy(&values);
+    pos_vector_destroy(&positions);
+
     return true;
 }
 
+// Inserts into a full segment by spreading the smallest enclosing window that stays within its
+// density threshold, doubling the array if none does.
+static void sorted_rebalance_insert(SortedIndex *index, unsigned int segment, int value,
+        unsigned int position) {
+    unsigned int height = __builtin_ctz(index->num_segments);
+
+    for (unsigned int level = 1; level <= height; level++) {
+        unsigned int num = 1 << level;
+        unsigned int first = segment & ~(num - 1);
+
+        unsigned int count = 0;
+        for (unsigned int i = first; i < first + num; i++) {
+            count += index->counts[i];
+        }
+
+        double upper = 1 - (1 - SORTED_ROOT_UPPER_DENSITY) * level / height;
+        if (count + 1 > upper * num * SORTED_SEGMENT_SIZE) {
+            continue;
+        }
+
+        int *values = malloc((count + 1) * sizeof(int));
+        unsigned int *positions = malloc((count + 1) * sizeof(unsigned int));
+        sorted_gather(index, first, num, values, positions);
+
+        unsigned int idx = binary_search_right(values, count, value);
+        memmove(values + idx + 1, values + idx, (count - idx) * sizeof(int));
+        memmove(positions + idx + 1, positions + idx, (count - idx) * sizeof(unsigned int));
+        values[idx] = value;
+        positions[idx] = position;
+
+        sorted_spread(index, first, num, values, positions, count + 1);
+        index->size++;
+
+        free(values);
+        free(positions);
+        return;
+    }
+
+    sorted_resize(index, 2 * index->num_segments, value, position, true);
+}
+
+// Refills an emptied segment by spreading the smallest enclosing window that keeps every segment
+// non-empty and stays within its density threshold. The whole array always qualifies, since it
+// is halved once it drops below its lower threshold.
+static void sorted_rebalance_remove(SortedIndex *index, unsigned int segment) {
+    unsigned int height = __builtin_ctz(index->num_segments);
+
+    for (unsigned int level = 1; level <= height; level++) {
+        unsigned int num = 1 << level;
+        unsigned int first = segment & ~(num - 1);
+
+        unsigned int count = 0;
+        for (unsigned int i = first; i < first + num; i++) {
+            count += index->counts[i];
+        }
+
+        double lower = SORTED_ROOT_LOWER_DENSITY * level / height;
+        if (count < num || count < lower * num * SORTED_SEGMENT_SIZE) {
+            continue;
+        }
+
+        int *values = malloc(count * sizeof(int));
+        unsigned int *positions = malloc(count * sizeof(unsigned int));
+        sorted_gather(index, first, num, values, positions);
+        sorted_spread(index, first, num, values, positions, count);
+
+        free(values);
+        free(positions);
+        return;
+    }
+}
+
 void sorted_insert(SortedIndex *index, int value, unsigned int position) {
-    unsigned int idx = binary_search_right(index->values.data, index->values.size, value);
+    sorted_slots_reserve(index, position);
+
+    unsigned int segment = sorted_segment(index, value, true);
+    unsigned int start = segment * SORTED_SEGMENT_SIZE;
+    unsigned int count = index->counts[segment];
+
+    if (count == SORTED_SEGMENT_SIZE) {
+        sorted_rebalance_insert(index, segment, value, position);
+        return;
+    }
+
+    int *values = index->values + start;
+    unsigned int *positions = index->positions + start;
+
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        offset += values[i] <= value;
+    }
+
+    memmove(values + offset + 1, values + offset, (count - offset) * sizeof(int));
+    memmove(positions + offset + 1, positions + offset, (count - offset) * sizeof(unsigned int));
+    values[offset] = value;
+    positions[offset] = position;
+
+    index->counts[segment]++;
+    index->size++;
+
+    sorted_slots_update(index, start + offset, start + count + 1);
+
+    if (offset == 0) {
+        sorted_tree_set(index, segment);
+    }
+}
+
+static inline void sorted_remove_slot(SortedIndex *index, unsigned int slot) {
+    unsigned int segment = slot / SORTED_SEGMENT_SIZE;
+    unsigned int start = segment * SORTED_SEGMENT_SIZE;
+    unsigned int offset = slot - start;
+    unsigned int count = index->counts[segment];
+
+    memmove(index->values + slot, index->values + slot + 1,
+            (count - offset - 1) * sizeof(int));
+    memmove(index->positions + slot, index->positions + slot + 1,
+            (count - offset - 1) * sizeof(unsigned int));
+
+    index->counts[segment]--;
+    index->size--;
+
+    sorted_slots_update(index, slot, start + count - 1);
+
+    unsigned int capacity = index->num_segments * SORTED_SEGMENT_SIZE;
+    if (index->num_segments > 1 && index->size < SORTED_ROOT_LOWER_DENSITY * capacity) {
+        sorted_resize(index, index->num_segments / 2, 0, 0, false);
+    } else if (index->counts[segment] == 0 && index->num_segments > 1) {
+        sorted_rebalance_remove(index, segment);
+    } else if (offset == 0) {
+        sorted_tree_set(index, segment);
+    }
+}
+
+// Returns the slot the position map holds for position if it is current, or the capacity.
+static inline unsigned int sorted_mapped_slot(SortedIndex *index, int value,
+        unsigned int position) {
+    unsigned int capacity = index->num_segments * SORTED_SEGMENT_SIZE;
+    if (position >= index->slots_capacity) {
+        return capacity;
+    }
 
-    int_vector_insert(&index->values, idx, value);
-    pos_vector_insert(&index->positions, idx, position);
+    unsigned int slot = index->slots[position];
+    if (slot >= capacity || slot % SORTED_SEGMENT_SIZE >= index->counts[slot / SORTED_SEGMENT_SIZE]
+            || index->values[slot] != value || index->positions[slot] != position) {
+        return capacity;
+    }
+    return slot;
 }
 
 bool sorted_remove(SortedIndex *index, int value, unsigned int position,
         unsigned int *positions_map, unsigned int *position_ptr) {
-    for (unsigned int idx = binary_search_left(index->values.data, index->values.size, value);
-            idx < index->values.size && index->values.data[idx] == value; idx++) {
-        unsigned int raw_pos = index->positions.data[idx];
-        unsigned int pos = positions_map != NULL ? positions_map[raw_pos] : raw_pos;
+    if (index->size == 0) {
+        return false;
+    }
 
-        if (pos == position) {
+    if (positions_map == NULL) {
+        unsigned int slot = sorted_mapped_slot(index, value, position);
+        if (slot < index->num_segments * SORTED_SEGMENT_SIZE) {
             if (position_ptr != NULL) {
-                *position_ptr = raw_pos;
+                *position_ptr = position;
             }
 
-            int_vector_remove(&index->values, idx);
-            pos_vector_remove(&index->positions, idx);
+            sorted_remove_slot(index, slot);
 
             return true;
         }
     }
 
-    return false;
-}
-
-bool sorted_search(SortedIndex *index, int value, unsigned int position,
-        unsigned int *positions_map, unsigned int *position_ptr) {
-    for (unsigned int idx = binary_search_left(index->values.data, index->values.size, value);
-            idx < index->values.size && index->values.data[idx] == value; idx++) {
-        unsigned int raw_pos = index->positions.data[idx];
+    unsigned int capacity = index->num_segments * SORTED_SEGMENT_SIZE;
+    for (unsigned int slot = sorted_bound(index, value, false);
+            slot < capacity && index->values[slot] == value; slot = sorted_next(index, slot)) {
+        unsigned int raw_pos = index->positions[slot];
         unsigned int pos = positions_map != NULL ? positions_map[raw_pos] : raw_pos;
 
         if (pos == position) {
@@ -101,6 +547,8 @@ bool sorted_search(SortedIndex *index, int value, unsigned int position,
                 *position_ptr = raw_pos;
             }
 
+            sorted_remove_slot(index, slot);
+
             return true;
         }
     }
@@ -108,77 +556,69 @@ bool sorted_search(SortedIndex *index, int value, unsigned int position,
     return false;
 }
 
-static inline int sorted_search_left(IntVector *values, int value) {
-    unsigned int idx = binary_search_left(values->data, values->size, value);
-    if (idx == values->size) {
-        return -1;
+bool sorted_search(SortedIndex *index, int value, unsigned int position,
+        unsigned int *positions_map, unsigned int *position_ptr) {
+    if (index->size == 0) {
+        return false;
     }
 
-    return idx;
-}
+    if (positions_map == NULL
+            && sorted_mapped_slot(index, value, position)
+                    < index->num_segments * SORTED_SEGMENT_SIZE) {
+        if (position_ptr != NULL) {
+            *position_ptr = position;
+        }
 
-static inline int sorted_search_right(IntVector *values, int value) {
-    unsigned int idx = binary_search_left(values->data, values->size, value);
-    if (idx == 0) {
-        return -1;
+        return true;
     }
 
-    return idx - 1;
-}
+    unsigned int capacity = index->num_segments * SORTED_SEGMENT_SIZE;
+    for (unsigned int slot = sorted_bound(index, value, false);
+            slot < capacity && index->values[slot] == value; slot = sorted_next(index, slot)) {
+        unsigned int raw_pos = index->positions[slot];
+        unsigned int pos = positions_map != NULL ? positions_map[raw_pos] : raw_pos;
 
-unsigned int sorted_select_lower(SortedIndex *index, int high, unsigned int *result) {
-    int idx = sorted_search_right(&index->values, high);
-    if (idx == -1) {
-        return 0;
+        if (pos == position) {
+            if (position_ptr != NULL) {
+                *position_ptr = raw_pos;
+            }
+
+            return true;
+        }
     }
 
-    memcpy(result, index->positions.data, (idx + 1) * sizeof(unsigned int));
+    return false;
+}
 
-    return idx + 1;
+unsigned int sorted_select_lower(SortedIndex *index, int high, unsigned int *result) {
+    return sorted_copy(index, 0, sorted_bound(index, high, false), result);
 }
 
 unsigned int sorted_select_higher(SortedIndex *index, int low, unsigned int *result) {
-    int idx = sorted_search_left(&index->values, low);
-    if (idx == -1) {
-        return 0;
-    }
-
-    memcpy(result, index->positions.data + idx, (index->values.size - idx) * sizeof(unsigned int));
-
-    return index->values.size - idx;
+    return sorted_copy(index, sorted_bound(index, low, false),
+            index->num_segments * SORTED_SEGMENT_SIZE, result);
 }
 
 unsigned int sorted_select_range(SortedIndex *index, int low, int high, unsigned int *result) {
-    int left_idx = sorted_search_left(&index->values, low);
-    if (left_idx == -1) {
-        return 0;
-    }
-
-    int right_idx = sorted_search_right(&index->values, high);
-    if (right_idx == -1) {
-        return 0;
-    }
-
-    memcpy(result, index->positions.data + left_idx,
-            (right_idx - left_idx + 1) * sizeof(unsigned int));
-
-    return right_idx - left_idx + 1;
+    return sorted_copy(index, sorted_bound(index, low, false), sorted_bound(index, high, false),
+            result);
 }
 
 int sorted_min(SortedIndex *index, unsigned int *position_ptr) {
     if (position_ptr != NULL) {
-        *position_ptr = index->positions.data[0];
+        *position_ptr = index->positions[0];
     }
 
-    return index->values.data[0];
+    return index->values[0];
 }
 
 int sorted_max(SortedIndex *index, unsigned int *position_ptr) {
-    unsigned int idx = index->values.size - 1;
+    unsigned int segment = index->num_segments - 1;
+    unsigned int idx = segment * SORTED_SEGMENT_SIZE + index->counts[segment] - 1;
 
     if (position_ptr != NULL) {
-        *position_ptr = index->positions.data[idx];
+        *position_ptr = index->positions[idx];
     }
 
-    return index->values.data[idx];
+    return index->values[idx];
 }
@@ -1,20 +1,189 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "../btree.c"
+#include "../learned.c"
+#include "../sorted.c"
 
 #define NUM_VALUES 10000
 
+#define BENCHMARK_VALUES 16777216
+#define BENCHMARK_LOOKUPS 4194304
+
+#define CHURN_VALUES 262144
+#define CHURN_ROUNDS 4
+
+// Times bulk loading, point lookups and inserts, for the B-tree and for the sorted and learned
+// indexes on the same data. Node capacities are fixed at compile time, so
+// sweep them by rebuilding, e.g.:
+//   for c in 64 128 256 512 1024; do
+//       gcc -std=gnu99 -O3 -march=native -I../include -DBTREE_INTERNAL_NODE_CAPACITY=$c
+//           -DBTREE_LEAF_NODE_CAPACITY=$c btree_test.c ../utils.c ../vector.c
+//           -o btree_test
+//       ./btree_test
+//   done
+void benchmark() {
+    int *values = malloc(BENCHMARK_VALUES * sizeof(int));
+    for (int i = 0; i < BENCHMARK_VALUES; i++) {
+        values[i] = i * 2;
+    }
+
+    int *lookups = malloc(BENCHMARK_LOOKUPS * sizeof(int));
+    srand(42);
+    for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+        lookups[i] = (rand() % BENCHMARK_VALUES) * 2;
+    }
+
+    unsigned int result[2];
+    unsigned int found = 0;
+
+    printf("Capacities: %d internal, %d leaf\n", BTREE_INTERNAL_NODE_CAPACITY,
+            BTREE_LEAF_NODE_CAPACITY);
+
+    BTreeIndex index;
+
+    clock_t start = clock();
+    btree_init(&index, values, NULL, BENCHMARK_VALUES);
+    clock_t end = clock();
+    printf("Bulk Load: %f\n", (double) (end - start) / CLOCKS_PER_SEC);
+
+    start = clock();
+    for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+        found += btree_select_range(&index, lookups[i], lookups[i] + 1, result);
+    }
+    end = clock();
+    printf("Point Lookups: %f (%u found)\n", (double) (end - start) / CLOCKS_PER_SEC, found);
+
+    start = clock();
+    for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+        btree_insert(&index, lookups[i] + 1, i);
+    }
+    end = clock();
+    printf("Inserts: %f\n", (double) (end - start) / CLOCKS_PER_SEC);
+
+    btree_destroy(&index);
+
+    SortedIndex sorted;
+
+    start = clock();
+    sorted_init(&sorted, values, NULL, BENCHMARK_VALUES);
+    end = clock();
+    printf("Sorted Bulk Load: %f\n", (double) (end - start) / CLOCKS_PER_SEC);
+
+    found = 0;
+    start = clock();
+    for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+        found += sorted_select_range(&sorted, lookups[i], lookups[i] + 1, result);
+    }
+    end = clock();
+    printf("Sorted Point Lookups: %f (%u found)\n", (double) (end - start) / CLOCKS_PER_SEC,
+            found);
+
+    sorted_destroy(&sorted);
+
+    LearnedIndex learned;
+
+    start = clock();
+    learned_init(&learned, values, NULL, BENCHMARK_VALUES);
+    end = clock();
+    printf("Learned Bulk Load: %f (%u segments, %zu bytes)\n",
+            (double) (end - start) / CLOCKS_PER_SEC, learned.num_segments,
+            learned.num_segments * sizeof(LearnedSegment));
+
+    found = 0;
+    start = clock();
+    for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+        found += learned_select_range(&learned, lookups[i], lookups[i] + 1, result);
+    }
+    end = clock();
+    printf("Learned Point Lookups: %f (%u found)\n", (double) (end - start) / CLOCKS_PER_SEC,
+            found);
+
+    start = clock();
+    for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+        learned_insert(&learned, lookups[i] + 1, i);
+    }
+    end = clock();
+    printf("Learned Inserts: %f\n", (double) (end - start) / CLOCKS_PER_SEC);
+
+    // Removes the bulk loaded entries that were looked up, positioned by their rank.
+    found = 0;
+    start = clock();
+    for (int i = 0; i < BENCHMARK_LOOKUPS; i++) {
+        found += learned_remove(&learned, lookups[i], lookups[i] / 2, NULL, NULL);
+    }
+    end = clock();
+    printf("Learned Removes: %f (%u removed)\n", (double) (end - start) / CLOCKS_PER_SEC, found);
+
+    learned_destroy(&learned);
+
+    free(values);
+    free(lookups);
+}
+
+// Slides a window of CHURN_VALUES entries through the tree one insert and one remove at a time,
+// checking that emptied leaves are reclaimed and that the tree still holds exactly the window.
+void churn() {
+    BTreeIndex index;
+    btree_init(&index, NULL, NULL, 0);
+    btree_track_positions(&index);
+
+    unsigned int errors = 0;
+    unsigned int max_leaves = 0;
+    for (unsigned int i = 0; i < CHURN_VALUES * CHURN_ROUNDS; i++) {
+        btree_insert(&index, i, i);
+        if (i >= CHURN_VALUES) {
+            errors += !btree_remove(&index, i - CHURN_VALUES, i - CHURN_VALUES, NULL, NULL);
+        }
+
+        if (i % BTREE_LEAF_NODE_CAPACITY == 0) {
+            unsigned int leaves = 0;
+            for (BTreeNode *node = index.head; node != NULL; node = node->fields.leaf.next) {
+                leaves++;
+            }
+            max_leaves = leaves > max_leaves ? leaves : max_leaves;
+        }
+    }
+
+    unsigned int first = CHURN_VALUES * (CHURN_ROUNDS - 1);
+    unsigned int *result = malloc(CHURN_VALUES * sizeof(unsigned int));
+    unsigned int count = btree_select_higher(&index, INT_MIN, result);
+    errors += count != CHURN_VALUES || index.size != CHURN_VALUES;
+    for (unsigned int i = 0; i < count; i++) {
+        errors += result[i] != first + i;
+    }
+    errors += btree_min(&index, NULL) != (int) first;
+    errors += btree_max(&index, NULL) != (int) (first + CHURN_VALUES - 1);
+
+    // Leaves are split in halves, so at most twice as many as needed are left.
+    errors += max_leaves > 2 * CHURN_VALUES / BTREE_LEAF_NODE_CAPACITY + 2;
+
+    for (unsigned int i = 0; i < CHURN_VALUES; i++) {
+        errors += !btree_remove(&index, first + i, first + i, NULL, NULL);
+    }
+    errors += index.root != NULL || index.head != NULL || index.tail != NULL;
+
+    printf("Churn: %u leaves at most, %u errors\n", max_leaves, errors);
+
+    free(result);
+    btree_destroy(&index);
+}
+
 int main(int argc, char *argv[]) {
+    benchmark();
+    churn();
+
     int *values = malloc(NUM_VALUES * sizeof(int));
     for (int i = 0; i < NUM_VALUES; i++) {
         values[i] = i - NUM_VALUES / 2;
     }
 
     BTreeIndex index;
-    btree_init(&index, true, NULL, NULL, 0);
+    btree_init(&index, NULL, NULL, 0);
 
-    unsigned int pos;
+    unsigned int pos = 0;
 
     /*
     for (int i = 0; i < 50; i++) {
@@ -32,8 +201,8 @@ int main(int argc, char *argv[]) {
 
     for (int i = 1; i <= 11; i += 2) {
         for (int j = 0; j < 7; j++) {
-            btree_insert(&index, i, &pos);
-            printf("Insert: %d, %u\n", i, pos);
+            btree_insert(&index, i, pos);
+            printf("Insert: %d, %u\n", i, pos++);
         }
     }
 
@@ -43,11 +212,11 @@ int main(int argc, char *argv[]) {
     }
 
     unsigned int count = 0;
-    for (BTreeLeafNode *n = index.head; n != NULL; n = n->next) {
+    for (BTreeNode *n = index.head; n != NULL; n = n->fields.leaf.next) {
         printf("New Node\n");
-        count += n->size;
-        for (size_t i = 0; i < n->size; i++) {
-            printf("%d, %u\n", n->values[i], n->positions[i]);
+        count += n->fields.leaf.size;
+        for (size_t i = 0; i < n->fields.leaf.size; i++) {
+            printf("%d, %u\n", n->fields.leaf.values[i], n->fields.leaf.positions[i]);
         }
     }
     printf("Count: %u\n", count);
@@ -77,11 +246,11 @@ int main(int argc, char *argv[]) {
     */
 
     count = 0;
-    for (BTreeLeafNode *n = index.tail; n != NULL; n = n->prev) {
+    for (BTreeNode *n = index.head; n != NULL; n = n->fields.leaf.next) {
         printf("New Node\n");
-        count += n->size;
-        for (int i = n->size - 1; i >= 0; i--) {
-            printf("%d, %u\n", n->values[i], n->positions[i]);
+        count += n->fields.leaf.size;
+        for (size_t i = 0; i < n->fields.leaf.size; i++) {
+            printf("%d, %u\n", n->fields.leaf.values[i], n->fields.leaf.positions[i]);
         }
     }
     printf("Count: %u\n", count);
@@ -92,7 +261,7 @@ int main(int argc, char *argv[]) {
     }
     */
 
-    int *results = malloc(NUM_VALUES * sizeof(int));
+    unsigned int *results = malloc(NUM_VALUES * sizeof(unsigned int));
     unsigned int results_count;
 
     results_count = btree_select_range(&index, 3, 8, results);
@@ -101,7 +270,7 @@ int main(int argc, char *argv[]) {
         if (i > 0) {
             printf(", ");
         }
-        printf("%d", results[i]);
+        printf("%u", results[i]);
     }
     printf("\n");
 
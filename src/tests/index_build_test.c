@@ -0,0 +1,255 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "client_context.h"
+#include "db_manager.h"
+#include "db_operator.h"
+#include "epoch.h"
+#include "message.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+// Builds unclustered indexes of every type while another client inserts, updates and deletes
+// rows and vacuums the table, then checks every index against a scan of its column. The table is
+// saved to data/ on exit, so run it from an empty directory, e.g.:
+//   gcc -std=gnu99 -O2 -march=native -pthread -I../include index_build_test.c ../batch.c
+//       ../btree.c ../client_context.c ../db_manager.c ../db_operator.c ../dsl.c ../epoch.c
+//       ../hash_index.c ../hash_table.c ../join.c ../learned.c ../parser.c ../queue.c ../sort.c
+//       ../sorted.c ../thread_pool.c ../utils.c ../vector.c -lm -o index_build_test
+//   mkdir -p /tmp/index_build_test && cd /tmp/index_build_test && ./index_build_test
+
+#define TABLE_ROWS 1048576
+#define INSERT_ROWS 1024
+#define VALUE_DOMAIN 65536
+#define INDEXES_COUNT 4
+#define CHECKS_COUNT 256
+
+// Column i + 2 gets an index of type INDEX_TYPES[i]. Rows are identified by col1, which is not
+// indexed, so selecting on it scans.
+static const char *INDEX_TYPES[INDEXES_COUNT] = {"btree", "sorted", "learned", "hash"};
+
+// A third of the rows are deleted while this index is built, so that readers of the new index
+// take many changed rows from the table while the other indexes are rebuilt in the background.
+#define REBUILD_INDEX 2
+
+static MessageStatus query(ClientContext *context, const char *command) {
+    char buffer[strlen(command) + 1];
+    strcpy(buffer, command);
+
+    Message message = MESSAGE_INITIALIZER;
+    DbOperator *dbo = parse_command(buffer, &message, context);
+    if (dbo != NULL) {
+        db_operator_execute(dbo, &message);
+        db_operator_free(dbo);
+    }
+    free(message.payload);
+
+    return message.status;
+}
+
+static char *next_id_command(char *command, unsigned int id) {
+    return command + sprintf(command, "(%u,%d,%d,%d,%d)", id, rand() % VALUE_DOMAIN,
+            rand() % VALUE_DOMAIN, rand() % VALUE_DOMAIN, rand() % VALUE_DOMAIN);
+}
+
+static unsigned int insert_rows(ClientContext *context, unsigned int id, unsigned int count) {
+    char *command = malloc(64 + count * 64);
+    char *end = command + sprintf(command, "relational_insert(db1.tbl");
+    for (unsigned int i = 0; i < count; i++) {
+        *end++ = ',';
+        end = next_id_command(end, id++);
+    }
+    strcpy(end, ")");
+
+    if (query(context, command) != OK) {
+        fprintf(stderr, "Insert failed\n");
+        exit(1);
+    }
+    free(command);
+
+    return id;
+}
+
+// Creates the indexes one after the other, as a client of its own.
+static void *build_routine(void *data) {
+    ClientContext *context = data;
+    char command[64];
+    for (unsigned int i = 0; i < INDEXES_COUNT; i++) {
+        sprintf(command, "create(idx,db1.tbl.col%u,%s,unclustered)", i + 2, INDEX_TYPES[i]);
+        if (query(context, command) != OK) {
+            fprintf(stderr, "Creating the %s index failed\n", INDEX_TYPES[i]);
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+// Runs random writes until the index being built is done, starting once its build has started.
+static unsigned int write_during_build(ClientContext *context, Column *column, unsigned int id,
+        bool rebuild, unsigned int *writes) {
+    while (__atomic_load_n(&column->index_build, __ATOMIC_ACQUIRE) == NULL
+            && __atomic_load_n(&column->index, __ATOMIC_ACQUIRE) == NULL) {
+        sched_yield();
+    }
+
+    if (rebuild) {
+        query(context, "d=select(db1.tbl.col3,null,21845)");
+        query(context, "relational_delete(db1.tbl,d)");
+        (*writes)++;
+    }
+
+    char command[128];
+    while (__atomic_load_n(&column->index, __ATOMIC_ACQUIRE) == NULL) {
+        unsigned int low = rand() % id;
+        switch (rand() % 8) {
+        case 0:
+        case 1:
+        case 2:
+            id = insert_rows(context, id, 1 + rand() % 4);
+            break;
+        case 3:
+        case 4:
+            sprintf(command, "u=select(db1.tbl.col1,%u,%u)", low, low + 16);
+            query(context, command);
+            sprintf(command, "relational_update(db1.tbl.col%d,u,%d)", 2 + rand() % INDEXES_COUNT,
+                    rand() % VALUE_DOMAIN);
+            query(context, command);
+            break;
+        case 5:
+        case 6:
+            sprintf(command, "d=select(db1.tbl.col1,%u,%u)", low, low + 16);
+            query(context, command);
+            query(context, "relational_delete(db1.tbl,d)");
+            break;
+        case 7:
+            query(context, "vacuum(db1.tbl)");
+            break;
+        }
+        (*writes)++;
+    }
+
+    return id;
+}
+
+static int compare_positions(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Returns a sorted copy of the positions of a result, and their number in count.
+static unsigned int *sorted_positions(ClientContext *context, char *name, unsigned int *count) {
+    Result *result = result_lookup(context, name);
+    *count = result != NULL ? result->num_tuples : 0;
+    unsigned int *positions = malloc((*count + 1) * sizeof(unsigned int));
+    if (*count > 0) {
+        memcpy(positions, result->values.pos_values, *count * sizeof(unsigned int));
+    }
+    qsort(positions, *count, sizeof(unsigned int), &compare_positions);
+    return positions;
+}
+
+// Compares selects through the index on every column with the rows that a scan finds.
+static unsigned int check_indexes(ClientContext *context) {
+    unsigned int errors = 0;
+    char command[128];
+
+    query(context, "a=select(db1.tbl.col1,0,null)");
+    Result *all = result_lookup(context, "a");
+
+    for (unsigned int i = 0; i < INDEXES_COUNT; i++) {
+        sprintf(command, "v=fetch(db1.tbl.col%u,a)", i + 2);
+        query(context, command);
+        Result *values = result_lookup(context, "v");
+
+        for (unsigned int c = 0; c < CHECKS_COUNT; c++) {
+            int low = rand() % VALUE_DOMAIN;
+            int high = low + (i == INDEXES_COUNT - 1 ? 1 : 1 + rand() % 256);
+            sprintf(command, "s=select(db1.tbl.col%u,%d,%d)", i + 2, low, high);
+            query(context, command);
+
+            unsigned int count;
+            unsigned int *positions = sorted_positions(context, "s", &count);
+
+            unsigned int expected_count = 0;
+            unsigned int *expected = malloc((all->num_tuples + 1) * sizeof(unsigned int));
+            for (unsigned int j = 0; j < all->num_tuples; j++) {
+                int value = values->values.int_values[j];
+                if (value >= low && value < high) {
+                    expected[expected_count++] = all->values.pos_values[j];
+                }
+            }
+            qsort(expected, expected_count, sizeof(unsigned int), &compare_positions);
+
+            if (count != expected_count
+                    || memcmp(positions, expected, count * sizeof(unsigned int)) != 0) {
+                errors++;
+            }
+
+            free(positions);
+            free(expected);
+        }
+    }
+
+    return errors;
+}
+
+int main() {
+    thread_pool_startup(4);
+    db_manager_startup();
+
+    ClientContext context;
+    client_context_init(&context, -1);
+
+    if (query(&context, "create(db,\"db1\")") != OK) {
+        fprintf(stderr, "Run from an empty directory\n");
+        return 1;
+    }
+    query(&context, "create(tbl,\"tbl\",db1,5)");
+    for (unsigned int i = 1; i <= INDEXES_COUNT + 1; i++) {
+        char command[64];
+        sprintf(command, "create(col,\"col%u\",db1.tbl)", i);
+        query(&context, command);
+    }
+
+    srand(165);
+    unsigned int id = 0;
+    while (id < TABLE_ROWS) {
+        id = insert_rows(&context, id, INSERT_ROWS);
+    }
+
+    ClientContext build_context;
+    client_context_init(&build_context, -1);
+
+    pthread_t builder;
+    pthread_create(&builder, NULL, &build_routine, &build_context);
+
+    unsigned int writes[INDEXES_COUNT] = {0};
+    for (unsigned int i = 0; i < INDEXES_COUNT; i++) {
+        char column_fqn[32];
+        sprintf(column_fqn, "db1.tbl.col%u", i + 2);
+        id = write_during_build(&context, column_lookup(column_fqn), id, i == REBUILD_INDEX,
+                writes + i);
+    }
+
+    pthread_join(builder, NULL);
+
+    unsigned int errors = check_indexes(&context);
+    for (unsigned int i = 0; i < INDEXES_COUNT; i++) {
+        printf("Index Build (%s): %u writes\n", INDEX_TYPES[i], writes[i]);
+    }
+    printf("Index Build: %u checks, %u errors\n", INDEXES_COUNT * CHECKS_COUNT, errors);
+
+    client_context_destroy(&build_context);
+    client_context_destroy(&context);
+
+    db_manager_shutdown();
+    thread_pool_shutdown();
+    epoch_shutdown();
+
+    return errors > 0;
+}
@@ -0,0 +1,288 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "client_context.h"
+#include "db_manager.h"
+#include "db_operator.h"
+#include "epoch.h"
+#include "message.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+// Probes indexes of every type while another client inserts, updates and deletes rows and
+// vacuums the table, then checks every probe against a scan of the version it read. The table is
+// saved to data/ on exit, so run it from an empty directory, e.g.:
+//   gcc -std=gnu99 -O2 -march=native -pthread -I../include index_read_test.c ../batch.c
+//       ../btree.c ../client_context.c ../db_manager.c ../db_operator.c ../dsl.c ../epoch.c
+//       ../hash_index.c ../hash_table.c ../join.c ../learned.c ../parser.c ../queue.c ../sort.c
+//       ../sorted.c ../thread_pool.c ../utils.c ../vector.c -lm -o index_read_test
+//   mkdir -p /tmp/index_read_test && cd /tmp/index_read_test && ./index_read_test
+
+#define TABLE_ROWS 262144
+#define INSERT_ROWS 1024
+#define VALUE_DOMAIN 65536
+#define INDEXES_COUNT 4
+#define WRITES_COUNT 4096
+
+// Column i + 2 gets an index of type INDEX_TYPES[i]. Rows are identified by col1, which is not
+// indexed, so selecting on it scans.
+static const char *INDEX_TYPES[INDEXES_COUNT] = {"btree", "sorted", "learned", "hash"};
+
+typedef struct Writer {
+    ClientContext context;
+    unsigned int id;
+    bool done;
+} Writer;
+
+static MessageStatus query(ClientContext *context, const char *command) {
+    char buffer[strlen(command) + 1];
+    strcpy(buffer, command);
+
+    Message message = MESSAGE_INITIALIZER;
+    DbOperator *dbo = parse_command(buffer, &message, context);
+    if (dbo != NULL) {
+        db_operator_execute(dbo, &message);
+        db_operator_free(dbo);
+    }
+    free(message.payload);
+
+    return message.status;
+}
+
+static char *next_id_command(char *command, unsigned int id) {
+    return command + sprintf(command, "(%u,%d,%d,%d,%d)", id, rand() % VALUE_DOMAIN,
+            rand() % VALUE_DOMAIN, rand() % VALUE_DOMAIN, rand() % VALUE_DOMAIN);
+}
+
+static unsigned int insert_rows(ClientContext *context, unsigned int id, unsigned int count) {
+    char *command = malloc(64 + count * 64);
+    char *end = command + sprintf(command, "relational_insert(db1.tbl");
+    for (unsigned int i = 0; i < count; i++) {
+        *end++ = ',';
+        end = next_id_command(end, id++);
+    }
+    strcpy(end, ")");
+
+    if (query(context, command) != OK) {
+        fprintf(stderr, "Insert failed\n");
+        exit(1);
+    }
+    free(command);
+
+    return id;
+}
+
+// Runs random writes as a client of its own. Large deletes and updates leave many rows for
+// readers to take from the table until the indexes are rebuilt.
+static void *write_routine(void *data) {
+    Writer *writer = data;
+    ClientContext *context = &writer->context;
+    unsigned int id = writer->id;
+
+    char command[128];
+    for (unsigned int i = 0; i < WRITES_COUNT; i++) {
+        unsigned int low = rand() % id;
+        unsigned int width = rand() % 64 == 0 ? 4096 : 16;
+        switch (rand() % 8) {
+        case 0:
+        case 1:
+        case 2:
+            id = insert_rows(context, id, 1 + rand() % 4);
+            break;
+        case 3:
+        case 4:
+            sprintf(command, "u=select(db1.tbl.col1,%u,%u)", low, low + width);
+            query(context, command);
+            sprintf(command, "relational_update(db1.tbl.col%d,u,%d)", 2 + rand() % INDEXES_COUNT,
+                    rand() % VALUE_DOMAIN);
+            query(context, command);
+            break;
+        case 5:
+        case 6:
+            sprintf(command, "d=select(db1.tbl.col1,%u,%u)", low, low + width);
+            query(context, command);
+            query(context, "relational_delete(db1.tbl,d)");
+            break;
+        case 7:
+            query(context, "vacuum(db1.tbl)");
+            break;
+        }
+    }
+
+    __atomic_store_n(&writer->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static inline int reader_value(ColumnReader *reader, unsigned int position) {
+    return reader->segments[position >> COLUMN_SEGMENT_BITS][position & COLUMN_SEGMENT_MASK];
+}
+
+static inline bool reader_row_live(ColumnReader *reader, unsigned int position) {
+    return reader->deleted_rows == NULL || !reader->deleted_rows[position >> COLUMN_SEGMENT_BITS]
+            [position & COLUMN_SEGMENT_MASK];
+}
+
+static int compare_positions(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Compares a select through the index of a reader with a scan of the version it read. Returns
+// the number of errors found.
+static unsigned int check_select(ColumnReader *reader, int low, int high) {
+    unsigned int *result = malloc((reader->rows_count + 1) * sizeof(unsigned int));
+    unsigned int count = column_reader_index_select(reader, true, low, true, high, result);
+
+    unsigned int errors = 0;
+    for (unsigned int i = 1; i < count; i++) {
+        int previous = reader_value(reader, result[i - 1]);
+        int value = reader_value(reader, result[i]);
+        if (previous > value || (previous == value && result[i - 1] >= result[i])) {
+            errors++;
+            break;
+        }
+    }
+    qsort(result, count, sizeof(unsigned int), &compare_positions);
+
+    unsigned int expected_count = 0;
+    unsigned int *expected = malloc((reader->rows_count + 1) * sizeof(unsigned int));
+    for (unsigned int p = 0; p < reader->values_count; p++) {
+        int value = reader_value(reader, p);
+        if (reader_row_live(reader, p) && value >= low && value < high) {
+            expected[expected_count++] = p;
+        }
+    }
+
+    if (count != expected_count
+            || memcmp(result, expected, count * sizeof(unsigned int)) != 0) {
+        errors++;
+    }
+
+    free(result);
+    free(expected);
+
+    return errors;
+}
+
+// Compares the extrema found through the index of a reader with a scan of the version it read.
+static unsigned int check_extrema(ColumnReader *reader) {
+    bool found = false;
+    int min_value = 0;
+    int max_value = 0;
+    for (unsigned int p = 0; p < reader->values_count; p++) {
+        if (reader_row_live(reader, p)) {
+            int value = reader_value(reader, p);
+            min_value = !found || value < min_value ? value : min_value;
+            max_value = !found || value > max_value ? value : max_value;
+            found = true;
+        }
+    }
+
+    unsigned int errors = 0;
+    int value;
+    unsigned int position;
+    if (column_reader_index_min(reader, &value, &position) && (value != min_value
+            || reader_value(reader, position) != value || !reader_row_live(reader, position))) {
+        errors++;
+    }
+    if (column_reader_index_max(reader, &value, &position) && (value != max_value
+            || reader_value(reader, position) != value || !reader_row_live(reader, position))) {
+        errors++;
+    }
+
+    return errors;
+}
+
+// Probes the index of a column through a reader, like a select on it would.
+static unsigned int check_index(Column *column, unsigned int i, unsigned int *checks) {
+    ColumnIndex *index = __atomic_load_n(&column->index, __ATOMIC_ACQUIRE);
+
+    ColumnReader reader;
+    column_reader_open(&reader, column, index);
+
+    unsigned int errors = 0;
+    if (reader.index != NULL && reader.rows_count > 0) {
+        int low = rand() % VALUE_DOMAIN;
+        int high = low + (i == INDEXES_COUNT - 1 ? 1 : 1 + rand() % 256);
+        errors += check_select(&reader, low, high);
+        (*checks)++;
+
+        if (i != INDEXES_COUNT - 1) {
+            errors += check_extrema(&reader);
+            (*checks)++;
+        }
+    }
+
+    column_reader_close(&reader);
+
+    return errors;
+}
+
+int main() {
+    thread_pool_startup(4);
+    db_manager_startup();
+
+    Writer writer;
+    client_context_init(&writer.context, -1);
+
+    if (query(&writer.context, "create(db,\"db1\")") != OK) {
+        fprintf(stderr, "Run from an empty directory\n");
+        return 1;
+    }
+    query(&writer.context, "create(tbl,\"tbl\",db1,5)");
+    for (unsigned int i = 1; i <= INDEXES_COUNT + 1; i++) {
+        char command[64];
+        sprintf(command, "create(col,\"col%u\",db1.tbl)", i);
+        query(&writer.context, command);
+    }
+
+    srand(165);
+    unsigned int id = 0;
+    while (id < TABLE_ROWS) {
+        id = insert_rows(&writer.context, id, INSERT_ROWS);
+    }
+
+    Column *columns[INDEXES_COUNT];
+    for (unsigned int i = 0; i < INDEXES_COUNT; i++) {
+        char command[64];
+        sprintf(command, "create(idx,db1.tbl.col%u,%s,unclustered)", i + 2, INDEX_TYPES[i]);
+        query(&writer.context, command);
+
+        sprintf(command, "db1.tbl.col%u", i + 2);
+        columns[i] = column_lookup(command);
+    }
+
+    writer.id = id;
+    writer.done = false;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &write_routine, &writer);
+
+    unsigned int checks = 0;
+    unsigned int errors = 0;
+    while (!__atomic_load_n(&writer.done, __ATOMIC_ACQUIRE)) {
+        unsigned int i = rand() % INDEXES_COUNT;
+        errors += check_index(columns[i], i, &checks);
+    }
+
+    pthread_join(thread, NULL);
+
+    // Once writes are done, the indexes are probed as the background rebuilds left them.
+    for (unsigned int i = 0; i < INDEXES_COUNT; i++) {
+        errors += check_index(columns[i], i, &checks);
+    }
+
+    printf("Index Read: %u writes, %u checks, %u errors\n", WRITES_COUNT, checks, errors);
+
+    client_context_destroy(&writer.context);
+
+    db_manager_shutdown();
+    thread_pool_shutdown();
+    epoch_shutdown();
+
+    return errors > 0;
+}
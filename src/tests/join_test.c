@@ -1,15 +1,34 @@
 #include <assert.h>
+#include <math.h>
 #include <time.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
 
 #include "vector.h"
 #include "utils.h"
 
+// The server's joins, renamed so they can be benchmarked against the variants below.
+#define join_hash server_join_hash
+#define join_nested_loop server_join_nested_loop
+#define join_sort_merge server_join_sort_merge
+#include "../join.c"
+#undef join_hash
+#undef join_nested_loop
+#undef join_sort_merge
+
 #define VALUES_COUNT 134217728
 
+#define GRACE_COUNT 262144
+#define GRACE_DOMAIN 65536
+#define GRACE_HOT_COUNT 1024
+
+#define ZIPF_COUNT 1048576
+#define ZIPF_DOMAIN 4194304
+#define ZIPF_EXPONENT 1.0
+
 void generate_random(unsigned int seed, int *values, size_t count) {
     srand(seed);
 
@@ -24,6 +43,48 @@ void generate_ascending(int offset, int *values, size_t count) {
     }
 }
 
+void generate_zipf(unsigned int seed, double exponent, int domain, int *values, size_t count) {
+    srand(seed);
+
+    double *cdf = malloc(domain * sizeof(double));
+    double sum = 0;
+    for (int i = 0; i < domain; i++) {
+        sum += 1 / pow(i + 1, exponent);
+        cdf[i] = sum;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        double u = (double) rand() / RAND_MAX * sum;
+
+        int low = 0;
+        int high = domain - 1;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (cdf[mid] < u) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        values[i] = low;
+    }
+
+    free(cdf);
+}
+
+// Spreads keys over the whole int range, so they are no longer a dense domain.
+void scatter(int *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        values[i] = (unsigned int) values[i] * 2654435761u;
+    }
+}
+
+double wall_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 static inline void probe(unsigned int *table, unsigned int *counts, unsigned int *offsets,
         int *values2, unsigned int *positions2, unsigned int count2, PosVector *pos_out1,
         PosVector *pos_out2) {
@@ -598,8 +659,115 @@ void join_sort_merge(int *values1, unsigned int *positions1, unsigned int count1
     free(sorted_positions2);
 }
 
+static int compare_pairs(const void *a, const void *b) {
+    unsigned long long int x = *(const unsigned long long int *) a;
+    unsigned long long int y = *(const unsigned long long int *) b;
+    return (x > y) - (x < y);
+}
+
+// Returns the pairs of a join result, sorted so that results of different joins can be compared.
+static unsigned long long int *sorted_pairs(PosVector *pos_out1, PosVector *pos_out2) {
+    unsigned long long int *pairs = malloc(pos_out1->size * sizeof(unsigned long long int));
+    for (unsigned int i = 0; i < pos_out1->size; i++) {
+        pairs[i] = (unsigned long long int) pos_out1->data[i] << 32 | pos_out2->data[i];
+    }
+    qsort(pairs, pos_out1->size, sizeof(unsigned long long int), &compare_pairs);
+    return pairs;
+}
+
+// Runs a grace hash join under the given budget and checks it against the in-memory join. With
+// spill set, the join has to succeed. Otherwise the spill files cannot be created, and the join
+// has to fall back to joining in memory.
+void check_grace_join(const char *name, size_t budget, bool spill, int *values1,
+        unsigned int *positions1, unsigned int count1, int *values2, unsigned int *positions2,
+        unsigned int count2) {
+    PosVector expected1;
+    PosVector expected2;
+    pos_vector_init(&expected1, count1);
+    pos_vector_init(&expected2, count1);
+    join_hash_static_count(values1, positions1, count1, values2, positions2, count2, &expected1,
+            &expected2);
+
+    PosVector pos_out1;
+    PosVector pos_out2;
+    pos_vector_init(&pos_out1, count1);
+    pos_vector_init(&pos_out2, count1);
+
+    join_set_memory_budget(budget);
+    if (spill) {
+        bool success = join_hash_grace(values1, positions1, count1, values2, positions2, count2,
+                &pos_out1, &pos_out2);
+        assert(success);
+    } else {
+        join_hash_uniform(values1, positions1, count1, values2, positions2, count2, &pos_out1,
+                &pos_out2);
+    }
+    join_set_memory_budget(0);
+
+    assert(pos_out1.size == expected1.size && pos_out2.size == expected2.size);
+
+    unsigned long long int *pairs = sorted_pairs(&pos_out1, &pos_out2);
+    unsigned long long int *expected_pairs = sorted_pairs(&expected1, &expected2);
+    assert(memcmp(pairs, expected_pairs, pos_out1.size * sizeof(unsigned long long int)) == 0);
+    free(pairs);
+    free(expected_pairs);
+
+    printf("Grace Hash Join (%s): %u pairs\n", name, pos_out1.size);
+
+    pos_vector_destroy(&pos_out1);
+    pos_vector_destroy(&pos_out2);
+    pos_vector_destroy(&expected1);
+    pos_vector_destroy(&expected2);
+}
+
+// Covers a single level of partitions, recursion on oversized ones, partitions of a single key
+// that run out of bytes to partition on, and the fallback when spilling fails.
+void test_grace_join() {
+    int *values1 = malloc(GRACE_COUNT * sizeof(int));
+    unsigned int *positions1 = malloc(GRACE_COUNT * sizeof(unsigned int));
+    int *values2 = malloc(GRACE_COUNT * sizeof(int));
+    unsigned int *positions2 = malloc(GRACE_COUNT * sizeof(unsigned int));
+
+    srand(42);
+    for (unsigned int i = 0; i < GRACE_COUNT; i++) {
+        values1[i] = rand() % GRACE_DOMAIN;
+        values2[i] = rand() % GRACE_DOMAIN;
+    }
+    scatter(values1, GRACE_COUNT);
+    scatter(values2, GRACE_COUNT);
+    generate_ascending(0, (int *) positions1, GRACE_COUNT);
+    generate_ascending(0, (int *) positions2, GRACE_COUNT);
+
+    check_grace_join("one level", 1048576, true, values1, positions1, GRACE_COUNT, values2,
+            positions2, GRACE_COUNT);
+    check_grace_join("recursive", 16384, true, values1, positions1, GRACE_COUNT, values2,
+            positions2, GRACE_COUNT);
+
+    for (unsigned int i = 0; i < GRACE_HOT_COUNT; i++) {
+        values1[i * (GRACE_COUNT / GRACE_HOT_COUNT)] = 12345;
+        values2[i * (GRACE_COUNT / GRACE_HOT_COUNT)] = 12345;
+    }
+    check_grace_join("hot key", 16384, true, values1, positions1, GRACE_COUNT, values2,
+            positions2, GRACE_COUNT);
+
+    // Without spare file descriptors, no spill file can be created.
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    struct rlimit no_files = { 3, limit.rlim_max };
+    setrlimit(RLIMIT_NOFILE, &no_files);
+    check_grace_join("fallback", 16384, false, values1, positions1, GRACE_COUNT, values2,
+            positions2, GRACE_COUNT);
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    free(values1);
+    free(positions1);
+    free(values2);
+    free(positions2);
+}
 
 int main(int argc, char *argv[]) {
+    test_grace_join();
+
     int *values1 = malloc(VALUES_COUNT * sizeof(int));
     unsigned int *positions1 = malloc(VALUES_COUNT * sizeof(int));
 
@@ -715,6 +883,74 @@ int main(int argc, char *argv[]) {
     pos_vector_destroy(&pos_out2);
 
 
+    // Zipf skewed build side against unique keys.
+    double wall_start, wall_end;
+
+    generate_zipf(42, ZIPF_EXPONENT, ZIPF_DOMAIN, values1, ZIPF_COUNT);
+    generate_ascending(0, values2, ZIPF_DOMAIN);
+    scatter(values1, ZIPF_COUNT);
+    scatter(values2, ZIPF_DOMAIN);
+
+    pos_vector_init(&pos_out1, ZIPF_COUNT);
+    pos_vector_init(&pos_out2, ZIPF_COUNT);
+    wall_start = wall_clock();
+    join_hash(values1, positions1, ZIPF_COUNT, values2, positions2, ZIPF_DOMAIN, &pos_out1,
+            &pos_out2);
+    wall_end = wall_clock();
+    for (unsigned int i = 0; i < pos_out1.size; i++) {
+        assert(values1[pos_out1.data[i]] == values2[pos_out2.data[i]]);
+    }
+    printf("Zipf Hash Join 1: %f\n", wall_end - wall_start);
+    printf("Result Size: %u\n", pos_out1.size);
+    pos_vector_destroy(&pos_out1);
+    pos_vector_destroy(&pos_out2);
+
+    pos_vector_init(&pos_out1, ZIPF_COUNT);
+    pos_vector_init(&pos_out2, ZIPF_COUNT);
+    wall_start = wall_clock();
+    server_join_hash(values1, positions1, ZIPF_COUNT, values2, positions2, ZIPF_DOMAIN, &pos_out1,
+            &pos_out2);
+    wall_end = wall_clock();
+    for (unsigned int i = 0; i < pos_out1.size; i++) {
+        assert(values1[pos_out1.data[i]] == values2[pos_out2.data[i]]);
+    }
+    printf("Zipf Skew-Aware Hash Join: %f\n", wall_end - wall_start);
+    printf("Result Size: %u\n", pos_out1.size);
+    pos_vector_destroy(&pos_out1);
+    pos_vector_destroy(&pos_out2);
+
+    // Zipf skew on both sides.
+    generate_zipf(24, ZIPF_EXPONENT, ZIPF_DOMAIN, values2, ZIPF_COUNT / 256);
+    scatter(values2, ZIPF_COUNT / 256);
+
+    pos_vector_init(&pos_out1, ZIPF_COUNT);
+    pos_vector_init(&pos_out2, ZIPF_COUNT);
+    wall_start = wall_clock();
+    join_hash(values1, positions1, ZIPF_COUNT, values2, positions2, ZIPF_COUNT / 256, &pos_out1,
+            &pos_out2);
+    wall_end = wall_clock();
+    for (unsigned int i = 0; i < pos_out1.size; i++) {
+        assert(values1[pos_out1.data[i]] == values2[pos_out2.data[i]]);
+    }
+    printf("Zipf x Zipf Hash Join 1: %f\n", wall_end - wall_start);
+    printf("Result Size: %u\n", pos_out1.size);
+    pos_vector_destroy(&pos_out1);
+    pos_vector_destroy(&pos_out2);
+
+    pos_vector_init(&pos_out1, ZIPF_COUNT);
+    pos_vector_init(&pos_out2, ZIPF_COUNT);
+    wall_start = wall_clock();
+    server_join_hash(values1, positions1, ZIPF_COUNT, values2, positions2, ZIPF_COUNT / 256,
+            &pos_out1, &pos_out2);
+    wall_end = wall_clock();
+    for (unsigned int i = 0; i < pos_out1.size; i++) {
+        assert(values1[pos_out1.data[i]] == values2[pos_out2.data[i]]);
+    }
+    printf("Zipf x Zipf Skew-Aware Hash Join: %f\n", wall_end - wall_start);
+    printf("Result Size: %u\n", pos_out1.size);
+    pos_vector_destroy(&pos_out1);
+    pos_vector_destroy(&pos_out2);
+
     free(values1);
     free(positions1);
     free(values2);
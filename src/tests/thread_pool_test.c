@@ -0,0 +1,225 @@
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "join.h"
+#include "sort.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include "vector.h"
+
+// Times skewed workloads on pools of growing size, to show how they scale, e.g.:
+//   gcc -std=gnu99 -O3 -march=native -pthread -I../include thread_pool_test.c ../join.c ../sort.c
+//       ../thread_pool.c ../utils.c ../vector.c -lm -o thread_pool_test
+//   ./thread_pool_test
+
+#define SORT_COUNT 16777216
+
+#define JOIN_COUNT1 1048576
+#define JOIN_COUNT2 256
+#define JOIN_DOMAIN 65536
+#define JOIN_EXPONENT 1.2
+
+#define TASKS_COUNT 4096
+#define TASKS_WORK 1048576
+
+#define MAX_THREADS 8
+
+// Nine values out of ten share their top byte, so that a single radix bucket holds most of them.
+void generate_skewed(int *values, size_t count) {
+    srand(42);
+
+    for (size_t i = 0; i < count; i++) {
+        values[i] = rand() % 10 > 0 ? rand() & 0xFFFFFF : rand() - RAND_MAX / 2;
+    }
+}
+
+void generate_zipf(unsigned int seed, double exponent, int domain, int *values, size_t count) {
+    srand(seed);
+
+    double *cdf = malloc(domain * sizeof(double));
+    double sum = 0;
+    for (int i = 0; i < domain; i++) {
+        sum += 1 / pow(i + 1, exponent);
+        cdf[i] = sum;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        double u = (double) rand() / RAND_MAX * sum;
+
+        int low = 0;
+        int high = domain - 1;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (cdf[mid] < u) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        values[i] = low;
+    }
+
+    free(cdf);
+}
+
+// Spreads keys over the whole int range, so they are no longer a dense domain.
+void scatter(int *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        values[i] = (unsigned int) values[i] * 2654435761u;
+    }
+}
+
+double wall_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Tasks whose cost follows a Zipf distribution, so that a few of them dominate.
+typedef struct SpinTask {
+    unsigned int start;
+    unsigned int end;
+    unsigned int *costs;
+    unsigned long long int result;
+} SpinTask;
+
+unsigned long long int spin(unsigned int cost) {
+    unsigned long long int x = cost;
+    for (unsigned int i = 0; i < cost; i++) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    return x;
+}
+
+// One equal share of the tasks per thread, as a static partitioning would do.
+void *spin_static_routine(void *data) {
+    SpinTask *task = data;
+    task->result = 0;
+    for (unsigned int i = task->start; i < task->end; i++) {
+        task->result += spin(task->costs[i]);
+    }
+    return NULL;
+}
+
+// Halves its share until it is a single task, forking the other half.
+void *spin_fork_routine(void *data) {
+    SpinTask *task = data;
+    if (task->end - task->start == 1) {
+        task->result = spin(task->costs[task->start]);
+        return NULL;
+    }
+
+    unsigned int middle = task->start + (task->end - task->start) / 2;
+    SpinTask upper = { middle, task->end, task->costs, 0 };
+    SpinTask lower = { task->start, middle, task->costs, 0 };
+
+    ThreadPoolGroup group;
+    thread_pool_group_init(&group);
+    thread_pool_fork(&group, &spin_fork_routine, &upper);
+    spin_fork_routine(&lower);
+    thread_pool_join(&group);
+
+    task->result = lower.result + upper.result;
+    return NULL;
+}
+
+int main() {
+    int *values = malloc(SORT_COUNT * sizeof(int));
+    int *sorted = malloc(SORT_COUNT * sizeof(int));
+    unsigned int *indices = malloc(SORT_COUNT * sizeof(unsigned int));
+    generate_skewed(values, SORT_COUNT);
+
+    int *join_values1 = malloc(JOIN_COUNT1 * sizeof(int));
+    int *join_values2 = malloc(JOIN_COUNT2 * sizeof(int));
+    unsigned int *join_positions1 = malloc(JOIN_COUNT1 * sizeof(unsigned int));
+    unsigned int *join_positions2 = malloc(JOIN_COUNT2 * sizeof(unsigned int));
+    generate_zipf(42, JOIN_EXPONENT, JOIN_DOMAIN, join_values1, JOIN_COUNT1);
+    generate_zipf(24, JOIN_EXPONENT, JOIN_DOMAIN, join_values2, JOIN_COUNT2);
+    scatter(join_values1, JOIN_COUNT1);
+    scatter(join_values2, JOIN_COUNT2);
+    for (unsigned int i = 0; i < JOIN_COUNT1; i++) {
+        join_positions1[i] = i;
+    }
+    for (unsigned int i = 0; i < JOIN_COUNT2; i++) {
+        join_positions2[i] = i;
+    }
+
+    unsigned int *costs = malloc(TASKS_COUNT * sizeof(unsigned int));
+    generate_zipf(7, 1.0, TASKS_COUNT, (int *) costs, TASKS_COUNT);
+    unsigned long long int costs_sum = 0;
+    for (unsigned int i = 0; i < TASKS_COUNT; i++) {
+        costs[i] = TASKS_WORK / (costs[i] + 1);
+        costs_sum += costs[i];
+    }
+
+    double wall_start, wall_end;
+
+    for (unsigned int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        thread_pool_startup(threads);
+
+        wall_start = wall_clock();
+        radix_sort_indices(values, NULL, sorted, indices, SORT_COUNT);
+        wall_end = wall_clock();
+        for (unsigned int i = 1; i < SORT_COUNT; i++) {
+            assert(sorted[i - 1] <= sorted[i]);
+        }
+        printf("Radix Sort Skewed (%u threads): %f\n", threads, wall_end - wall_start);
+
+        PosVector pos_out1;
+        PosVector pos_out2;
+        pos_vector_init(&pos_out1, JOIN_COUNT1);
+        pos_vector_init(&pos_out2, JOIN_COUNT1);
+        wall_start = wall_clock();
+        join_hash(join_values1, join_positions1, JOIN_COUNT1, join_values2, join_positions2,
+                JOIN_COUNT2, &pos_out1, &pos_out2);
+        wall_end = wall_clock();
+        for (unsigned int i = 0; i < pos_out1.size; i++) {
+            assert(join_values1[pos_out1.data[i]] == join_values2[pos_out2.data[i]]);
+        }
+        printf("Zipf x Zipf Hash Join (%u threads): %f\n", threads, wall_end - wall_start);
+        printf("Result Size: %u\n", pos_out1.size);
+        pos_vector_destroy(&pos_out1);
+        pos_vector_destroy(&pos_out2);
+
+        SpinTask shares[MAX_THREADS];
+        for (unsigned int t = 0; t < threads; t++) {
+            shares[t].start = TASKS_COUNT * t / threads;
+            shares[t].end = TASKS_COUNT * (t + 1) / threads;
+            shares[t].costs = costs;
+        }
+        wall_start = wall_clock();
+        thread_pool_run(&spin_static_routine, shares, sizeof(SpinTask), threads);
+        wall_end = wall_clock();
+        printf("Zipf Tasks Static (%u threads): %f\n", threads, wall_end - wall_start);
+
+        SpinTask root = { 0, TASKS_COUNT, costs, 0 };
+        wall_start = wall_clock();
+        spin_fork_routine(&root);
+        wall_end = wall_clock();
+        unsigned long long int static_result = 0;
+        for (unsigned int t = 0; t < threads; t++) {
+            static_result += shares[t].result;
+        }
+        assert(root.result == static_result);
+        printf("Zipf Tasks Fork/Join (%u threads): %f\n", threads, wall_end - wall_start);
+
+        thread_pool_shutdown();
+    }
+
+    printf("Task Work: %llu\n", costs_sum);
+
+    free(values);
+    free(sorted);
+    free(indices);
+    free(join_values1);
+    free(join_values2);
+    free(join_positions1);
+    free(join_positions2);
+    free(costs);
+
+    return 0;
+}
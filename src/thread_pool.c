@@ -0,0 +1,298 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "utils.h"
+
+#define THREAD_POOL_DEQUE_CAPACITY 64
+
+typedef struct ThreadPoolTask {
+    void *(*routine)(void *);
+    void *arg;
+    ThreadPoolGroup *group;
+} ThreadPoolTask;
+
+// Tasks forked by one thread. The owner pushes and pops at the bottom, so it keeps working on the
+// tasks it forked last, whose data is still in its cache. Other threads steal from the top, which
+// holds the oldest tasks, and those tend to be the largest ones in divide and conquer.
+typedef struct ThreadPoolDeque {
+    pthread_mutex_t mutex;
+    ThreadPoolTask *tasks;
+    unsigned int top;
+    unsigned int bottom;
+    unsigned int capacity;
+} ThreadPoolDeque;
+
+static pthread_t *thread_pool_threads = NULL;
+static unsigned int thread_pool_threads_count = 0;
+
+// One deque per worker, then one shared by all threads outside the pool.
+static ThreadPoolDeque *thread_pool_deques = NULL;
+static unsigned int thread_pool_deques_count = 0;
+static ThreadPoolDeque *thread_pool_shared = NULL;
+
+// Tasks in all deques, and threads asleep waiting for some. Joining threads only wait for tasks of
+// their group, so they sleep until the next fork instead.
+static unsigned int thread_pool_queued = 0;
+static unsigned int thread_pool_idle = 0;
+static unsigned int thread_pool_joining = 0;
+static unsigned long thread_pool_forks = 0;
+static bool thread_pool_stopping = false;
+static pthread_mutex_t thread_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thread_pool_cond = PTHREAD_COND_INITIALIZER;
+
+static __thread ThreadPoolDeque *thread_pool_local = NULL;
+static __thread unsigned int thread_pool_victim = 0;
+
+static inline void thread_pool_deque_init(ThreadPoolDeque *deque) {
+    pthread_mutex_init(&deque->mutex, NULL);
+    deque->tasks = NULL;
+    deque->top = 0;
+    deque->bottom = 0;
+    deque->capacity = 0;
+}
+
+static inline void thread_pool_deque_destroy(ThreadPoolDeque *deque) {
+    pthread_mutex_destroy(&deque->mutex);
+    free(deque->tasks);
+}
+
+static inline void thread_pool_deque_push(ThreadPoolDeque *deque, ThreadPoolTask *task) {
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->bottom == deque->capacity) {
+        if (deque->top > 0) {
+            memmove(deque->tasks, deque->tasks + deque->top,
+                    (deque->bottom - deque->top) * sizeof(ThreadPoolTask));
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        } else {
+            deque->capacity = deque->capacity > 0 ? deque->capacity * 2
+                    : THREAD_POOL_DEQUE_CAPACITY;
+            deque->tasks = realloc(deque->tasks, deque->capacity * sizeof(ThreadPoolTask));
+        }
+    }
+    deque->tasks[deque->bottom++] = *task;
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+// Takes the task at the bottom of the deque, or at its top when stealing. If group is set, only a
+// task of that group is taken, the one nearest to that end.
+static inline bool thread_pool_deque_take(ThreadPoolDeque *deque, bool steal,
+        ThreadPoolGroup *group, ThreadPoolTask *task) {
+    pthread_mutex_lock(&deque->mutex);
+
+    unsigned int i = deque->bottom;
+    if (steal) {
+        for (i = deque->top; i < deque->bottom && group != NULL && deque->tasks[i].group != group;
+                i++);
+    } else {
+        for (; i > deque->top && group != NULL && deque->tasks[i - 1].group != group; i--);
+        i = i > deque->top ? i - 1 : deque->bottom;
+    }
+
+    bool found = i < deque->bottom;
+    if (found) {
+        *task = deque->tasks[i];
+        if (i == deque->top) {
+            deque->top++;
+        } else {
+            memmove(deque->tasks + i, deque->tasks + i + 1,
+                    (deque->bottom - i - 1) * sizeof(ThreadPoolTask));
+            deque->bottom--;
+        }
+        if (deque->top == deque->bottom) {
+            deque->top = 0;
+            deque->bottom = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&deque->mutex);
+    return found;
+}
+
+// Takes the newest task of this thread's deque, or else steals the oldest one of another deque.
+// Joining threads only take tasks of the group they join, as they may hold locks that other tasks
+// take too.
+static bool thread_pool_take(ThreadPoolGroup *group, ThreadPoolTask *task) {
+    if (__atomic_load_n(&thread_pool_queued, __ATOMIC_SEQ_CST) == 0) {
+        return false;
+    }
+
+    ThreadPoolDeque *local = thread_pool_local != NULL ? thread_pool_local : thread_pool_shared;
+    bool found = thread_pool_deque_take(local, false, group, task);
+
+    unsigned int start = thread_pool_victim++;
+    for (unsigned int i = 0; i < thread_pool_deques_count && !found; i++) {
+        ThreadPoolDeque *victim = thread_pool_deques + (start + i) % thread_pool_deques_count;
+        found = victim != local && thread_pool_deque_take(victim, true, group, task);
+    }
+
+    if (found) {
+        __atomic_sub_fetch(&thread_pool_queued, 1, __ATOMIC_SEQ_CST);
+    }
+    return found;
+}
+
+static void thread_pool_execute(ThreadPoolTask *task) {
+    task->routine(task->arg);
+
+    // Joining threads sleep on the pool's condition, so that they also wake up for new tasks.
+    if (__atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&thread_pool_mutex);
+        pthread_cond_broadcast(&thread_pool_cond);
+        pthread_mutex_unlock(&thread_pool_mutex);
+    }
+}
+
+static void *thread_pool_worker_routine(void *data) {
+    thread_pool_local = data;
+    thread_pool_victim = thread_pool_local - thread_pool_deques + 1;
+
+    while (true) {
+        ThreadPoolTask task;
+        if (thread_pool_take(NULL, &task)) {
+            thread_pool_execute(&task);
+            continue;
+        }
+
+        pthread_mutex_lock(&thread_pool_mutex);
+        __atomic_add_fetch(&thread_pool_idle, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&thread_pool_queued, __ATOMIC_SEQ_CST) == 0
+                && !thread_pool_stopping) {
+            pthread_cond_wait(&thread_pool_cond, &thread_pool_mutex);
+        }
+        __atomic_sub_fetch(&thread_pool_idle, 1, __ATOMIC_SEQ_CST);
+        bool stopped = thread_pool_stopping
+                && __atomic_load_n(&thread_pool_queued, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&thread_pool_mutex);
+
+        if (stopped) {
+            return NULL;
+        }
+    }
+}
+
+void thread_pool_startup(unsigned int threads_count) {
+    if (threads_count == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_count = processors > 0 ? processors : 1;
+    }
+
+    thread_pool_threads = malloc(threads_count * sizeof(pthread_t));
+    thread_pool_deques_count = threads_count + 1;
+    thread_pool_deques = malloc(thread_pool_deques_count * sizeof(ThreadPoolDeque));
+    for (unsigned int i = 0; i < thread_pool_deques_count; i++) {
+        thread_pool_deque_init(thread_pool_deques + i);
+    }
+    thread_pool_shared = thread_pool_deques + threads_count;
+    thread_pool_stopping = false;
+
+    for (unsigned int i = 0; i < threads_count; i++) {
+        if (pthread_create(thread_pool_threads + i, NULL, &thread_pool_worker_routine,
+                thread_pool_deques + i) != 0) {
+            log_err("Unable to create pool worker thread.\n");
+            break;
+        }
+        thread_pool_threads_count++;
+    }
+
+    log_info("Started %u worker threads.\n", thread_pool_threads_count);
+}
+
+void thread_pool_shutdown() {
+    pthread_mutex_lock(&thread_pool_mutex);
+    thread_pool_stopping = true;
+    pthread_cond_broadcast(&thread_pool_cond);
+    pthread_mutex_unlock(&thread_pool_mutex);
+
+    for (unsigned int i = 0; i < thread_pool_threads_count; i++) {
+        pthread_join(thread_pool_threads[i], NULL);
+    }
+
+    for (unsigned int i = 0; i < thread_pool_deques_count; i++) {
+        thread_pool_deque_destroy(thread_pool_deques + i);
+    }
+
+    free(thread_pool_threads);
+    free(thread_pool_deques);
+    thread_pool_threads = NULL;
+    thread_pool_deques = NULL;
+    thread_pool_shared = NULL;
+    thread_pool_threads_count = 0;
+    thread_pool_deques_count = 0;
+}
+
+unsigned int thread_pool_size() {
+    return thread_pool_threads_count > 0 ? thread_pool_threads_count : 1;
+}
+
+void thread_pool_group_init(ThreadPoolGroup *group) {
+    group->pending = 0;
+}
+
+void thread_pool_fork(ThreadPoolGroup *group, void *(*routine)(void *), void *arg) {
+    if (thread_pool_threads_count == 0) {
+        routine(arg);
+        return;
+    }
+
+    ThreadPoolTask task = { routine, arg, group };
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+
+    // Counted before it is pushed, so that it never goes negative when stolen right away.
+    __atomic_add_fetch(&thread_pool_queued, 1, __ATOMIC_SEQ_CST);
+    thread_pool_deque_push(thread_pool_local != NULL ? thread_pool_local : thread_pool_shared,
+            &task);
+    // Counted after it is pushed, so that a joiner which missed it sees the count change.
+    __atomic_add_fetch(&thread_pool_forks, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&thread_pool_joining, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&thread_pool_mutex);
+        pthread_cond_broadcast(&thread_pool_cond);
+        pthread_mutex_unlock(&thread_pool_mutex);
+    } else if (__atomic_load_n(&thread_pool_idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&thread_pool_mutex);
+        pthread_cond_signal(&thread_pool_cond);
+        pthread_mutex_unlock(&thread_pool_mutex);
+    }
+}
+
+void thread_pool_join(ThreadPoolGroup *group) {
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        unsigned long forks = __atomic_load_n(&thread_pool_forks, __ATOMIC_SEQ_CST);
+
+        ThreadPoolTask task;
+        if (thread_pool_take(group, &task)) {
+            thread_pool_execute(&task);
+            continue;
+        }
+
+        // Sleep until a task of the group finishes elsewhere, or until a task is forked, which may
+        // be one of the group.
+        pthread_mutex_lock(&thread_pool_mutex);
+        __atomic_add_fetch(&thread_pool_joining, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&thread_pool_forks, __ATOMIC_SEQ_CST) == forks
+                && __atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+            pthread_cond_wait(&thread_pool_cond, &thread_pool_mutex);
+        }
+        __atomic_sub_fetch(&thread_pool_joining, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&thread_pool_mutex);
+    }
+}
+
+void thread_pool_run(void *(*routine)(void *), void *tasks, size_t task_size, unsigned int count) {
+    ThreadPoolGroup group;
+    thread_pool_group_init(&group);
+
+    for (unsigned int i = 1; i < count; i++) {
+        thread_pool_fork(&group, routine, (char *) tasks + i * task_size);
+    }
+    if (count > 0) {
+        routine(tasks);
+    }
+
+    thread_pool_join(&group);
+}
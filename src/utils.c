@@ -12,155 +12,6 @@
 #define ANSI_COLOR_GREEN   "\x1b[32m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
-static inline bool is_records_ascending(Record *records, size_t count) {
-    if (count == 0) {
-        return true;
-    }
-
-    int prev = records[0].value;
-    for (size_t i = 1; i < count; i++) {
-        int val = records[i].value;
-
-        if (prev > val) {
-            return false;
-        }
-
-        prev = val;
-    }
-
-    return true;
-}
-
-static inline void _radix_sort_indices_lsb(Record *dst, Record *begin, Record *end, Record *begin1,
-        unsigned int maxshift) {
-    size_t size = end - begin;
-    if (is_records_ascending(begin, size)) {
-        if (dst != begin) {
-            memcpy(dst, begin, size * sizeof(Record));
-        }
-        return;
-    }
-
-    Record *end1 = begin1 + size;
-
-    for (unsigned int shift = 0; shift <= maxshift; shift += 8) {
-        size_t count[0x100] = { 0 };
-        for (Record *p = begin; p != end; p++) {
-            count[(p->value >> shift) & 0xFF]++;
-        }
-
-        Record *bucket[0x100], *q = begin1;
-        for (int i = 0; i < 0x100; q += count[i++]) {
-            bucket[i] = q;
-        }
-
-        for (Record *p = begin; p != end; p++) {
-            *bucket[(p->value >> shift) & 0xFF]++ = *p;
-        }
-
-        Record *tmp;
-
-        tmp = begin;
-        begin = begin1;
-        begin1 = tmp;
-
-        tmp = end;
-        end = end1;
-        end1 = tmp;
-    }
-}
-
-static inline void _radix_sort_indices_msb2(Record *dst, Record *begin, Record *end, Record *begin1,
-        unsigned int shift) {
-    size_t size = end - begin;
-    if (is_records_ascending(begin, size)) {
-        if (dst != begin) {
-            memcpy(dst, begin, size * sizeof(Record));
-        }
-        return;
-    }
-
-    size_t count[0x100] = { 0 };
-    for (Record *p = begin; p != end; p++) {
-        count[(p->value >> shift) & 0xFF]++;
-    }
-
-    Record *bucket[0x100], *obucket[0x100], *q = begin1;
-    for (int i = 0; i < 0x100; q += count[i++]) {
-        obucket[i] = bucket[i] = q;
-    }
-
-    for (Record *p = begin; p != end; p++) {
-        *bucket[(p->value >> shift) & 0xFF]++ = *p;
-    }
-
-    for (int i = 0; i < 0x100; ++i) {
-        size_t off = (obucket[i] - begin1);
-        _radix_sort_indices_lsb(dst + off, obucket[i], bucket[i], begin + off, shift - 8);
-    }
-}
-
-static inline void _radix_sort_indices_msb(Record *dst, Record *begin, Record *end, Record *begin1,
-        unsigned int shift) {
-    size_t size = end - begin;
-    if (is_records_ascending(begin, size)) {
-        if (dst != begin) {
-            memcpy(dst, begin, size * sizeof(Record));
-        }
-        return;
-    }
-
-    size_t count[0x100] = { 0 };
-    for (Record *p = begin; p != end; p++) {
-        count[((p->value >> shift) & 0xFF) ^ (1 << 7)]++;
-    }
-
-    Record *bucket[0x100], *obucket[0x100], *q = begin1;
-    for (int i = 0; i < 0x100; q += count[i++]) {
-        obucket[i] = bucket[i] = q;
-    }
-
-    for (Record *p = begin; p != end; p++) {
-        *bucket[((p->value >> shift) & 0xFF) ^ (1 << 7)]++ = *p;
-    }
-
-    for (int i = 0; i < 0x100; ++i) {
-        size_t off = (obucket[i] - begin1);
-        _radix_sort_indices_msb2(dst + off, obucket[i], bucket[i], begin + off, shift - 8);
-    }
-}
-
-void radix_sort_indices(int *values_in, unsigned int *indices_in, int *values_out,
-        unsigned int *indices_out, size_t size) {
-    Record *buf = malloc(size * sizeof(Record));
-    Record *buf1 = malloc(size * sizeof(Record));
-
-    if (indices_in == NULL) {
-        for (size_t i = 0; i < size; i++) {
-            Record *r = &buf[i];
-            r->value = values_in[i];
-            r->position = i;
-        }
-    } else {
-        for (size_t i = 0; i < size; i++) {
-            Record *r = &buf[i];
-            r->value = values_in[i];
-            r->position = indices_in[i];
-        }
-    }
-
-    _radix_sort_indices_msb(buf, buf, buf + size, buf1, (sizeof(int) - 1) * 8);
-
-    for (size_t i = 0; i < size; i++) {
-        Record *r = &buf[i];
-        values_out[i] = r->value;
-        indices_out[i] = r->position;
-    }
-
-    free(buf);
-    free(buf1);
-}
-
 unsigned int binary_search_left(register int *values, unsigned int size, register int value) {
     register int left = 0;
     register int right = size - 1;
@@ -315,6 +166,41 @@ char *strip_quotes(char *str) {
     return ++str;
 }
 
+unsigned int parse_int_tuples(char *str, IntVector *values) {
+    unsigned int tuple_size = 0;
+
+    while (str != NULL) {
+        char *end = strchr(str, ')');
+        if (*str != '(' || end == NULL || (end[1] != ',' && end[1] != '\0')) {
+            return 0;
+        }
+        *end = '\0';
+
+        char *tuple = str + 1;
+        str = end[1] == ',' ? end + 2 : NULL;
+
+        unsigned int size = 0;
+        char *token;
+        while ((token = strsep(&tuple, ",")) != NULL) {
+            char *endptr;
+            int value = strtoi(token, &endptr);
+            if (endptr == token || *endptr != '\0') {
+                return 0;
+            }
+            int_vector_append(values, value);
+            size++;
+        }
+
+        if (tuple_size == 0) {
+            tuple_size = size;
+        } else if (size != tuple_size) {
+            return 0;
+        }
+    }
+
+    return tuple_size;
+}
+
 static inline bool is_valid_name_char(char c) {
     return c == '_' || c == '-' || isalnum(c);
 }